@@ -0,0 +1,1192 @@
+/**
+ * @file simple_message_bench.c
+ * TCP/IP Server-Client project
+ *
+ * Load generator for the simple_message_server. A single epoll loop drives
+ * a number of concurrent connections, each with one request in flight.
+ *
+ * In closed loop (the default) every connection sends its next request as
+ * soon as the previous response is complete. In open loop (--rate) requests
+ * arrive at a fixed rate no matter how fast the server answers; a request
+ * waiting for a free connection is timed from its arrival, so a slow server
+ * cannot hide its queueing delay.
+ *
+ * Latencies are recorded in log-linear histograms (as HdrHistogram does)
+ * for three phases:
+ *
+ *     connect     - connect() until the connection is established
+ *     first-byte  - request issued until the first byte of the response
+ *     full        - request issued until the response is complete
+ *
+ * Protocol 2 keeps the connections alive, so connect is only measured when
+ * a connection is (re-)established. Protocol 1 connects for every request,
+ * which is then part of first-byte and full as well.
+ *
+ * The builtin logic answers with the whole board, so runs are only
+ * comparable when they start with boards of the same size.
+ *
+ * With --parse no server is involved: a synthetic text response is parsed
+ * over and over, by the line-by-line fgets()/sscanf() scheme the client
+ * used before and by the incremental parser it uses now.
+ *
+ * With --spawn no server is involved either: a program is started over and
+ * over with fork() + exec, as the server started its external logic before,
+ * and with posix_spawn(), as it does now, while the bench holds
+ * --spawn-memory MiB resident like a grown server does.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_protocol.h"
+#include "simple_message_client_response.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <spawn.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define MAX_EVENTS 256
+#define RECV_CHUNK (64 * 1024)
+#define NSEC_PER_SEC 1000000000ULL
+
+/* histogram: values below HIST_SUB are exact, larger ones keep HIST_SUB_BITS significant bits */
+#define HIST_SUB_BITS 8
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_HALF (HIST_SUB / 2)
+#define HIST_SIZE (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)
+
+/* bytes of a binary response needed to know its status: tag, length, varint */
+#define STATUS_FIELD_MAX (2 + PROTOCOL_VARINT_MAX)
+/* --parse: files of the synthetic text response, and the reads it arrives in (the client's buffer) */
+#define PARSE_FILES 64
+#define PARSE_FILE_SIZE 128
+#define PARSE_CHUNK 1024
+/* --spawn: the program started, and the default resident memory of the bench in MiB */
+#define SPAWN_PROGRAM "/bin/true"
+#define SPAWN_MEMORY 256
+
+/* getopt codes for long options without a short equivalent */
+#define OPT_USER_SIZE 256
+#define OPT_IMAGE_SIZE 257
+#define OPT_MESSAGE_SIZE 258
+#define OPT_COMPRESS 259
+#define OPT_PARSE 260
+#define OPT_SPAWN 261
+#define OPT_SPAWN_MEMORY 262
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    uint64_t counts[HIST_SIZE];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} histogram_t;
+
+typedef enum
+{
+    BENCH_IDLE,             /* no request; the connection may be open or closed */
+    BENCH_CONNECTING,
+    BENCH_SENDING,
+    BENCH_RECEIVING
+} bench_state_t;
+
+typedef struct bench_conn
+{
+    int fd;                     /* -1 if not connected */
+    bench_state_t state;
+    unsigned long requests;     /* requests sent on the current connection */
+    uint64_t connect_start;
+    uint64_t start;             /* when the current request was issued */
+    uint64_t first_byte;        /* 0 until the response begins */
+
+    /* request being sent */
+    unsigned char *out;
+    size_t out_len;
+    size_t out_sent;
+
+    /* binary response being received: the head is collected, the rest only counted */
+    unsigned char head[PROTOCOL_PREAMBLE_SIZE + PROTOCOL_HEADER_SIZE + STATUS_FIELD_MAX];
+    size_t head_len;
+    size_t head_want;
+    int header_done;            /* the frame header has been parsed */
+    uint64_t payload;           /* payload bytes of the frame */
+    uint64_t skipped;           /* payload bytes received beyond the head */
+    smc_parser_t parser;        /* text response being received */
+
+    struct bench_conn *next_idle;
+} bench_conn_t;
+
+typedef struct
+{
+    const char *server;
+    const char *port;
+    int connections;
+    unsigned long requests;     /* 0 if limited by duration */
+    double duration;            /* seconds, 0 if limited by number of requests */
+    double rate;                /* requests per second, 0 for closed loop */
+    size_t user_size;
+    size_t image_size;
+    size_t message_size;
+    int protocol;
+    unsigned encodings;         /* PROTOCOL_ENCODING_* asked for in protocol 2 requests */
+    unsigned long parse;        /* responses to parse with --parse, 0 for a load run */
+    unsigned long spawn;        /* programs to start each way with --spawn, 0 for a load run */
+    unsigned long spawn_memory; /* MiB held resident during --spawn */
+} bench_options_t;
+
+/** --parse: the socket, replaced by reads of up to PARSE_CHUNK bytes from memory */
+typedef struct
+{
+    const char *src;
+    size_t src_len;
+    size_t src_pos;
+    char buf[PARSE_CHUNK];
+    size_t start;
+    size_t end;
+} parse_reader_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static const char *cpFilename;
+static bench_options_t options;
+
+static struct addrinfo *addresses;
+static struct addrinfo *address;        /* the address that worked */
+static struct addrinfo unixAddress;     /* unix:<path> instead of a name */
+static struct sockaddr_un unixPath;
+static int epfd;
+
+static char *cpUser, *cpImage, *cpMessage;
+static unsigned char *cpTextRequest;    /* the same for every protocol 1 request */
+static size_t textRequestLen;
+static size_t frameCap;                 /* size of a protocol 2 request with preamble */
+static uint32_t nextId;
+
+static bench_conn_t *conns;
+static bench_conn_t *idle;              /* connections without a request */
+
+static uint64_t benchStart, benchEnd, deadline;
+static unsigned long issued, completed, failed, badStatus;
+static uint64_t bytesReceived;
+
+static histogram_t histConnect, histFirstByte, histFull;
+static histogram_t histFork, histForkWait, histSpawn, histSpawnWait;   /* --spawn */
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static void usage(FILE *stream, int exitcode);
+static void exitWithError(const char *cpWhere, const char *cpMessage);
+static void parseOptions(int argc, char *argv[]);
+static uint64_t now(void);
+static char *filler(size_t size, char c);
+static void histRecord(histogram_t *hist, uint64_t value);
+static uint64_t histUpperBound(int index);
+static uint64_t histPercentile(const histogram_t *hist, double percentile);
+static void histPrint(const char *cpName, const histogram_t *hist);
+static void resolve(void);
+static void watch(bench_conn_t *conn, int op, uint32_t events);
+static void pushIdle(bench_conn_t *conn);
+static void closeConn(bench_conn_t *conn);
+static void issue(bench_conn_t *conn, uint64_t start);
+static void startConnect(bench_conn_t *conn);
+static void connected(bench_conn_t *conn);
+static void startSend(bench_conn_t *conn);
+static void sendRequest(bench_conn_t *conn);
+static void receiveResponse(bench_conn_t *conn);
+static int feedResponse(bench_conn_t *conn, const unsigned char *data, size_t len);
+static int responseStatus(const bench_conn_t *conn);
+static void finish(bench_conn_t *conn, int ok);
+static int moreToIssue(uint64_t t);
+static uint64_t arrival(unsigned long index);
+static void report(void);
+static size_t parseFill(parse_reader_t *reader);
+static void parseSkip(parse_reader_t *reader, size_t size);
+static char *parseGets(parse_reader_t *reader, char *cpLine, size_t size);
+static unsigned long parseLegacy(parse_reader_t *reader, int *pStatus);
+static unsigned long parseIncremental(parse_reader_t *reader, smc_parser_t *parser, int *pStatus);
+static void parseBench(void);
+static void spawnBench(void);
+
+/**
+ * ------------------------------------------------------------- main --
+ */
+int main(int argc, char *argv[])
+{
+    struct epoll_event events[MAX_EVENTS];
+    bench_conn_t *conn;
+    uint64_t t, next;
+    long timeout;
+    int i, n;
+
+    cpFilename = argv[0];
+    parseOptions(argc, argv);
+
+    if (options.parse > 0) {
+        parseBench();
+        return EXIT_SUCCESS;
+    }
+
+    if (options.spawn > 0) {
+        spawnBench();
+        return EXIT_SUCCESS;
+    }
+
+    resolve();
+
+    /* payloads of the chosen sizes, the same for every request */
+    cpUser = filler(options.user_size, 'u');
+    cpMessage = filler(options.message_size, 'm');
+    cpImage = options.image_size > 0 ? filler(options.image_size, 'i') : NULL;
+    frameCap = PROTOCOL_PREAMBLE_SIZE + PROTOCOL_HEADER_SIZE + protocolRequestLength(cpUser, cpImage, cpMessage, options.encodings, 0);
+    textRequestLen = strlen("user=\n") + options.user_size + options.message_size + 1 +
+        (cpImage != NULL ? strlen("img=\n") + options.image_size : 0);
+    if ((cpTextRequest = malloc(textRequestLen + 1)) == NULL) exitWithError("malloc()", strerror(errno));
+    (void) snprintf((char *) cpTextRequest, textRequestLen + 1, "user=%s\n%s%s%s%s\n", cpUser,
+                    cpImage != NULL ? "img=" : "", cpImage != NULL ? cpImage : "", cpImage != NULL ? "\n" : "",
+                    cpMessage);
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) exitWithError("epoll_create1()", strerror(errno));
+
+    if ((conns = calloc((size_t) options.connections, sizeof(*conns))) == NULL) {
+        exitWithError("calloc()", strerror(errno));
+    }
+    for (i = options.connections - 1; i >= 0; i--) {
+        conns[i].fd = -1;
+        if (options.protocol >= PROTOCOL_VERSION && (conns[i].out = malloc(frameCap)) == NULL) {
+            exitWithError("malloc()", strerror(errno));
+        }
+        pushIdle(&conns[i]);
+    }
+
+    benchStart = now();
+    deadline = options.duration > 0 ? benchStart + (uint64_t) (options.duration * NSEC_PER_SEC) : UINT64_MAX;
+
+    for (;;) {
+        t = now();
+
+        /* hand out the requests which are due to idle connections */
+        while (idle != NULL && moreToIssue(t)) {
+            if (options.rate > 0 && arrival(issued) > t) break;
+            conn = idle;
+            idle = conn->next_idle;
+            issue(conn, options.rate > 0 ? arrival(issued) : t);
+        }
+
+        if (issued == completed + failed && !moreToIssue(t)) break;
+
+        /* sleep until the next arrival, if a connection is free to take it */
+        timeout = -1;
+        if (options.rate > 0 && idle != NULL && moreToIssue(t)) {
+            next = arrival(issued);
+            timeout = next > t ? (long) ((next - t + 999999) / 1000000) : 0;
+        }
+        if (options.duration > 0 && moreToIssue(t)) {
+            next = (deadline - t + 999999) / 1000000;
+            if (timeout < 0 || (long) next < timeout) timeout = (long) next;
+        }
+
+        if ((n = epoll_wait(epfd, events, MAX_EVENTS, (int) (timeout > INT_MAX ? INT_MAX : timeout))) < 0) {
+            if (errno == EINTR) continue;
+            exitWithError("epoll_wait()", strerror(errno));
+        }
+
+        for (i = 0; i < n; i++) {
+            conn = events[i].data.ptr;
+            if (conn->fd < 0) continue;
+
+            switch (conn->state) {
+            case BENCH_CONNECTING:
+                connected(conn);
+                break;
+            case BENCH_SENDING:
+                sendRequest(conn);
+                break;
+            case BENCH_RECEIVING:
+                receiveResponse(conn);
+                break;
+            case BENCH_IDLE:
+                /* the server closed an idle keep-alive connection */
+                closeConn(conn);
+                break;
+            }
+        }
+    }
+
+    benchEnd = now();
+    report();
+    return failed > 0 || badStatus > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * \brief print usage information and exit
+ */
+static void usage(FILE *stream, int exitcode)
+{
+    if (fprintf(stream,
+            "\n usage: %s options\n"
+            "options:\n"
+            "        -s, --server <server>           IP address or name of the server, or unix:<path>\n"
+            "        -p, --port <port>               port of the server (not needed for unix:<path>)\n"
+            "        -c, --connections <n>           concurrent connections (default 1)\n"
+            "        -n, --requests <n>              requests to send (default 1000)\n"
+            "        -d, --duration <seconds>        send requests for this long instead\n"
+            "        -r, --rate <requests/s>         open loop at a fixed arrival rate (default closed loop)\n"
+            "        --user-size <bytes>             length of the user name (default 8)\n"
+            "        --image-size <bytes>            length of the image URL (default 0: no image)\n"
+            "        --message-size <bytes>          length of the message (default 64)\n"
+            "        -P, --protocol <1|2>            1: text, connection per request; 2: binary keep-alive (default)\n"
+            "        --compress                      ask for compressed board pages (protocol 2)\n"
+            "        --parse <n>                     no server: time parsing n text responses, before and now\n"
+            "        --spawn <n>                     no server: time starting a program n times with fork() + exec\n"
+            "                                        and with posix_spawn()\n"
+            "        --spawn-memory <MiB>            memory the bench holds resident during --spawn (default 256)\n"
+            "        -h, --help\n", cpFilename) < 0) {
+        exitcode = errno;
+    }
+
+    exit(exitcode);
+}
+
+static void exitWithError(const char *cpWhere, const char *cpMessage)
+{
+    int save_errno = 0;
+
+    if (fprintf(stderr, "%s - %s: %s\n", cpFilename, cpWhere, cpMessage) < 0) save_errno = errno;
+
+    if (save_errno != 0) exit(save_errno);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief parse the command line into options
+ */
+static void parseOptions(int argc, char *argv[])
+{
+    struct option long_options[] =
+    {
+        {"server", 1, NULL, 's'},
+        {"port", 1, NULL, 'p'},
+        {"connections", 1, NULL, 'c'},
+        {"requests", 1, NULL, 'n'},
+        {"duration", 1, NULL, 'd'},
+        {"rate", 1, NULL, 'r'},
+        {"user-size", 1, NULL, OPT_USER_SIZE},
+        {"image-size", 1, NULL, OPT_IMAGE_SIZE},
+        {"message-size", 1, NULL, OPT_MESSAGE_SIZE},
+        {"protocol", 1, NULL, 'P'},
+        {"compress", 0, NULL, OPT_COMPRESS},
+        {"parse", 1, NULL, OPT_PARSE},
+        {"spawn", 1, NULL, OPT_SPAWN},
+        {"spawn-memory", 1, NULL, OPT_SPAWN_MEMORY},
+        {"help", 0, NULL, 'h'},
+        {0, 0, 0, 0}
+    };
+    unsigned long value;
+    char *end;
+    int c;
+
+    options.connections = 1;
+    options.requests = 1000;
+    options.user_size = 8;
+    options.message_size = 64;
+    options.protocol = PROTOCOL_VERSION;
+    options.spawn_memory = SPAWN_MEMORY;
+
+    while ((c = getopt_long(argc, argv, "s:p:c:n:d:r:P:h", long_options, NULL)) != -1) {
+
+        /* all other arguments are non-negative numbers */
+        value = 0;
+        if (c != 's' && c != 'p' && c != 'd' && c != 'r' && c != 'h' && c != '?' && c != OPT_COMPRESS) {
+            errno = 0;
+            value = strtoul(optarg, &end, 10);
+            if (errno != 0 || end == optarg || *end != '\0' || optarg[0] == '-') usage(stderr, EXIT_FAILURE);
+        }
+
+        switch (c) {
+        case 's':
+            options.server = optarg;
+            break;
+        case 'p':
+            options.port = optarg;
+            break;
+        case 'c':
+            if (value < 1 || value > INT_MAX) usage(stderr, EXIT_FAILURE);
+            options.connections = (int) value;
+            break;
+        case 'n':
+            if (value < 1) usage(stderr, EXIT_FAILURE);
+            options.requests = value;
+            break;
+        case 'd':
+        case 'r':
+            errno = 0;
+            if (c == 'd') options.duration = strtod(optarg, &end);
+            else options.rate = strtod(optarg, &end);
+            if (errno != 0 || end == optarg || *end != '\0' || (c == 'd' ? options.duration : options.rate) <= 0) {
+                usage(stderr, EXIT_FAILURE);
+            }
+            break;
+        case OPT_USER_SIZE:
+            if (value < 1) usage(stderr, EXIT_FAILURE);
+            options.user_size = value;
+            break;
+        case OPT_IMAGE_SIZE:
+            options.image_size = value;
+            break;
+        case OPT_MESSAGE_SIZE:
+            options.message_size = value;
+            break;
+        case 'P':
+            if (value == PROTOCOL_VERSION_TEXT || value == PROTOCOL_VERSION) options.protocol = (int) value;
+            else usage(stderr, EXIT_FAILURE);
+            break;
+        case OPT_COMPRESS:
+            options.encodings = PROTOCOL_ENCODING_DEFLATE;
+            break;
+        case OPT_PARSE:
+            if (value < 1) usage(stderr, EXIT_FAILURE);
+            options.parse = value;
+            break;
+        case OPT_SPAWN:
+            if (value < 1) usage(stderr, EXIT_FAILURE);
+            options.spawn = value;
+            break;
+        case OPT_SPAWN_MEMORY:
+            if (value > SIZE_MAX / (1024 * 1024)) usage(stderr, EXIT_FAILURE);
+            options.spawn_memory = value;
+            break;
+        case 'h':
+            usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (optind != argc) usage(stderr, EXIT_FAILURE);
+    if (options.parse == 0 && options.spawn == 0 && (options.server == NULL ||
+        (options.port == NULL && strncmp(options.server, "unix:", 5) != 0))) usage(stderr, EXIT_FAILURE);
+
+    /* a duration replaces the number of requests */
+    if (options.duration > 0) options.requests = 0;
+}
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * \brief a string of size times c
+ */
+static char *filler(size_t size, char c)
+{
+    char *cp;
+
+    if ((cp = malloc(size + 1)) == NULL) exitWithError("malloc()", strerror(errno));
+    memset(cp, c, size);
+    cp[size] = '\0';
+    return cp;
+}
+
+/**
+ * \brief count a value (nanoseconds)
+ *
+ * Values below HIST_SUB get a bucket of their own. Above, each power of two
+ * is split into HIST_HALF buckets, so a value is off by less than 1%.
+ */
+static void histRecord(histogram_t *hist, uint64_t value)
+{
+    int msb, shift, index;
+
+    if (value < HIST_SUB) {
+        index = (int) value;
+    } else {
+        msb = 63 - __builtin_clzll(value);
+        shift = msb - HIST_SUB_BITS + 1;
+        index = HIST_SUB + (shift - 1) * HIST_HALF + (int) (value >> shift) - HIST_HALF;
+    }
+
+    hist->counts[index]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max) hist->max = value;
+}
+
+/**
+ * \brief largest value counted in a bucket
+ */
+static uint64_t histUpperBound(int index)
+{
+    int shift;
+
+    if (index < HIST_SUB) return (uint64_t) index;
+
+    shift = (index - HIST_SUB) / HIST_HALF + 1;
+    return (((uint64_t) ((index - HIST_SUB) % HIST_HALF + HIST_HALF + 1)) << shift) - 1;
+}
+
+/**
+ * \brief smallest value which percentile percent of the values do not exceed
+ */
+static uint64_t histPercentile(const histogram_t *hist, double percentile)
+{
+    uint64_t rank, seen = 0, bound;
+    int i;
+
+    if (hist->total == 0) return 0;
+
+    rank = (uint64_t) (percentile / 100.0 * (double) hist->total + 0.5);
+    if (rank < 1) rank = 1;
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            bound = histUpperBound(i);
+            return bound < hist->max ? bound : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+static void histPrint(const char *cpName, const histogram_t *hist)
+{
+    if (hist->total == 0) {
+        printf("%-11s %10d %10s %10s %10s %10s %10s\n", cpName, 0, "-", "-", "-", "-", "-");
+        return;
+    }
+
+    printf("%-11s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", cpName, (unsigned long long) hist->total,
+           (double) histPercentile(hist, 50.0) / 1000.0,
+           (double) histPercentile(hist, 99.0) / 1000.0,
+           (double) histPercentile(hist, 99.9) / 1000.0,
+           (double) hist->max / 1000.0,
+           (double) hist->sum / (double) hist->total / 1000.0);
+}
+
+/**
+ * \brief look up the server once for all connections
+ */
+static void resolve(void)
+{
+    struct addrinfo hints;
+    int iRetValue;
+
+    /* unix:<path> - the Unix domain socket of a server on this host */
+    if (strncmp(options.server, "unix:", 5) == 0) {
+        if (strlen(options.server + 5) >= sizeof(unixPath.sun_path)) {
+            exitWithError("socket(AF_UNIX)", strerror(ENAMETOOLONG));
+        }
+        unixPath.sun_family = AF_UNIX;
+        strcpy(unixPath.sun_path, options.server + 5);
+        unixAddress.ai_family = AF_UNIX;
+        unixAddress.ai_socktype = SOCK_STREAM;
+        unixAddress.ai_addr = (struct sockaddr *) &unixPath;
+        unixAddress.ai_addrlen = sizeof(unixPath);
+        address = &unixAddress;
+        return;
+    }
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    if ((iRetValue = getaddrinfo(options.server, options.port, &hints, &addresses)) != 0) {
+        exitWithError("getaddrinfo()", gai_strerror(iRetValue));
+    }
+    address = addresses;
+}
+
+static void watch(bench_conn_t *conn, int op, uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = conn;
+    if (epoll_ctl(epfd, op, conn->fd, &ev) < 0) exitWithError("epoll_ctl()", strerror(errno));
+}
+
+static void pushIdle(bench_conn_t *conn)
+{
+    conn->state = BENCH_IDLE;
+    conn->next_idle = idle;
+    idle = conn;
+}
+
+static void closeConn(bench_conn_t *conn)
+{
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+/**
+ * \brief start a request on an idle connection
+ *
+ * \param start - time the request is measured from
+ */
+static void issue(bench_conn_t *conn, uint64_t start)
+{
+    issued++;
+    conn->start = start;
+    conn->first_byte = 0;
+
+    if (conn->fd < 0) startConnect(conn);
+    else startSend(conn);
+}
+
+/**
+ * \brief open a non-blocking connection
+ *
+ * Until one address worked, the others are tried in the order of getaddrinfo().
+ */
+static void startConnect(bench_conn_t *conn)
+{
+    for (;;) {
+        conn->connect_start = now();
+        conn->requests = 0;
+        if ((conn->fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                               address->ai_protocol)) < 0) {
+            exitWithError("socket()", strerror(errno));
+        }
+
+        if (connect(conn->fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) break;
+
+        closeConn(conn);
+        if (completed == 0 && address->ai_next != NULL) {
+            address = address->ai_next;
+            continue;
+        }
+        finish(conn, 0);
+        return;
+    }
+
+    conn->state = BENCH_CONNECTING;
+    watch(conn, EPOLL_CTL_ADD, EPOLLOUT);
+}
+
+static void connected(bench_conn_t *conn)
+{
+    socklen_t len = sizeof(int);
+    int error = 0;
+
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+        closeConn(conn);
+        if (completed == 0 && address->ai_next != NULL) {
+            address = address->ai_next;
+            startConnect(conn);
+            return;
+        }
+        finish(conn, 0);
+        return;
+    }
+
+    histRecord(&histConnect, now() - conn->connect_start);
+    startSend(conn);
+}
+
+/**
+ * \brief prepare the request and send as much of it as the socket takes
+ */
+static void startSend(bench_conn_t *conn)
+{
+    size_t start = 0;
+
+    if (options.protocol >= PROTOCOL_VERSION) {
+        if (conn->requests == 0) start = protocolPutPreamble(conn->out, PROTOCOL_VERSION);
+        conn->out_len = start + protocolPutRequest(conn->out + start, ++nextId, PROTOCOL_FLAG_KEEP_ALIVE,
+                                                   cpUser, cpImage, cpMessage, options.encodings, NULL, 0);
+        conn->head_want = (conn->requests == 0 ? PROTOCOL_PREAMBLE_SIZE : 0) + PROTOCOL_HEADER_SIZE;
+    } else {
+        conn->out = cpTextRequest;
+        conn->out_len = textRequestLen;
+        conn->head_want = 0;
+        parserReset(&conn->parser);
+    }
+
+    conn->out_sent = 0;
+    conn->head_len = 0;
+    conn->header_done = 0;
+    conn->payload = 0;
+    conn->skipped = 0;
+    conn->state = BENCH_SENDING;
+    watch(conn, EPOLL_CTL_MOD, EPOLLOUT);
+    sendRequest(conn);
+}
+
+static void sendRequest(bench_conn_t *conn)
+{
+    ssize_t n;
+
+    while (conn->out_sent < conn->out_len) {
+        if ((n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            finish(conn, 0);
+            return;
+        }
+        conn->out_sent += (size_t) n;
+    }
+
+    /* a text request ends where the client stops sending */
+    if (options.protocol < PROTOCOL_VERSION) (void) shutdown(conn->fd, SHUT_WR);
+
+    conn->requests++;
+    conn->state = BENCH_RECEIVING;
+    watch(conn, EPOLL_CTL_MOD, EPOLLIN);
+}
+
+static void receiveResponse(bench_conn_t *conn)
+{
+    static unsigned char buf[RECV_CHUNK];
+    ssize_t n;
+    int result;
+
+    for (;;) {
+        if ((n = recv(conn->fd, buf, sizeof(buf), 0)) < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            finish(conn, 0);
+            return;
+        }
+
+        if (conn->first_byte == 0 && n > 0) {
+            conn->first_byte = now();
+            histRecord(&histFirstByte, conn->first_byte - conn->start);
+        }
+        bytesReceived += (uint64_t) n;
+
+        /* a text response ends with the connection */
+        if (n == 0) {
+            finish(conn, options.protocol < PROTOCOL_VERSION);
+            return;
+        }
+
+        if ((result = feedResponse(conn, buf, (size_t) n)) != 0) {
+            finish(conn, result > 0);
+            return;
+        }
+    }
+}
+
+/**
+ * \brief account for received bytes of a response
+ *
+ * \return 1 if the (binary) response is complete, -1 if it is malformed, 0 if more is expected
+ */
+static int feedResponse(bench_conn_t *conn, const unsigned char *data, size_t len)
+{
+    protocol_header_t header;
+    size_t n, preamble;
+    int iResult;
+
+    /* a text response is parsed as it arrives, the file bodies are passed over */
+    while (options.protocol < PROTOCOL_VERSION && len > 0) {
+        iResult = parserFeed(&conn->parser, (const char *) data, len, &n);
+        if (iResult == PARSER_ERROR) return -1;
+        if (iResult == PARSER_FILE) parserSkipBody(&conn->parser);
+        data += n;
+        len -= n;
+    }
+
+    /* collect what is needed to parse the header and the status */
+    n = conn->head_want - conn->head_len;
+    if (n > len) n = len;
+    memcpy(conn->head + conn->head_len, data, n);
+    conn->head_len += n;
+    data += n;
+    len -= n;
+
+    if (options.protocol < PROTOCOL_VERSION) return 0;
+
+    preamble = conn->requests == 1 ? PROTOCOL_PREAMBLE_SIZE : 0;
+
+    if (!conn->header_done) {
+        if (conn->head_len < preamble + PROTOCOL_HEADER_SIZE) return 0;
+        if (preamble > 0 && protocolGetPreamble(conn->head, preamble) <= 0) return -1;
+        protocolGetHeader(conn->head + preamble, &header);
+        if (header.type != PROTOCOL_FRAME_RESPONSE) return -1;
+        conn->header_done = 1;
+        conn->payload = header.length;
+        conn->head_want += header.length < STATUS_FIELD_MAX ? header.length : STATUS_FIELD_MAX;
+        return feedResponse(conn, data, len);
+    }
+
+    /* with one request in flight, nothing may follow the response */
+    conn->skipped += len;
+    n = conn->head_len - preamble - PROTOCOL_HEADER_SIZE;
+    if (n + conn->skipped > conn->payload) return -1;
+    return n + conn->skipped == conn->payload ? 1 : 0;
+}
+
+/**
+ * \brief status of the response, -1 if it has none
+ */
+static int responseStatus(const bench_conn_t *conn)
+{
+    const unsigned char *cp;
+    uint64_t fieldLen, status;
+    size_t len;
+    int n;
+
+    if (options.protocol < PROTOCOL_VERSION) {
+        if (!conn->parser.has_status || conn->parser.status < 0 || conn->parser.status > INT_MAX) return -1;
+        return (int) conn->parser.status;
+    }
+
+    len = conn->requests == 1 ? PROTOCOL_PREAMBLE_SIZE : 0;
+    cp = conn->head + len + PROTOCOL_HEADER_SIZE;
+    len = conn->head_len - len - PROTOCOL_HEADER_SIZE;
+
+    if (len < 2 || cp[0] != PROTOCOL_FIELD_STATUS) return -1;
+    if ((n = protocolGetVarint(cp + 1, len - 1, &fieldLen)) <= 0 || fieldLen > len - 1 - (size_t) n) return -1;
+    if (protocolGetVarint(cp + 1 + n, (size_t) fieldLen, &status) <= 0 || status > INT_MAX) return -1;
+    return (int) status;
+}
+
+/**
+ * \brief end the current request of the connection
+ *
+ * \param ok - the response is complete
+ */
+static void finish(bench_conn_t *conn, int ok)
+{
+    if (ok) {
+        completed++;
+        histRecord(&histFull, now() - conn->start);
+        if (responseStatus(conn) != 0) badStatus++;
+    } else {
+        failed++;
+    }
+
+    /* a keep-alive connection is kept for the next request */
+    if (conn->fd >= 0 && (!ok || options.protocol < PROTOCOL_VERSION)) closeConn(conn);
+    if (conn->fd >= 0) watch(conn, EPOLL_CTL_MOD, EPOLLIN | EPOLLRDHUP);
+
+    pushIdle(conn);
+}
+
+/**
+ * \brief whether further requests are to be issued at time t
+ */
+static int moreToIssue(uint64_t t)
+{
+    if (options.requests > 0) return issued < options.requests;
+    return t < deadline && (options.rate <= 0 || arrival(issued) < deadline);
+}
+
+/**
+ * \brief scheduled arrival of the request with the given index in open loop
+ */
+static uint64_t arrival(unsigned long index)
+{
+    return benchStart + (uint64_t) ((double) index * (double) NSEC_PER_SEC / options.rate);
+}
+
+static void report(void)
+{
+    double seconds = (double) (benchEnd - benchStart) / (double) NSEC_PER_SEC;
+    unsigned long scheduled;
+
+    printf("%s loop, protocol %d, %d connection(s)\n",
+           options.rate > 0 ? "open" : "closed", options.protocol, options.connections);
+    if (options.rate > 0) printf("target rate: %.1f requests/s\n", options.rate);
+    /* in open loop, arrivals still waiting for a connection at the deadline are not sent */
+    if (options.rate > 0 && options.duration > 0) {
+        scheduled = (unsigned long) (options.duration * options.rate);
+        if ((double) scheduled < options.duration * options.rate) scheduled++;
+        if (scheduled > issued) printf("missed:      %lu arrivals found no free connection\n", scheduled - issued);
+    }
+    printf("requests:    %lu completed, %lu failed, %lu with status != 0\n", completed, failed, badStatus);
+    printf("duration:    %.3f s\n", seconds);
+    printf("throughput:  %.1f requests/s, %.2f MB/s received\n",
+           (double) completed / seconds, (double) bytesReceived / seconds / 1e6);
+    printf("\n%-11s %10s %10s %10s %10s %10s %10s\n", "latency(us)", "count", "p50", "p99", "p999", "max", "mean");
+    histPrint("connect", &histConnect);
+    histPrint("first-byte", &histFirstByte);
+    histPrint("full", &histFull);
+}
+
+/**
+ * \brief make bytes available like a read() of the socket would
+ *
+ * \return number of buffered bytes, 0 at the end of the response
+ */
+static size_t parseFill(parse_reader_t *reader)
+{
+    size_t n;
+
+    if (reader->start < reader->end) return reader->end - reader->start;
+
+    n = reader->src_len - reader->src_pos < PARSE_CHUNK ? reader->src_len - reader->src_pos : PARSE_CHUNK;
+    memcpy(reader->buf, reader->src + reader->src_pos, n);
+    reader->src_pos += n;
+    reader->start = 0;
+    reader->end = n;
+    return n;
+}
+
+/**
+ * \brief pass over a file body, as writing it is not what is measured
+ */
+static void parseSkip(parse_reader_t *reader, size_t size)
+{
+    size_t n;
+
+    while (size > 0 && (n = parseFill(reader)) > 0) {
+        if (n > size) n = size;
+        reader->start += n;
+        size -= n;
+    }
+}
+
+/**
+ * \brief the client's former line reader: one byte at a time into a fixed buffer
+ */
+static char *parseGets(parse_reader_t *reader, char *cpLine, size_t size)
+{
+    size_t used = 0;
+
+    while (used + 1 < size) {
+        if (parseFill(reader) == 0) break;
+
+        cpLine[used++] = reader->buf[reader->start++];
+        if (cpLine[used - 1] == '\n') break;
+    }
+
+    if (used == 0) return NULL;
+    cpLine[used] = '\0';
+    return cpLine;
+}
+
+/**
+ * \brief parse a response the way the client did before the incremental parser
+ *
+ * The file name is freed and sized with room for its terminator, which the
+ * client did not do; everything else is as it was.
+ *
+ * \return number of files
+ */
+static unsigned long parseLegacy(parse_reader_t *reader, int *pStatus)
+{
+    char cBuf[PARSE_CHUNK], *cpName = NULL;
+    unsigned long files = 0;
+    int iLength;
+
+    while (parseGets(reader, cBuf, sizeof(cBuf))) {
+        if (strncmp(cBuf, "status=", 7) == 0) {
+            if (sscanf(cBuf, "status=%d", pStatus) == 0) exitWithError("sscanf()", "status could not be scanned");
+        }
+        if (strncmp(cBuf, "file=", 5) == 0) {
+            free(cpName);
+            if ((cpName = malloc(strlen(cBuf) - 5)) == NULL) exitWithError("malloc()", strerror(errno));
+            if (sscanf(cBuf, "file=%s", cpName) == 0) exitWithError("sscanf()", "file could not be scanned");
+        }
+        if (strncmp(cBuf, "len=", 4) == 0) {
+            if (sscanf(cBuf, "len=%d", &iLength) == 0 || iLength < 0) exitWithError("sscanf()", "len could not be scanned");
+            parseSkip(reader, (size_t) iLength);
+            files++;
+        }
+    }
+
+    free(cpName);
+    return files;
+}
+
+/**
+ * \brief parse a response the way the client does now
+ *
+ * \return number of files
+ */
+static unsigned long parseIncremental(parse_reader_t *reader, smc_parser_t *parser, int *pStatus)
+{
+    unsigned long files = 0;
+    size_t consumed;
+    int iResult;
+
+    parserReset(parser);
+
+    while (parseFill(reader) > 0) {
+        iResult = parserFeed(parser, reader->buf + reader->start, reader->end - reader->start, &consumed);
+        reader->start += consumed;
+
+        if (iResult == PARSER_ERROR) exitWithError("parserFeed()", "malformed response");
+        if (iResult == PARSER_STATUS) *pStatus = (int) parser->status;
+        if (iResult == PARSER_FILE) {
+            parseSkip(reader, (size_t) parser->length);
+            files++;
+        }
+    }
+
+    return files;
+}
+
+/**
+ * \brief time both parsers on the same synthetic response
+ */
+static void parseBench(void)
+{
+    parse_reader_t reader;
+    smc_parser_t parser;
+    char *cpResponse, *cp;
+    size_t size = strlen("status=0\n");
+    uint64_t start, legacy, incremental;
+    unsigned long i, files;
+    int iStatus, f;
+
+    /* status and PARSE_FILES small files, so that the headers dominate */
+    for (f = 0; f < PARSE_FILES; f++) {
+        size += (size_t) snprintf(NULL, 0, "file=response_%03d.html\nlen=%d\n", f, PARSE_FILE_SIZE) + PARSE_FILE_SIZE;
+    }
+    if ((cpResponse = malloc(size + 1)) == NULL) exitWithError("malloc()", strerror(errno));
+    cp = cpResponse + sprintf(cpResponse, "status=0\n");
+    for (f = 0; f < PARSE_FILES; f++) {
+        cp += sprintf(cp, "file=response_%03d.html\nlen=%d\n", f, PARSE_FILE_SIZE);
+        memset(cp, 'x', PARSE_FILE_SIZE);
+        cp += PARSE_FILE_SIZE;
+    }
+
+    memset(&reader, 0, sizeof(reader));
+    memset(&parser, 0, sizeof(parser));
+    reader.src = cpResponse;
+    reader.src_len = size;
+
+    start = now();
+    for (i = 0; i < options.parse; i++) {
+        reader.src_pos = reader.start = reader.end = 0;
+        iStatus = -1;
+        files = parseLegacy(&reader, &iStatus);
+        if (files != PARSE_FILES || iStatus != 0) exitWithError("parseLegacy()", "wrong result");
+    }
+    legacy = now() - start;
+
+    start = now();
+    for (i = 0; i < options.parse; i++) {
+        reader.src_pos = reader.start = reader.end = 0;
+        iStatus = -1;
+        files = parseIncremental(&reader, &parser, &iStatus);
+        if (files != PARSE_FILES || iStatus != 0) exitWithError("parseIncremental()", "wrong result");
+    }
+    incremental = now() - start;
+
+    printf("parse: %lu text responses of %lu bytes (%d files), read %d bytes at a time\n",
+           options.parse, (unsigned long) size, PARSE_FILES, PARSE_CHUNK);
+    printf("fgets/sscanf: %10.0f ns/response %8.1f MB/s\n",
+           (double) legacy / (double) options.parse, (double) size * (double) options.parse / ((double) legacy / 1e3));
+    printf("incremental:  %10.0f ns/response %8.1f MB/s\n",
+           (double) incremental / (double) options.parse, (double) size * (double) options.parse / ((double) incremental / 1e3));
+    printf("speedup:      %10.1fx\n", (double) legacy / (double) incremental);
+
+    parserFree(&parser);
+    free(cpResponse);
+}
+
+/**
+ * \brief wait for a program started by spawnBench() - exits if it failed
+ */
+static void spawnWait(pid_t pid)
+{
+    int status;
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) exitWithError("waitpid()", strerror(errno));
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) exitWithError("waitpid()", SPAWN_PROGRAM " failed");
+}
+
+/**
+ * \brief --spawn: start SPAWN_PROGRAM with fork() + exec and with posix_spawn()
+ *
+ * The bench touches --spawn-memory MiB first, standing in for a server
+ * that has grown. Recorded are the time until the call returns in the
+ * parent, which the server reports as sms_spawn_duration_seconds, and the
+ * time until the program has exited. posix_spawn() returns only after the
+ * exec, so the second figure is the fair comparison.
+ */
+static void spawnBench(void)
+{
+    char *argv[] = { (char *) SPAWN_PROGRAM, NULL };
+    char *cpBallast = NULL;
+    size_t size = (size_t) options.spawn_memory * 1024 * 1024, off;
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long i;
+    uint64_t start;
+    pid_t pid;
+    int iResult;
+
+    if (size > 0) {
+        if ((cpBallast = malloc(size)) == NULL) exitWithError("malloc()", strerror(errno));
+        /* every page resident, so fork() has page tables to copy */
+        for (off = 0; off < size; off += (size_t) (page > 0 ? page : 4096)) cpBallast[off] = (char) off;
+    }
+
+    for (i = 0; i < options.spawn; i++) {
+        start = now();
+        pid = fork();
+        if (pid == 0) {
+            execv(SPAWN_PROGRAM, argv);
+            _exit(127);
+        }
+        histRecord(&histFork, now() - start);
+        if (pid < 0) exitWithError("fork()", strerror(errno));
+        spawnWait(pid);
+        histRecord(&histForkWait, now() - start);
+    }
+
+    for (i = 0; i < options.spawn; i++) {
+        start = now();
+        iResult = posix_spawn(&pid, SPAWN_PROGRAM, NULL, NULL, argv, environ);
+        histRecord(&histSpawn, now() - start);
+        if (iResult != 0) exitWithError("posix_spawn()", strerror(iResult));
+        spawnWait(pid);
+        histRecord(&histSpawnWait, now() - start);
+    }
+
+    printf("spawn: %lu x %s each way, %lu MiB resident\n", options.spawn, SPAWN_PROGRAM, options.spawn_memory);
+    printf("\n%-11s %10s %10s %10s %10s %10s %10s\n", "latency(us)", "count", "p50", "p99", "p999", "max", "mean");
+    histPrint("fork", &histFork);
+    histPrint("fork+wait", &histForkWait);
+    histPrint("posix_spawn", &histSpawn);
+    histPrint("spawn+wait", &histSpawnWait);
+
+    free(cpBallast);
+}
@@ -18,20 +18,77 @@
  /**
  * -------------------------------------------------------------- includes --
  */
+#define _GNU_SOURCE
 #include "simple_message_client_commandline_handling.h"
+#include "simple_message_client_batch.h"
+#include "simple_message_client_response.h"
+#include "simple_message_protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
  
 /**
  * -------------------------------------------------------------- defines --
  */
 #define MAX_BUF 1024 
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+/* output chunk of the decompression of a response file */
+#define INFLATE_CHUNK (64 * 1024)
+/* head start of a connect attempt before the next address is tried (RFC 8305) */
+#define CONNECT_ATTEMPT_DELAY_MS 250
+/* a Unix domain socket with a full backlog is tried again after this long */
+#define UNIX_CONNECT_RETRY_MS 10
+/* names of the response files received so far, one per line, for --conditional */
+#define KNOWN_FILES_MANIFEST ".simple_message_client.files"
+/* the server looks at no more known files than this */
+#define KNOWN_FILES_MAX 16
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+/** buffered reader on the socket; unlike stdio it tells how many bytes are buffered */
+typedef struct
+{
+	int iFD;
+	char cBuf[MAX_BUF];
+	size_t start;
+	size_t end;
+} reader_t;
+
+/** where the requests come from: the messages of the command line or a batch */
+typedef struct
+{
+	smc_batch_t batch;
+	int iNext;                  /* next message of the command line */
+	const char *cpUser;         /* defaults for fields a record does not give */
+	const char *cpImage;
+	unsigned long ulFailed;     /* invalid records and responses with a status != 0 */
+} source_t;
+
+/** a response file received before, for --conditional */
+typedef struct
+{
+	char *cpName;
+	int iHasVersion;            /* the server sent a version with the file */
+	uint64_t version;
+} known_file_t;
  
  /**
  * -------------------------------------------------------------- global variables --
@@ -39,6 +96,9 @@
 const char *cpServer, *cpPort, *cpUser, *cpMessage, *cpImage, *cpFilename;
 int iVerbose = 0;
 int save_errno = 0;
+smc_options_t options;
+known_file_t *knownFiles = NULL;
+size_t knownFileCount = 0;
 
 /**
  * --------------------------------------------------- function prototypes --
@@ -46,8 +106,45 @@ int save_errno = 0;
 void usage(FILE * stream, const char * message, int exitcode);
 void verbose(const char * message);
 void openSocket(int *paramISocketFD);
+int connectUnix(const char *cpPath);
+long long monotonicMs(void);
+void sortAddresses(struct addrinfo *list, struct addrinfo **addrs);
+int startConnect(const struct addrinfo *address, int iFastOpen, int *pError);
 void sendRequest(int *paramISocketFD, FILE* fpWriteSocket);
-void readResponse(int *paramISocketFD, FILE* fpReadSocket);
+int readResponse(int *paramISocketFD);
+void exitWithError(const char *cpWhere, const char *cpMessage);
+unsigned char *buildFrameRequest(const smc_record_t *record, uint32_t id, int keepAlive, int preamble, size_t *length);
+void sendFrameRequest(FILE* fpWriteSocket);
+uint32_t readFrameResponse(reader_t *reader, uint64_t *pStatus);
+void sourceOpen(source_t *source);
+int sourceNext(source_t *source, smc_record_t *record, uint32_t *pId);
+void sourceClose(source_t *source);
+void reportRecord(source_t *source, uint32_t id, long lStatus, const char *cpReason);
+void runSequential(source_t *source);
+void runPipeline(int *paramISocketFD, source_t *source);
+ssize_t readerFill(reader_t *reader);
+size_t readerPeek(reader_t *reader, size_t size);
+int readerReadFull(reader_t *reader, char *cpDest, size_t size);
+int readerSkip(reader_t *reader, size_t size);
+char *readerGets(reader_t *reader, char *cpLine, size_t size);
+size_t readerRead(reader_t *reader, char *cpDest, size_t size);
+void writeResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength);
+void copyResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength);
+int spliceBody(reader_t *reader, int iFileFD, size_t length);
+void spliceResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength);
+int openTmpFile(const char *cpResponseFilename, char *cpTmpName, size_t size);
+int publishTmpFile(int iFileFD, const char *cpTmpName, const char *cpResponseFilename);
+int mmapBody(reader_t *reader, int iFileFD, size_t length);
+void mmapResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength);
+void writeEncodedFile(reader_t *reader, const char *cpResponseFilename, uint64_t encoding, size_t length, uint64_t size);
+int inflateBody(reader_t *reader, int iFileFD, size_t length, uint64_t size);
+int readerReadVarint(reader_t *reader, size_t size, uint64_t *value);
+void knownFilesLoad(void);
+void knownFilesSave(void);
+void knownFileSet(const char *cpName, int iHasVersion, uint64_t version, int iSave);
+unsigned char *knownFilesEncode(size_t *length);
+int patchBody(reader_t *reader, int iFileFD, size_t offset, size_t length);
+void patchResponseFile(reader_t *reader, const char *cpResponseFilename, size_t length);
 
  /**
  * ------------------------------------------------------------- main --
@@ -55,29 +152,29 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket);
 int main(int argc, const char* argv[])
 {	
     int iSocketFD;
+	source_t source;
 	cpFilename = argv[0];
-	FILE* fpWriteSocket = NULL;
-	FILE* fpReadSocket = NULL;
 	
 	/* function to parse parameter provided by Thomas M. Galla, Christian Fibich*/
-	smc_parsecommandline(argc, argv, &usage, &cpServer, &cpPort, &cpUser, &cpMessage, &cpImage, &iVerbose);
-
-	/* function to connect to server */
-	openSocket(&iSocketFD);   
-	
-	/* function to write request into stream socket */
-	sendRequest(&iSocketFD, fpWriteSocket);
+	smc_parsecommandline(argc, argv, &usage, &cpServer, &cpPort, &cpUser, &cpMessage, &cpImage, &iVerbose, &options);
 
-	/* function to parse response into files */
-	readResponse(&iSocketFD, fpReadSocket);
+	sourceOpen(&source);
+	if (options.conditional) knownFilesLoad();
 	
-	/* everthing fine - close file pointer if they were already open*/
-    if ( fpWriteSocket != NULL) fclose(fpWriteSocket);
-    if ( fpReadSocket != NULL) fclose(fpReadSocket);
+	if (options.protocol >= PROTOCOL_VERSION && (options.batch != NULL || options.message_count > 1)) {
+		/* several binary requests share one keep-alive connection */
+		openSocket(&iSocketFD);
+		runPipeline(&iSocketFD, &source);
+		close(iSocketFD);
+	} else {
+		/* text requests: one connection per message */
+		runSequential(&source);
+	}
 	
-	close(iSocketFD);
+	sourceClose(&source);
     
-	return 0;
+	/* only a batch reports the status of its records */
+	return (options.batch != NULL && source.ulFailed > 0) ? EXIT_FAILURE : 0;
 }
 
 /**
@@ -94,12 +191,24 @@ void usage(FILE * stream, const char * message, int errcode)
     if (fprintf(stream,
             "\n usage: %s options\n"
             "options:\n"
-			"        -s, --server  <server>       IP address (IPv4 or IPv6) of server\n"
-            "        -p, --port <port>       port of the server [0 to 65535]\n"
+			"        -s, --server  <server>       IP address (IPv4 or IPv6) of server, or unix:<path> of its Unix domain socket\n"
+            "        -p, --port <port>       port of the server [0 to 65535], not needed for unix:<path>\n"
 			"        -u, --user <user>		 username for the message submission\n"
 			"        -i, --image <image URL>       image url for the submitting user\n"
-			"        -m, --message <message>	   message to submit to bulletin board\n"
+			"        -m, --message <message>	   message to submit to bulletin board (repeat for several messages)\n"
 			"        -v, --verbose	   trace information to stdout\n"
+			"        -t, --transfer <copy|splice|mmap>	   how response files are written (default copy)\n"
+			"        -P, --protocol <1|2>	   1: text, 2: binary frames (default, servers answering in text are understood)\n"
+			"        --batch <file|->	   submit the records of a file (message, user<TAB>message,\n"
+			"                    	   user<TAB>image<TAB>message or JSON lines) and print\n"
+			"                    	   \"line<TAB>status\" for each instead of writing response files\n"
+			"        --inflight <n>	   requests sent ahead of their responses (default 32)\n"
+			"        --connect-timeout <ms>	   give up connecting after ms milliseconds (default: no limit)\n"
+			"        --fastopen	   send the request in the SYN to servers contacted before (TCP Fast Open,\n"
+			"                    	   servers of a single address only)\n"
+			"        --compress	   ask for compressed response files (protocol 2, if built with zlib)\n"
+			"        --conditional	   keep response files the server would send unchanged (protocol 2,\n"
+			"                    	   remembered in " KNOWN_FILES_MANIFEST ")\n"
             "        -h, --help\n", message) < 0) {
         /*When fprintf fails, the new exit value is the errno value from the failed fprintf()*/
 		errcode = errno; 
@@ -124,10 +233,21 @@ void verbose(const char * message)
  */
 void openSocket(int *paramISocketFD) 
 {
-	struct addrinfo hints, *socket_address, *rp;
-	int iRetValue;
+	struct addrinfo hints, *socket_address, *rp, **addrs;
+	struct pollfd *attempts;
+	int iRetValue, iAddrCount = 0, iStarted = 0, iPending = 0, iFD, iError, iLastError = ECONNREFUSED, iTimeout, i;
+	long long llNow, llNextStart, llDeadline;
+	socklen_t errLen;
 	
 	verbose("Try to connect to socket");
+	*paramISocketFD = -1;
+	
+	/* unix:/path - a server on this host, neither name resolution nor TCP */
+	if (strncmp(cpServer, SMC_UNIX_PREFIX, SMC_UNIX_PREFIX_SIZE) == 0) {
+		*paramISocketFD = connectUnix(cpServer + SMC_UNIX_PREFIX_SIZE);
+		verbose("Successful connected to socket");
+		return;
+	}
 	
 	/* set memory for struct hints */
 	memset(&hints, 0, sizeof hints); //fill a byte string with a byte value
@@ -157,33 +277,104 @@ void openSocket(int *paramISocketFD)
         save_errno = 0;
         
         //ERROR MESSAGE
-        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "getaddrinfo()", strerror(errno)) < 0) save_errno= errno;
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "getaddrinfo()", gai_strerror(iRetValue)) < 0) save_errno= errno;
 		
         //EXIT LOGIC
         if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
         exit(EXIT_FAILURE);
 	}
 	
-	/* loop over socket address linked list */
-	for (rp = socket_address; rp != NULL; rp = rp->ai_next) {
-	   *paramISocketFD = socket(rp->ai_family, rp->ai_socktype,
-					rp->ai_protocol);
-	   if (*paramISocketFD == -1)
-		   continue;
+	/* 
+	*	happy eyeballs (RFC 8305): the addresses are tried with alternating
+	*	families in the order of getaddrinfo(). A new attempt starts every
+	*	CONNECT_ATTEMPT_DELAY_MS, or right away when the last one failed, so
+	*	an address which drops the SYN does not hold up the others. The first
+	*	connection established wins, the other attempts are closed.
+	*	TCP Fast Open is only used for a single address: its connect()
+	*	succeeds before any handshake, so it would win the race even
+	*	against an address which is down.
+	*/
+	for (rp = socket_address; rp != NULL; rp = rp->ai_next) iAddrCount++;
+	
+	if ((addrs = malloc((size_t) iAddrCount * sizeof(*addrs))) == NULL ||
+			(attempts = malloc((size_t) iAddrCount * sizeof(*attempts))) == NULL) {
+		exitWithError("malloc()", strerror(errno));
+	}
+	sortAddresses(socket_address, addrs);
 	
-	   if (connect(*paramISocketFD, rp->ai_addr, rp->ai_addrlen) != -1)
-		   break;                 
+	llNow = monotonicMs();
+	llNextStart = llNow;
+	llDeadline = options.connect_timeout > 0 ? llNow + options.connect_timeout : 0;
 	
-	   close(*paramISocketFD);
-    }
+	while (*paramISocketFD < 0) {
+		
+		llNow = monotonicMs();
+		if (llDeadline != 0 && llNow >= llDeadline) {
+			iLastError = ETIMEDOUT;
+			break;
+		}
+		
+		/* start the next attempt once its delay is up or nothing else is pending */
+		if (iStarted < iAddrCount && (iPending == 0 || llNow >= llNextStart)) {
+			iFD = startConnect(addrs[iStarted++], options.fastopen && iAddrCount == 1, &iLastError);
+			llNextStart = llNow + CONNECT_ATTEMPT_DELAY_MS;
+			if (iFD >= 0 && iLastError == 0) {
+				*paramISocketFD = iFD;
+			} else if (iFD >= 0) {
+				attempts[iPending].fd = iFD;
+				attempts[iPending].events = POLLOUT;
+				iPending++;
+			} else {
+				/* failed at once, e.g. no route - go on with the next address */
+				llNextStart = llNow;
+			}
+			continue;
+		}
+		
+		/* all addresses failed */
+		if (iPending == 0) break;
+		
+		iTimeout = -1;
+		if (iStarted < iAddrCount) iTimeout = (int) (llNextStart - llNow);
+		if (llDeadline != 0 && (iTimeout < 0 || llDeadline - llNow < iTimeout)) iTimeout = (int) (llDeadline - llNow);
+		
+		if (poll(attempts, (nfds_t) iPending, iTimeout) < 0) {
+			if (errno == EINTR) continue;
+			exitWithError("poll()", strerror(errno));
+		}
+		
+		for (i = iPending - 1; i >= 0 && *paramISocketFD < 0; i--) {
+			if (attempts[i].revents == 0) continue;
+			
+			iError = 0;
+			errLen = sizeof(iError);
+			if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &iError, &errLen) < 0) iError = errno;
+			
+			if (iError == 0) {
+				*paramISocketFD = attempts[i].fd;
+			} else {
+				verbose("Connect attempt failed");
+				iLastError = iError;
+				close(attempts[i].fd);
+				/* the next address need not wait for the delay */
+				llNextStart = llNow;
+			}
+			attempts[i] = attempts[--iPending];
+		}
+	}
+	
+	/* cancel the attempts which lost the race */
+	for (i = 0; i < iPending; i++) close(attempts[i].fd);
+	free(attempts);
+	free(addrs);
 	
-	if (rp == NULL || paramISocketFD == NULL) {
+	if (*paramISocketFD < 0) {
 		
         //RESET save_errno
         save_errno = 0;
         
         //ERROR MESSAGE
-        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),connect()", "no address succeeded") < 0) save_errno= errno;
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),connect()", strerror(iLastError)) < 0) save_errno= errno;
 
         //EXIT LOGIC
         if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
@@ -192,12 +383,179 @@ void openSocket(int *paramISocketFD)
         
 	}
 	
+	/* the rest of the client uses blocking I/O */
+	if (fcntl(*paramISocketFD, F_SETFL, fcntl(*paramISocketFD, F_GETFL) & ~O_NONBLOCK) < 0) {
+		exitWithError("fcntl()", strerror(errno));
+	}
+	
 	/* socket address info are no longer needed */
 	freeaddrinfo(socket_address);   
 	
 	verbose("Successful connected to socket");
 }
 
+/**
+ * \brief connect to a Unix domain socket of the server
+ *
+ * With --connect-timeout the socket connects non-blocking. The kernel
+ * answers EAGAIN rather than waiting while the backlog of the server is
+ * full, and poll() does not report when there is room again, so the
+ * connect is repeated every UNIX_CONNECT_RETRY_MS until the deadline.
+ *
+ * \param cpPath - path of the socket
+ *
+ * \return the connected socket - exits on failure
+ */
+int connectUnix(const char *cpPath)
+{
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	int iFD, iError = 0, iTimeout;
+	long long llNow, llDeadline = 0;
+	socklen_t errLen;
+	
+	if (strlen(cpPath) >= sizeof(addr.sun_path)) {
+		exitWithError("socket(AF_UNIX)", strerror(ENAMETOOLONG));
+	}
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, cpPath);
+	
+	if (options.connect_timeout > 0) llDeadline = monotonicMs() + options.connect_timeout;
+	
+	if ((iFD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (llDeadline != 0 ? SOCK_NONBLOCK : 0), 0)) < 0) {
+		exitWithError("socket(AF_UNIX)", strerror(errno));
+	}
+	
+	while (connect(iFD, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		if (errno == EINTR) continue;
+		if (errno != EAGAIN && errno != EINPROGRESS) exitWithError("socket(AF_UNIX),connect()", strerror(errno));
+		iError = errno;
+		
+		llNow = monotonicMs();
+		if (llNow >= llDeadline) exitWithError("socket(AF_UNIX),connect()", strerror(ETIMEDOUT));
+		iTimeout = (int) (llDeadline - llNow);
+		
+		if (iError == EAGAIN) {
+			/* backlog full - try again shortly */
+			if (iTimeout > UNIX_CONNECT_RETRY_MS) iTimeout = UNIX_CONNECT_RETRY_MS;
+			(void) poll(NULL, 0, iTimeout);
+			continue;
+		}
+		
+		/* in progress: wait for the outcome like the TCP attempts */
+		pfd.fd = iFD;
+		pfd.events = POLLOUT;
+		while ((iError = poll(&pfd, 1, iTimeout)) < 0 && errno == EINTR);
+		if (iError < 0) exitWithError("poll()", strerror(errno));
+		if (iError == 0) exitWithError("socket(AF_UNIX),connect()", strerror(ETIMEDOUT));
+		
+		iError = 0;
+		errLen = sizeof(iError);
+		if (getsockopt(iFD, SOL_SOCKET, SO_ERROR, &iError, &errLen) < 0) iError = errno;
+		if (iError != 0) exitWithError("socket(AF_UNIX),connect()", strerror(iError));
+		break;
+	}
+	
+	/* the rest of the client uses blocking I/O */
+	if (llDeadline != 0 && fcntl(iFD, F_SETFL, fcntl(iFD, F_GETFL) & ~O_NONBLOCK) < 0) {
+		exitWithError("fcntl()", strerror(errno));
+	}
+	
+	return iFD;
+}
+
+/**
+ * \brief milliseconds of the monotonic clock
+ */
+long long monotonicMs(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief order the addresses for happy eyeballs: alternate the families, starting with the first one
+ *
+ * \param list - result of getaddrinfo()
+ * \param addrs [OUT] - all addresses of the list in connect order
+ */
+void sortAddresses(struct addrinfo *list, struct addrinfo **addrs)
+{
+	struct addrinfo *first = list, *other = list;
+	int iFamily = list->ai_family, iTakeFirst = 1, n = 0;
+	
+	while (first != NULL || other != NULL) {
+		/* next of the first family, and next of any other family */
+		while (first != NULL && first->ai_family != iFamily) first = first->ai_next;
+		while (other != NULL && other->ai_family == iFamily) other = other->ai_next;
+		
+		if ((iTakeFirst && first != NULL) || other == NULL) {
+			if (first == NULL) break;
+			addrs[n++] = first;
+			first = first->ai_next;
+		} else {
+			addrs[n++] = other;
+			other = other->ai_next;
+		}
+		iTakeFirst = !iTakeFirst;
+	}
+}
+
+/**
+ * \brief start a non-blocking connect
+ *
+ * \param address - address to connect to
+ * \param iFastOpen - non-zero to use TCP Fast Open
+ * \param pError [OUT] - 0 if connected already, the errno if the attempt failed
+ *
+ * \return the socket, still connecting unless *pError is 0, or -1 if the attempt failed
+ */
+int startConnect(const struct addrinfo *address, int iFastOpen, int *pError)
+{
+	int iFD;
+	
+	verbose("Start connect attempt");
+	
+	if ((iFD = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol)) < 0) {
+		*pError = errno;
+		return -1;
+	}
+	
+#ifdef TCP_FASTOPEN_CONNECT
+	/* 
+	*	TCP Fast Open: with a cookie of this server, connect() returns at once
+	*	and the first write goes out with the SYN. Without a cookie, or if the
+	*	kernel does not know the option, this is an ordinary connect.
+	*/
+	if (iFastOpen) {
+		int iOn = 1;
+		if (setsockopt(iFD, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &iOn, sizeof(iOn)) < 0) {
+			verbose("TCP_FASTOPEN_CONNECT not available - connecting without");
+		}
+	}
+#else
+	(void) iFastOpen;
+#endif
+	
+	if (connect(iFD, address->ai_addr, address->ai_addrlen) == 0) {
+		*pError = 0;
+		return iFD;
+	}
+	
+	if (errno == EINPROGRESS) {
+		*pError = EINPROGRESS;
+		return iFD;
+	}
+	
+	*pError = errno;
+	close(iFD);
+	return -1;
+}
+
 /**
  * \brief function to open stream as write stream and write/send request to server socket
  *
@@ -210,7 +568,8 @@ void sendRequest(int *paramISocketFD, FILE* fpWriteSocket)
 	
 	/* open socket file descriptor */
 	verbose("Open stream for writing");
-	if ((fpWriteSocket = fdopen(*paramISocketFD, "w")) == NULL) {
+	/* on a duplicate of the socket, so the stream can be closed before the socket */
+	if ((fpWriteSocket = fdopen(dup(*paramISocketFD), "w")) == NULL) {
         
         //RESET save_errno
         save_errno = 0;
@@ -224,6 +583,14 @@ void sendRequest(int *paramISocketFD, FILE* fpWriteSocket)
         
 	}
 	
+	/* binary request: delimited by its frame, so the write direction stays open */
+	if (options.protocol >= PROTOCOL_VERSION) {
+		sendFrameRequest(fpWriteSocket);
+		fclose(fpWriteSocket);
+		verbose("Succesful sent request to server");
+		return;
+	}
+	
 	/* write user to stream */
 	verbose("Write user into stream");
 	if (fprintf(fpWriteSocket,"user=%s\n",cpUser) < 0) {
@@ -320,8 +687,9 @@ void sendRequest(int *paramISocketFD, FILE* fpWriteSocket)
 	}
 	
 	/* after writing: disable write operations for socket */
+	/* ENOTCONN: an overloaded server may have answered busy and closed already - read that answer */
 	verbose("Close write direction of stream");
-	if (shutdown(*paramISocketFD,SHUT_WR) != 0) {
+	if (shutdown(*paramISocketFD,SHUT_WR) != 0 && errno != ENOTCONN) {
 		
         //RESET save_errno
         save_errno = 0;
@@ -344,167 +712,131 @@ void sendRequest(int *paramISocketFD, FILE* fpWriteSocket)
         
 	}
 	
+	fclose(fpWriteSocket);
 	verbose("Succesful sent request to server");
 }
 
 /**
- * \brief function to open stream as read stream and parse response into files
+ * \brief function to read the response from the socket and parse it into files
  *
  * \param paramISocketFD - socket file descriptor to the address
+ *
+ * \return status of the response, EXIT_FAILURE if the server sent none
  */
-void readResponse(int *paramISocketFD, FILE* fpReadSocket) 
+int readResponse(int *paramISocketFD) 
 {
-	FILE* fpInputFile = NULL;
-	char cBuf[MAX_BUF];
-	int iRecStatus, iRecLength, iReadlen = 0, iBufLen = 0, iCurrentlyRead = 0;
-	char *cpResponseFilename = NULL;
+	static reader_t reader;
+	static smc_parser_t parser;
+	int iRecStatus = EXIT_FAILURE, iResult;
+	size_t consumed;
+	uint64_t status;
 	
 	verbose("Try to parse response of server");
 	
-	/* open socket file descriptor in read operation */
-	verbose("Open stream for reading");
-	if ((fpReadSocket = fdopen(*paramISocketFD, "r")) == NULL) {
-		
-        //RESET save_errno
-        save_errno = 0;
-        
-        //ERROR MESSAGE
-        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fdopen()", strerror(errno)) < 0) save_errno= errno;
-
-        //EXIT LOGIC
-        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-		exit(EXIT_FAILURE);
-        
+	/* own buffered reader instead of fdopen(), so the bytes read ahead of a file body are known */
+	verbose("Open reader on socket");
+	reader.iFD = *paramISocketFD;
+	reader.start = 0;
+	reader.end = 0;
+	
+	/* a server which only speaks text answers without preamble */
+	if (options.protocol >= PROTOCOL_VERSION) {
+		if (readerPeek(&reader, PROTOCOL_PREAMBLE_SIZE) >= PROTOCOL_PREAMBLE_SIZE &&
+				protocolGetPreamble((const unsigned char *) reader.cBuf + reader.start, PROTOCOL_PREAMBLE_SIZE) > 0) {
+			reader.start += PROTOCOL_PREAMBLE_SIZE;
+			(void) readFrameResponse(&reader, &status);
+			verbose("Successful processed response");
+			return status > INT_MAX ? INT_MAX : (int) status;
+		}
+		verbose("Server answered in text");
 	}
 	
+	/* the parser keeps its memory from one response to the next */
+	parserReset(&parser);
+	
 	/* loop over response */
-	while(fgets(cBuf, MAX_BUF, fpReadSocket)) {
-		//reset errno
-        errno = 0;
-			
-		/* check if part of buffered response is status part */
-		if (strncmp(cBuf, "status=", 7) == 0) 
-		{
-			/* get status of response */
+	while (readerFill(&reader) > 0) {
+		
+		iResult = parserFeed(&parser, reader.cBuf + reader.start, reader.end - reader.start, &consumed);
+		reader.start += consumed;
+		
+		switch (iResult) {
+		
+		case PARSER_STATUS:
 			verbose("Parse status of response");
-			if (sscanf(cBuf,"status=%d",&iRecStatus) == 0) {
-				if (errno != 0) {
-					
-                    //RESET save_errno
-                    save_errno = 0;
-
-                    //ERROR MESSAGE
-                    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "sscanf()", /*strerror(errno)*/"status could not be scanned") < 0) save_errno= errno;
-
-                    
-                //close read file pointer
-                    if (fclose(fpReadSocket) < 0) {
-                        
-                        //ERROR MESSAGE
-                        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                        
-                    }
-
-                    //EXIT LOGIC
-                    if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-                    exit(EXIT_FAILURE);
-				}
-			}
-		}
+			iRecStatus = parser.status > INT_MAX || parser.status < INT_MIN ? EXIT_FAILURE : (int) parser.status;
+			break;
 		
-		/* check if part of buffered response is filename part */
-		if (strncmp(cBuf, "file=", 5) == 0) 
-		{
-			/* malloc for length of cbuf - "file=" and \n char at the end of the line */
-			if ((cpResponseFilename = malloc((strlen(cBuf) - 6) * sizeof(char))) == NULL)
-			{
-                
-                
-                //RESET save_errno
-                save_errno = 0;
-                
-                //ERROR MESSAGE
-                if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "malloc()", strerror(errno)) < 0) save_errno= errno;
-                
-                
-            //close read file pointer
-                if (fclose(fpReadSocket) < 0) {
-                    
-                    //ERROR MESSAGE
-                    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                    
-                }
-                
-                //EXIT LOGIC
-                if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-                exit(EXIT_FAILURE);
-
+		case PARSER_FILE:
+			verbose("Parse filename and length of response file");
+			if (parser.length > INT_MAX) {
+				exitWithError("readResponse()", "file too large");
 			}
-			
-			/* get filename of response */
-			verbose("Parse filename of response");
-			if (sscanf(cBuf,"file=%s",cpResponseFilename) == 0) {
-				if (errno != 0) {
-					
-                    
-                    //RESET save_errno
-                    save_errno = 0;
-                    
-                    //ERROR MESSAGE
-                    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "sscanf()", /*strerror(errno)*/"file could not be scanned") < 0) save_errno= errno;
-                    
-                    
-                //close read file pointer
-                    if (fclose(fpReadSocket) < 0) {
-                        
-                        //ERROR MESSAGE
-                        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                        
-                    }
-                    
-                    //EXIT LOGIC
-                    if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-                    exit(EXIT_FAILURE);
+			/* write the body into the file the way the user asked for */
+			writeResponseFile(&reader, parserName(&parser), (int) parser.length);
+			break;
+		
+		case PARSER_ERROR:
+			exitWithError("readResponse()", "Malformed response");
+			break;
+		
+		default:
+			break;
+		}
+	}
+	
+	verbose("Successful processed response");
+	return iRecStatus;
+}
 
-				}
-			}
+/**
+ * \brief write one response file of the announced length
+ *
+ * \param reader - reader on the socket
+ * \param cpResponseFilename - name of the file
+ * \param iRecLength - announced length of the file
+ */
+void writeResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength)
+{
+	/* a batch only reports the status, its records would all overwrite the same files */
+	if (options.batch != NULL) {
+		if (readerSkip(reader, (size_t) iRecLength) < 0) {
+			exitWithError("readerSkip()", "Cannot read from socket");
 		}
-		
-		/* check if part of buffered response is length part */
-		if (strncmp(cBuf, "len=", 4) == 0) 
-		{
-			/* get bytes-length of file */
-			verbose("Parse length of response file");
-			if (sscanf(cBuf,"len=%d",&iRecLength) == 0) {
-				if (errno != 0) {
-					
-                    //RESET save_errno
-                    save_errno = 0;
-                    
-                    //ERROR MESSAGE
-                    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "sscanf()", /*strerror(errno)*/"file could not be scanned") < 0) save_errno= errno;
-                    
-                    
-                    //close read file pointer
-                    if (fclose(fpReadSocket) < 0) {
-                        
-                        //ERROR MESSAGE
-                        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                        
-                    }
-                    
-                    //EXIT LOGIC
-                    if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-                    exit(EXIT_FAILURE);
+		return;
+	}
+	
+	/* zero-copy variants write the file on their own */
+	if (options.transfer == SMC_TRANSFER_SPLICE) {
+		spliceResponseFile(reader, cpResponseFilename, iRecLength);
+		return;
+	}
+	if (options.transfer == SMC_TRANSFER_MMAP) {
+		mmapResponseFile(reader, cpResponseFilename, iRecLength);
+		return;
+	}
+	
+	copyResponseFile(reader, cpResponseFilename, iRecLength);
+}
 
-				}
-			}
-			
-			/* open file in (w)rite mode -> create file if not exist or clean file and begin at null */
-			verbose("Open response file in write mode");
-			if ((fpInputFile = fopen(cpResponseFilename,"w")) ==  NULL)
-			{
-				
+/**
+ * \brief write one response file through a user-space buffer
+ *
+ * \param reader - reader on the socket
+ * \param cpResponseFilename - name of the file
+ * \param iRecLength - announced length of the file
+ */
+void copyResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength)
+{
+	FILE* fpInputFile = NULL;
+	char cBuf[MAX_BUF];
+	int iReadlen = 0, iBufLen = 0, iCurrentlyRead = 0;
+	
+	/* open file in (w)rite mode -> create file if not exist or clean file and begin at null */
+	verbose("Open response file in write mode");
+	if ((fpInputFile = fopen(cpResponseFilename,"w")) ==  NULL)
+	{
+		
                 
                 //RESET save_errno
                 save_errno = 0;
@@ -513,41 +845,34 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket)
                 if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fopen()", strerror(errno)) < 0) save_errno= errno;
                 
                 
-                //close read file pointer
-                if (fclose(fpReadSocket) < 0) {
-                    
-                    //ERROR MESSAGE
-                    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                    
-                }
                 
                 //EXIT LOGIC
                 if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
                 exit(EXIT_FAILURE);
 
-			}
-			
-			/* reset int variables for each file */
-			iReadlen = 0;
-			iBufLen = 0;
-			
-			/* loop until byte-length of file is reached and processed */
-			while (iReadlen < iRecLength)
-			{
-				/* set length of bytes which are need to be read */
-				if ((iRecLength-iReadlen) > MAX_BUF) {
-					iBufLen = MAX_BUF;
-				} else {
-					iBufLen = iRecLength-iReadlen;
-				}
-			//
+	}
+	
+	/* reset int variables for each file */
+	iReadlen = 0;
+	iBufLen = 0;
+	
+	/* loop until byte-length of file is reached and processed */
+	while (iReadlen < iRecLength)
+	{
+		/* set length of bytes which are need to be read */
+		if ((iRecLength-iReadlen) > MAX_BUF) {
+			iBufLen = MAX_BUF;
+		} else {
+			iBufLen = iRecLength-iReadlen;
+		}
+	//
             /* read from stream... */
             //
-				iCurrentlyRead = (int) fread(cBuf, sizeof(char),iBufLen,fpReadSocket);
-				
-				/* network problems because no bytes read */
-				if (iCurrentlyRead == 0) {
-					
+		iCurrentlyRead = (int) readerRead(reader, cBuf, iBufLen);
+		
+		/* network problems because no bytes read */
+		if (iCurrentlyRead == 0) {
+			
                     //RESET save_errno
                     save_errno = 0;
                     
@@ -564,25 +889,18 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket)
                     }
 
                     
-                //close read file pointer
-                    if (fclose(fpReadSocket) < 0) {
-                        
-                        //ERROR MESSAGE
-                        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                        
-                    }
                     
                     //EXIT LOGIC
                     if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
                     exit(EXIT_FAILURE);
 
-				}
-			
+		}
+	
             //
             /* ...and write into file */
             //
-				if (((int)fwrite(cBuf, sizeof(char), iCurrentlyRead,fpInputFile)) != iCurrentlyRead)
-				{
+		if (((int)fwrite(cBuf, sizeof(char), iCurrentlyRead,fpInputFile)) != iCurrentlyRead)
+		{
                     //RESET save_errno
                     save_errno = 0;
                     
@@ -599,32 +917,25 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket)
                     }
                     
                     
-                //close read file pointer
-                    if (fclose(fpReadSocket) < 0) {
-                        
-                        //ERROR MESSAGE
-                        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fclose() - could not close Read File Pointer", strerror(errno)) < 0) save_errno= errno;
-                        
-                    }
                     
                     //EXIT LOGIC
                     if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
                     exit(EXIT_FAILURE);
 
-				}
-				
-				/* add processed bytes to counter */
-				iReadlen += iCurrentlyRead;
-			}
-			
-			/* flush all unwritten data to the stream */
-			if (fflush(fpInputFile) != 0) {
-				
-                
-                //RESET save_errno
-                save_errno = 0;
-                
-                //ERROR MESSAGE
+		}
+		
+		/* add processed bytes to counter */
+		iReadlen += iCurrentlyRead;
+	}
+	
+	/* flush all unwritten data to the stream */
+	if (fflush(fpInputFile) != 0) {
+		
+                
+                //RESET save_errno
+                save_errno = 0;
+                
+                //ERROR MESSAGE
                 if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "fflush()", strerror(errno)) < 0) save_errno= errno;
 
                
@@ -639,13 +950,13 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket)
                 //EXIT LOGIC
                 if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
                 exit(EXIT_FAILURE);
-			}
-			
+	}
+	
             
             
-			/* everything fine - close file pointer */
-			verbose("Successful processed response file");
-		
+	/* everything fine - close file pointer */
+	verbose("Successful processed response file");
+
             
         //close inputfile file pointer
             if (fclose(fpInputFile) < 0) {
@@ -658,9 +969,1337 @@ void readResponse(int *paramISocketFD, FILE* fpReadSocket)
                 if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
                 exit(EXIT_FAILURE);
             }
-            
+}
+
+/**
+ * \brief refill the reader from the socket once all buffered bytes are consumed
+ *
+ * \param reader - reader on the socket
+ *
+ * \return number of buffered bytes, 0 on end of stream, -1 on error
+ */
+ssize_t readerFill(reader_t *reader)
+{
+	ssize_t iRead;
+	
+	if (reader->start < reader->end) return (ssize_t) (reader->end - reader->start);
+	
+	do {
+		iRead = read(reader->iFD, reader->cBuf, sizeof(reader->cBuf));
+	} while (iRead < 0 && errno == EINTR);
+	
+	reader->start = 0;
+	reader->end = iRead > 0 ? (size_t) iRead : 0;
+	return iRead;
+}
+
+/**
+ * \brief read one line like fgets() does
+ *
+ * \param reader - reader on the socket
+ * \param cpLine - destination of the line (including '\n')
+ * \param size - size of cpLine
+ *
+ * \return cpLine, or NULL if nothing could be read
+ */
+char *readerGets(reader_t *reader, char *cpLine, size_t size)
+{
+	size_t used = 0;
+	
+	while (used + 1 < size) {
+		if (readerFill(reader) <= 0) break;
+		
+		cpLine[used++] = reader->cBuf[reader->start++];
+		if (cpLine[used - 1] == '\n') break;
+	}
+	
+	if (used == 0) return NULL;
+	cpLine[used] = '\0';
+	return cpLine;
+}
+
+/**
+ * \brief read up to size bytes, buffered bytes first
+ *
+ * \param reader - reader on the socket
+ * \param cpDest - destination buffer
+ * \param size - maximum number of bytes
+ *
+ * \return number of bytes read, 0 on end of stream or error
+ */
+size_t readerRead(reader_t *reader, char *cpDest, size_t size)
+{
+	ssize_t iAvail;
+	
+	if ((iAvail = readerFill(reader)) <= 0) return 0;
+	
+	if ((size_t) iAvail < size) size = (size_t) iAvail;
+	memcpy(cpDest, reader->cBuf + reader->start, size);
+	reader->start += size;
+	return size;
+}
+
+/**
+ * \brief move length bytes of the socket into a file with splice()
+ *
+ * Bytes already buffered by the reader are written first; the rest goes
+ * socket -> pipe -> file inside the kernel. Falls back to read()/write()
+ * when the kernel refuses to splice the file (EINVAL).
+ *
+ * \param reader - reader on the socket
+ * \param iFileFD - file descriptor of the destination file
+ * \param length - number of body bytes
+ *
+ * \return 0 on success, -1 on error (errno set, 0 on premature end of stream)
+ */
+int spliceBody(reader_t *reader, int iFileFD, size_t length)
+{
+	int iPipe[2];
+	ssize_t iIn, iOut;
+	size_t pending = 0, chunk;
+	char cBuf[MAX_BUF];
+	
+	/* bytes the reader already pulled out of the socket */
+	chunk = reader->end - reader->start;
+	if (chunk > length) chunk = length;
+	while (chunk > 0) {
+		if ((iOut = write(iFileFD, reader->cBuf + reader->start, chunk)) < 0) {
+			if (errno == EINTR) continue;
+			return -1;
 		}
+		reader->start += (size_t) iOut;
+		chunk -= (size_t) iOut;
+		length -= (size_t) iOut;
 	}
+	if (length == 0) return 0;
 	
-	verbose("Successful processed response");
+	if (pipe2(iPipe, O_CLOEXEC) < 0) return -1;
+	/* a larger pipe means fewer splice() round trips; the default size works as well */
+	(void) fcntl(iPipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+	
+	while (length > 0 || pending > 0) {
+		if (length > 0) {
+			iIn = splice(reader->iFD, NULL, iPipe[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (iIn == 0) {
+				errno = 0;
+				break;
+			}
+			if (iIn < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+			length -= (size_t) iIn;
+			pending += (size_t) iIn;
+		}
+		
+		while (pending > 0) {
+			iOut = splice(iPipe[0], NULL, iFileFD, NULL, pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (iOut < 0 && errno == EINTR) continue;
+			if (iOut <= 0) break;
+			pending -= (size_t) iOut;
+		}
+		if (pending > 0) break;
+	}
+	
+	/* file system without splice support: drain the pipe and copy the rest */
+	if ((length > 0 || pending > 0) && errno == EINVAL) {
+		errno = 0;
+		while (length > 0 || pending > 0) {
+			if (pending > 0) {
+				iIn = read(iPipe[0], cBuf, pending < sizeof(cBuf) ? pending : sizeof(cBuf));
+				if (iIn > 0) pending -= (size_t) iIn;
+			} else {
+				iIn = read(reader->iFD, cBuf, length < sizeof(cBuf) ? length : sizeof(cBuf));
+				if (iIn > 0) length -= (size_t) iIn;
+			}
+			if (iIn < 0 && errno == EINTR) continue;
+			if (iIn <= 0) break;
+			
+			for (chunk = 0; chunk < (size_t) iIn; chunk += (size_t) iOut) {
+				if ((iOut = write(iFileFD, cBuf + chunk, (size_t) iIn - chunk)) < 0) {
+					if (errno == EINTR) {
+						iOut = 0;
+						continue;
+					}
+					break;
+				}
+			}
+			if (chunk < (size_t) iIn) break;
+		}
+	}
+	
+	save_errno = errno;
+	close(iPipe[0]);
+	close(iPipe[1]);
+	errno = save_errno;
+	
+	return (length > 0 || pending > 0) ? -1 : 0;
+}
+
+/**
+ * \brief write one response file with spliceBody()
+ *
+ * \param reader - reader on the socket
+ * \param cpResponseFilename - name of the file
+ * \param iRecLength - announced length of the file
+ */
+void spliceResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength)
+{
+	int iFileFD;
+	
+	verbose("Open response file in write mode");
+	if ((iFileFD = open(cpResponseFilename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "open()", strerror(errno)) < 0) save_errno= errno;
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	if (spliceBody(reader, iFileFD, iRecLength > 0 ? (size_t) iRecLength : 0) < 0) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "splice()", errno != 0 ? strerror(errno) : "Cannot read from socket") < 0) save_errno= errno;
+        
+        //close response file descriptor
+        close(iFileFD);
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	if (close(iFileFD) < 0) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "close()", strerror(errno)) < 0) save_errno= errno;
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	verbose("Successful processed response file");
+}
+
+/**
+ * \brief open an unnamed file in the directory of the response file
+ *
+ * Uses O_TMPFILE, so nobody can see the file before publishTmpFile().
+ * File systems without O_TMPFILE get a hidden named file instead, which
+ * is renamed over the target in the same way.
+ *
+ * \param cpResponseFilename - name the file gets when it is published
+ * \param cpTmpName [OUT] - name of the fallback file, empty for O_TMPFILE
+ * \param size - size of cpTmpName
+ *
+ * \return file descriptor, -1 on error (errno set)
+ */
+int openTmpFile(const char *cpResponseFilename, char *cpTmpName, size_t size)
+{
+	const char *cpSlash = strrchr(cpResponseFilename, '/');
+	int iFileFD;
+	mode_t mask;
+	
+	cpTmpName[0] = '\0';
+	if (cpSlash == NULL) {
+		iFileFD = open(".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0666);
+	} else {
+		if ((size_t) (cpSlash - cpResponseFilename) + 2 > size) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memcpy(cpTmpName, cpResponseFilename, (size_t) (cpSlash - cpResponseFilename) + 1);
+		cpTmpName[cpSlash - cpResponseFilename + 1] = '\0';
+		iFileFD = open(cpTmpName, O_TMPFILE | O_RDWR | O_CLOEXEC, 0666);
+		cpTmpName[0] = '\0';
+	}
+	if (iFileFD >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) return iFileFD;
+	
+	/* no O_TMPFILE support: named file next to the target, renamed when complete */
+	if (snprintf(cpTmpName, size, "%.*s.%s.XXXXXX", cpSlash == NULL ? 0 : (int) (cpSlash - cpResponseFilename + 1),
+			cpResponseFilename, cpSlash == NULL ? cpResponseFilename : cpSlash + 1) >= (int) size) {
+		cpTmpName[0] = '\0';
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if ((iFileFD = mkostemp(cpTmpName, O_CLOEXEC)) < 0) {
+		cpTmpName[0] = '\0';
+		return -1;
+	}
+	/* mkostemp() creates 0600, a normal response file honours the umask */
+	mask = umask(0);
+	umask(mask);
+	(void) fchmod(iFileFD, 0666 & ~mask);
+	return iFileFD;
+}
+
+/**
+ * \brief give a complete file from openTmpFile() its name
+ *
+ * The unnamed file is linked under a temporary name and then renamed over
+ * the target, so an existing file is replaced atomically.
+ *
+ * \param iFileFD - file descriptor from openTmpFile()
+ * \param cpTmpName - name from openTmpFile()
+ * \param cpResponseFilename - final name
+ *
+ * \return 0 on success, -1 on error (errno set)
+ */
+int publishTmpFile(int iFileFD, const char *cpTmpName, const char *cpResponseFilename)
+{
+	char cProcPath[64];
+	char cLinkName[PATH_MAX];
+	
+	if (cpTmpName[0] != '\0') return rename(cpTmpName, cpResponseFilename);
+	
+	if (snprintf(cLinkName, sizeof(cLinkName), "%s.%ld.tmp", cpResponseFilename, (long) getpid()) >= (int) sizeof(cLinkName)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	(void) snprintf(cProcPath, sizeof(cProcPath), "/proc/self/fd/%d", iFileFD);
+	(void) unlink(cLinkName);
+	if (linkat(AT_FDCWD, cProcPath, AT_FDCWD, cLinkName, AT_SYMLINK_FOLLOW) < 0) return -1;
+	if (rename(cLinkName, cpResponseFilename) < 0) {
+		save_errno = errno;
+		(void) unlink(cLinkName);
+		errno = save_errno;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \brief receive length bytes of the socket straight into a mapping of the file
+ *
+ * The file is allocated to its full size up front, so it gets its extents in
+ * one go instead of growing with every write.
+ *
+ * \param reader - reader on the socket
+ * \param iFileFD - file descriptor of the destination file
+ * \param length - number of body bytes
+ *
+ * \return 0 on success, -1 on error (errno set, 0 on premature end of stream)
+ */
+int mmapBody(reader_t *reader, int iFileFD, size_t length)
+{
+	char *cpMap;
+	size_t done;
+	ssize_t iRead;
+	
+	if (length == 0) return 0;
+	
+	if ((errno = posix_fallocate(iFileFD, 0, (off_t) length)) != 0) {
+		/* file system cannot allocate: a sparse file of the right size still maps */
+		if (errno != EOPNOTSUPP && errno != EINVAL) return -1;
+		if (ftruncate(iFileFD, (off_t) length) < 0) return -1;
+	}
+	
+	if ((cpMap = mmap(NULL, length, PROT_WRITE, MAP_SHARED, iFileFD, 0)) == MAP_FAILED) return -1;
+	
+	/* bytes the reader already pulled out of the socket */
+	done = reader->end - reader->start;
+	if (done > length) done = length;
+	memcpy(cpMap, reader->cBuf + reader->start, done);
+	reader->start += done;
+	
+	while (done < length) {
+		iRead = recv(reader->iFD, cpMap + done, length - done, MSG_WAITALL);
+		if (iRead < 0 && errno == EINTR) continue;
+		if (iRead <= 0) {
+			if (iRead == 0) errno = 0;
+			break;
+		}
+		done += (size_t) iRead;
+	}
+	
+	save_errno = errno;
+	(void) munmap(cpMap, length);
+	errno = save_errno;
+	
+	return done < length ? -1 : 0;
+}
+
+/**
+ * \brief write one response file with mmapBody() and publish it when complete
+ *
+ * \param reader - reader on the socket
+ * \param cpResponseFilename - name of the file
+ * \param iRecLength - announced length of the file
+ */
+void mmapResponseFile(reader_t *reader, const char *cpResponseFilename, int iRecLength)
+{
+	char cTmpName[PATH_MAX];
+	const char *cpWhere;
+	int iFileFD;
+	
+	verbose("Open unnamed response file");
+	if ((iFileFD = openTmpFile(cpResponseFilename, cTmpName, sizeof(cTmpName))) < 0) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "open()", strerror(errno)) < 0) save_errno= errno;
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	cpWhere = "mmap()";
+	if (mmapBody(reader, iFileFD, iRecLength > 0 ? (size_t) iRecLength : 0) == 0) {
+		verbose("Publish response file");
+		cpWhere = "linkat()";
+		if (publishTmpFile(iFileFD, cTmpName, cpResponseFilename) == 0) cpWhere = NULL;
+	}
+	
+	if (cpWhere != NULL) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, cpWhere, errno != 0 ? strerror(errno) : "Cannot read from socket") < 0) save_errno= errno;
+        
+        //remove the incomplete file, an unnamed one vanishes with close()
+        if (cTmpName[0] != '\0') (void) unlink(cTmpName);
+        close(iFileFD);
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	if (close(iFileFD) < 0) {
+		
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, "close()", strerror(errno)) < 0) save_errno= errno;
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+	}
+	
+	verbose("Successful processed response file");
+}
+
+/**
+ * \brief write one encoded response file, decoded on the fly
+ *
+ * \param reader - reader on the socket
+ * \param cpResponseFilename - name of the file
+ * \param encoding - PROTOCOL_ENCODING_* of the data
+ * \param length - length of the encoded data
+ * \param size - announced size of the decoded file
+ */
+void writeEncodedFile(reader_t *reader, const char *cpResponseFilename, uint64_t encoding, size_t length, uint64_t size)
+{
+	int iFileFD;
+	
+	/* a batch only reports the status */
+	if (options.batch != NULL) {
+		if (readerSkip(reader, length) < 0) {
+			exitWithError("readerSkip()", "Cannot read from socket");
+		}
+		return;
+	}
+	
+	if (encoding != PROTOCOL_ENCODING_DEFLATE || !(PROTOCOL_ENCODINGS_SUPPORTED & PROTOCOL_ENCODING_DEFLATE)) {
+		exitWithError("readFrameResponse()", "unsupported file encoding");
+	}
+	
+	verbose("Open response file in write mode");
+	if ((iFileFD = open(cpResponseFilename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+		exitWithError("open()", strerror(errno));
+	}
+	
+	if (inflateBody(reader, iFileFD, length, size) < 0) {
+		close(iFileFD);
+		exitWithError("inflate()", errno != 0 ? strerror(errno) : "Corrupt compressed file");
+	}
+	
+	if (close(iFileFD) < 0) {
+		exitWithError("close()", strerror(errno));
+	}
+	verbose("Successful processed response file");
+}
+
+/**
+ * \brief inflate length bytes of a zlib stream from the socket into a file
+ *
+ * Only a chunk of the input and of the output is held at a time. Decoding
+ * stops as soon as the data grows beyond the announced size.
+ *
+ * \param reader - reader on the socket
+ * \param iFileFD - file the decoded data is written to
+ * \param length - length of the encoded data
+ * \param size - announced size of the decoded data
+ *
+ * \return 0 on success, -1 on error (errno set, 0 if the data is corrupt or truncated)
+ */
+int inflateBody(reader_t *reader, int iFileFD, size_t length, uint64_t size)
+{
+#ifdef HAVE_ZLIB
+	z_stream stream;
+	unsigned char cOut[INFLATE_CHUNK], *cpOut;
+	ssize_t iAvail, iWritten;
+	size_t n, produced;
+	uint64_t total = 0;
+	int iResult = Z_OK;
+	
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK) {
+		errno = ENOMEM;
+		return -1;
+	}
+	
+	while (length > 0 && iResult != Z_STREAM_END) {
+		
+		if ((iAvail = readerFill(reader)) <= 0) break;
+		n = (size_t) iAvail < length ? (size_t) iAvail : length;
+		stream.next_in = (Bytef *) reader->cBuf + reader->start;
+		stream.avail_in = (uInt) n;
+		
+		/* drain the output for this input */
+		do {
+			stream.next_out = cOut;
+			stream.avail_out = sizeof(cOut);
+			iResult = inflate(&stream, Z_NO_FLUSH);
+			if (iResult != Z_OK && iResult != Z_STREAM_END && iResult != Z_BUF_ERROR) break;
+			
+			produced = sizeof(cOut) - stream.avail_out;
+			/* more than announced: stop before a bomb fills the disk */
+			if (produced > size - total) {
+				inflateEnd(&stream);
+				errno = 0;
+				return -1;
+			}
+			total += produced;
+			for (cpOut = cOut; produced > 0; ) {
+				if ((iWritten = write(iFileFD, cpOut, produced)) < 0) {
+					if (errno == EINTR) continue;
+					inflateEnd(&stream);
+					return -1;
+				}
+				cpOut += iWritten;
+				produced -= (size_t) iWritten;
+			}
+		} while (stream.avail_out == 0 && iResult != Z_STREAM_END);
+		
+		reader->start += n - stream.avail_in;
+		length -= n - stream.avail_in;
+		if (iResult != Z_OK && iResult != Z_STREAM_END && iResult != Z_BUF_ERROR) break;
+	}
+	
+	inflateEnd(&stream);
+	errno = 0;
+	return (iResult == Z_STREAM_END && length == 0 && total == size) ? 0 : -1;
+#else
+	(void) reader;
+	(void) iFileFD;
+	(void) length;
+	(void) size;
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/**
+ * \brief read a varint field
+ *
+ * \return 0 on success, -1 on a malformed field or premature end of stream
+ */
+int readerReadVarint(reader_t *reader, size_t size, uint64_t *value)
+{
+	unsigned char cVarint[PROTOCOL_VARINT_MAX];
+	
+	if (size > sizeof(cVarint) || readerReadFull(reader, (char *) cVarint, size) < 0 ||
+			protocolGetVarint(cVarint, size, value) <= 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \brief print an error message and exit like the rest of the client does
+ *
+ * \param cpWhere - failing function
+ * \param cpMessage - description of the error
+ */
+void exitWithError(const char *cpWhere, const char *cpMessage)
+{
+        //RESET save_errno
+        save_errno = 0;
+        
+        //ERROR MESSAGE
+        if (fprintf(stderr,"%s - %s: %s\n", cpFilename, cpWhere, cpMessage) < 0) save_errno= errno;
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief encode a request frame for the given record
+ *
+ * \param record - user, image and message of the request
+ * \param id - request id echoed by the server
+ * \param keepAlive - ask the server to keep the connection open
+ * \param preamble - non-zero for the first frame of the connection
+ * \param length [OUT] - length of the frame
+ *
+ * Known files are only sent with the first frame: a response still in
+ * flight could overwrite a file after its hash went out.
+ *
+ * \return the frame, to be freed by the caller
+ */
+unsigned char *buildFrameRequest(const smc_record_t *record, uint32_t id, int keepAlive, int preamble, size_t *length)
+{
+	unsigned char *cpFrame, *cpKnown = NULL;
+	unsigned encodings = options.compress ? PROTOCOL_ENCODINGS_SUPPORTED : 0;
+	size_t start = 0, knownLen = 0;
+	
+	if (options.conditional && preamble) cpKnown = knownFilesEncode(&knownLen);
+	
+	if ((cpFrame = malloc(PROTOCOL_PREAMBLE_SIZE + PROTOCOL_HEADER_SIZE +
+			protocolRequestLength(record->user, record->image, record->message, encodings, knownLen))) == NULL) {
+		exitWithError("malloc()", strerror(errno));
+	}
+	
+	if (preamble) start = protocolPutPreamble(cpFrame, PROTOCOL_VERSION);
+	*length = start + protocolPutRequest(cpFrame + start, id, keepAlive ? PROTOCOL_FLAG_KEEP_ALIVE : 0,
+			record->user, record->image, record->message, encodings, cpKnown, knownLen);
+	free(cpKnown);
+	return cpFrame;
+}
+
+/**
+ * \brief read the response files received by earlier runs: one name per line,
+ *        followed by a tab and the version if the file has one
+ */
+void knownFilesLoad(void)
+{
+	FILE *fpManifest;
+	char cpLine[PATH_MAX + 32], *cpTab, *cpEnd;
+	unsigned long long version;
+	size_t len;
+	
+	if ((fpManifest = fopen(KNOWN_FILES_MANIFEST, "r")) == NULL) return;
+	
+	while (fgets(cpLine, sizeof(cpLine), fpManifest) != NULL) {
+		len = strcspn(cpLine, "\n");
+		if (len == 0) continue;
+		cpLine[len] = '\0';
+		if ((cpTab = strchr(cpLine, '\t')) == NULL) {
+			knownFileSet(cpLine, 0, 0, 0);
+			continue;
+		}
+		*cpTab = '\0';
+		version = strtoull(cpTab + 1, &cpEnd, 10);
+		knownFileSet(cpLine, *cpEnd == '\0', (uint64_t) version, 0);
+	}
+	
+	fclose(fpManifest);
+}
+
+/**
+ * \brief rewrite the manifest from the files in memory
+ */
+void knownFilesSave(void)
+{
+	FILE *fpManifest;
+	size_t i;
+	
+	if ((fpManifest = fopen(KNOWN_FILES_MANIFEST ".new", "w")) == NULL) {
+		verbose("Cannot update " KNOWN_FILES_MANIFEST);
+		return;
+	}
+	
+	for (i = 0; i < knownFileCount; i++) {
+		/* a name the line format cannot hold is not remembered across runs */
+		if (strpbrk(knownFiles[i].cpName, "\t\n") != NULL) continue;
+		if (knownFiles[i].iHasVersion) {
+			fprintf(fpManifest, "%s\t%llu\n", knownFiles[i].cpName, (unsigned long long) knownFiles[i].version);
+		} else {
+			fprintf(fpManifest, "%s\n", knownFiles[i].cpName);
+		}
+	}
+	
+	if (fclose(fpManifest) != 0 || rename(KNOWN_FILES_MANIFEST ".new", KNOWN_FILES_MANIFEST) < 0) {
+		verbose("Cannot update " KNOWN_FILES_MANIFEST);
+		(void) unlink(KNOWN_FILES_MANIFEST ".new");
+	}
+}
+
+/**
+ * \brief remember a received response file, in memory and in the manifest
+ *
+ * \param cpName - file name as sent by the server
+ * \param iHasVersion - non-zero if the server sent a version with the file
+ * \param version - the version
+ * \param iSave - non-zero to update the manifest if anything changed
+ */
+void knownFileSet(const char *cpName, int iHasVersion, uint64_t version, int iSave)
+{
+	known_file_t *file = NULL;
+	size_t i;
+	
+	for (i = 0; i < knownFileCount; i++) {
+		if (strcmp(knownFiles[i].cpName, cpName) == 0) {
+			file = &knownFiles[i];
+			break;
+		}
+	}
+	
+	if (file == NULL) {
+		if ((knownFiles = realloc(knownFiles, (knownFileCount + 1) * sizeof(*knownFiles))) == NULL ||
+				(knownFiles[knownFileCount].cpName = strdup(cpName)) == NULL) {
+			exitWithError("malloc()", strerror(errno));
+		}
+		file = &knownFiles[knownFileCount++];
+	} else if (file->iHasVersion == iHasVersion && (!iHasVersion || file->version == version)) {
+		return;
+	}
+	
+	file->iHasVersion = iHasVersion;
+	file->version = version;
+	
+	if (iSave) knownFilesSave();
+}
+
+/**
+ * \brief encode a known file field, and the version if any, for each remembered response file still present
+ *
+ * \param length [OUT] - length of the fields
+ *
+ * \return the fields, to be freed by the caller; NULL if none
+ */
+unsigned char *knownFilesEncode(size_t *length)
+{
+	unsigned char *cpFields = NULL;
+	struct stat fileStat;
+	void *pContent;
+	uint64_t hash;
+	size_t i, size = 0, count = 0;
+	int iFileFD;
+	
+	*length = 0;
+	
+	for (i = 0; i < knownFileCount && count < KNOWN_FILES_MAX; i++) {
+		
+		if ((iFileFD = open(knownFiles[i].cpName, O_RDONLY)) < 0) continue;
+		if (fstat(iFileFD, &fileStat) < 0 || !S_ISREG(fileStat.st_mode)) {
+			close(iFileFD);
+			continue;
+		}
+		
+		/* an empty file cannot be mapped */
+		if (fileStat.st_size == 0) {
+			hash = protocolHash("", 0);
+		} else {
+			pContent = mmap(NULL, (size_t) fileStat.st_size, PROT_READ, MAP_PRIVATE, iFileFD, 0);
+			if (pContent == MAP_FAILED) {
+				close(iFileFD);
+				continue;
+			}
+			hash = protocolHash(pContent, (size_t) fileStat.st_size);
+			munmap(pContent, (size_t) fileStat.st_size);
+		}
+		close(iFileFD);
+		
+		size += protocolKnownFileSize(knownFiles[i].cpName) + 2 + PROTOCOL_VARINT_MAX;
+		if ((cpFields = realloc(cpFields, size)) == NULL) {
+			exitWithError("malloc()", strerror(errno));
+		}
+		*length += protocolPutKnownFile(cpFields + *length, hash, knownFiles[i].cpName);
+		if (knownFiles[i].iHasVersion) {
+			*length += protocolPutVarintField(cpFields + *length, PROTOCOL_FIELD_KNOWN_VERSION, knownFiles[i].version);
+		}
+		count++;
+	}
+	
+	return cpFields;
+}
+
+/**
+ * \brief insert bytes of the socket into a file, moving its tail behind them
+ *
+ * \param reader - reader on the socket
+ * \param iFileFD - file open for reading and writing
+ * \param offset - where the bytes go
+ * \param length - number of bytes to insert
+ *
+ * \return 0 on success, -1 on error with errno set
+ */
+int patchBody(reader_t *reader, int iFileFD, size_t offset, size_t length)
+{
+	struct stat fileStat;
+	char cBuf[MAX_BUF], *cpTail = NULL;
+	size_t tailLen, done, n;
+	ssize_t iIO;
+	
+	if (fstat(iFileFD, &fileStat) < 0) return -1;
+	if ((size_t) fileStat.st_size < offset) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	/* the tail is what the insert overwrites */
+	tailLen = (size_t) fileStat.st_size - offset;
+	if (tailLen > 0 && (cpTail = malloc(tailLen)) == NULL) return -1;
+	for (done = 0; done < tailLen; done += (size_t) iIO) {
+		if ((iIO = pread(iFileFD, cpTail + done, tailLen - done, (off_t) (offset + done))) <= 0) {
+			if (iIO < 0 && errno == EINTR) {
+				iIO = 0;
+				continue;
+			}
+			if (iIO == 0) errno = EIO;
+			free(cpTail);
+			return -1;
+		}
+	}
+	
+	while (length > 0) {
+		if ((n = readerRead(reader, cBuf, length < sizeof(cBuf) ? length : sizeof(cBuf))) == 0) {
+			free(cpTail);
+			errno = EPIPE;
+			return -1;
+		}
+		length -= n;
+		for (done = 0; done < n; done += (size_t) iIO) {
+			if ((iIO = pwrite(iFileFD, cBuf + done, n - done, (off_t) offset)) < 0) {
+				if (errno == EINTR) {
+					iIO = 0;
+					continue;
+				}
+				free(cpTail);
+				return -1;
+			}
+			offset += (size_t) iIO;
+		}
+	}
+	
+	for (done = 0; done < tailLen; done += (size_t) iIO) {
+		if ((iIO = pwrite(iFileFD, cpTail + done, tailLen - done, (off_t) (offset + done))) < 0) {
+			if (errno == EINTR) {
+				iIO = 0;
+				continue;
+			}
+			free(cpTail);
+			return -1;
+		}
+	}
+	
+	free(cpTail);
+	return 0;
+}
+
+/**
+ * \brief apply a patch of the response to the file the client holds
+ *
+ * \param reader - reader on the socket, at the patch
+ * \param cpResponseFilename - file to patch
+ * \param length - length of the patch field
+ */
+void patchResponseFile(reader_t *reader, const char *cpResponseFilename, size_t length)
+{
+	uint64_t offset;
+	size_t peek = length < PROTOCOL_VARINT_MAX ? length : PROTOCOL_VARINT_MAX;
+	int n, iFileFD;
+	
+	/* a batch only reports the status */
+	if (options.batch != NULL) {
+		if (readerSkip(reader, length) < 0) {
+			exitWithError("readerSkip()", "Cannot read from socket");
+		}
+		return;
+	}
+	
+	if (readerPeek(reader, peek) < peek ||
+			(n = protocolGetVarint((const unsigned char *) reader->cBuf + reader->start, peek, &offset)) <= 0) {
+		exitWithError("readFrameResponse()", "Malformed file patch");
+	}
+	reader->start += (size_t) n;
+	length -= (size_t) n;
+	
+	verbose("Patch response file");
+	if ((iFileFD = open(cpResponseFilename, O_RDWR | O_CLOEXEC)) < 0) {
+		exitWithError("open()", strerror(errno));
+	}
+	if (offset > SIZE_MAX || patchBody(reader, iFileFD, (size_t) offset, length) < 0) {
+		close(iFileFD);
+		exitWithError("patchBody()", strerror(errno));
+	}
+	if (close(iFileFD) < 0) {
+		exitWithError("close()", strerror(errno));
+	}
+	verbose("Successful processed response file");
+}
+
+/**
+ * \brief write the request as one binary frame
+ *
+ * \param fpWriteSocket - write stream on the socket
+ */
+void sendFrameRequest(FILE* fpWriteSocket)
+{
+	smc_record_t record;
+	unsigned char *cpFrame;
+	size_t length;
+	
+	verbose("Write request frame into stream");
+	
+	record.user = cpUser;
+	record.image = cpImage;
+	record.message = cpMessage;
+	cpFrame = buildFrameRequest(&record, 1, 0, 1, &length);
+	
+	if (fwrite(cpFrame, 1, length, fpWriteSocket) != length || fflush(fpWriteSocket) != 0) {
+		free(cpFrame);
+		exitWithError("fwrite()", strerror(errno));
+	}
+	
+	free(cpFrame);
+}
+
+/**
+ * \brief start reading the records of the batch or the messages of the command line
+ */
+void sourceOpen(source_t *source)
+{
+	source->iNext = 0;
+	source->cpUser = cpUser;
+	source->cpImage = cpImage;
+	source->ulFailed = 0;
+	
+	if (options.batch != NULL && batchOpen(&source->batch, options.batch) < 0) {
+		exitWithError("batchOpen()", strerror(errno));
+	}
+}
+
+/**
+ * \brief get the next record to submit
+ *
+ * Invalid records of a batch are reported and skipped.
+ *
+ * \param source - the source
+ * \param record [OUT] - the record, fields not given by it are taken from the command line
+ * \param pId [OUT] - id of the request: line in the batch or number of the message
+ *
+ * \return 1 if there is a record, 0 at the end
+ */
+int sourceNext(source_t *source, smc_record_t *record, uint32_t *pId)
+{
+	const char *cpReason;
+	int iResult;
+	
+	if (options.batch == NULL) {
+		if (source->iNext == options.message_count) return 0;
+		record->user = source->cpUser;
+		record->image = source->cpImage;
+		record->message = options.messages[source->iNext++];
+		*pId = (uint32_t) source->iNext;
+		return 1;
+	}
+	
+	for (;;) {
+		if ((iResult = batchNext(&source->batch, record, &cpReason)) == BATCH_END) return 0;
+		if (iResult == BATCH_ERROR) exitWithError("batchNext()", strerror(errno));
+		*pId = (uint32_t) source->batch.line;
+		
+		if (iResult == BATCH_RECORD) {
+			if (record->user == NULL) record->user = source->cpUser;
+			if (record->image == NULL) record->image = source->cpImage;
+			if (record->user != NULL) return 1;
+			cpReason = "no user";
+		}
+		reportRecord(source, *pId, -1, cpReason);
+	}
+}
+
+void sourceClose(source_t *source)
+{
+	if (options.batch != NULL) batchClose(&source->batch);
+}
+
+/**
+ * \brief print the outcome of a record of the batch
+ *
+ * \param source - the source
+ * \param id - line of the record
+ * \param lStatus - status of the response
+ * \param cpReason - why the record was not submitted, NULL if it was
+ */
+void reportRecord(source_t *source, uint32_t id, long lStatus, const char *cpReason)
+{
+	if (cpReason != NULL || lStatus != 0) source->ulFailed++;
+	if (options.batch == NULL) {
+		if (lStatus == PROTOCOL_STATUS_BUSY &&
+				fprintf(stderr, "%s - %s: %s\n", cpFilename, "readResponse()", "server is busy - try again later") < 0) {
+			exitWithError("fprintf()", strerror(errno));
+		}
+		return;
+	}
+	
+	if (cpReason != NULL) {
+		if (printf("%lu\tinvalid\t%s\n", (unsigned long) id, cpReason) < 0) exitWithError("printf()", strerror(errno));
+	} else if (printf("%lu\t%ld\n", (unsigned long) id, lStatus) < 0) {
+		exitWithError("printf()", strerror(errno));
+	}
+}
+
+/**
+ * \brief submit each record over a connection of its own
+ *
+ * \param source - the source
+ */
+void runSequential(source_t *source)
+{
+	smc_record_t record;
+	uint32_t id;
+	int iSocketFD, iStatus;
+	
+	while (sourceNext(source, &record, &id)) {
+		cpUser = record.user;
+		cpImage = record.image;
+		cpMessage = record.message;
+		
+		/* function to connect to server */
+		openSocket(&iSocketFD);
+		
+		/* function to write request into stream socket */
+		sendRequest(&iSocketFD, NULL);
+
+		/* function to parse response into files */
+		iStatus = readResponse(&iSocketFD);
+		reportRecord(source, id, iStatus, NULL);
+		
+		close(iSocketFD);
+	}
+}
+
+/**
+ * \brief send all records over one keep-alive connection
+ *
+ * Up to options.inflight requests are sent ahead of their responses. The
+ * socket is polled for both directions, so neither side can block the
+ * other with a full socket buffer. Records are read only when the window
+ * has room, so a batch of any size runs in constant memory.
+ *
+ * \param paramISocketFD - socket file descriptor to the address
+ * \param source - the source
+ */
+void runPipeline(int *paramISocketFD, source_t *source)
+{
+	static reader_t reader;
+	smc_record_t record;
+	struct pollfd pfd;
+	unsigned char *cpFrame = NULL;
+	uint32_t *ids, id;
+	size_t frameLen = 0, frameSent = 0, window = (size_t) options.inflight;
+	unsigned long ulSent = 0, ulDone = 0;
+	int iEnd = 0, iKeepAlive, iStatus;
+	char cBusy[64];
+	uint64_t status;
+	ssize_t n;
+	
+	verbose("Send pipelined requests");
+	
+	/* ids of the requests in flight, oldest first */
+	if ((ids = malloc(window * sizeof(*ids))) == NULL) {
+		exitWithError("malloc()", strerror(errno));
+	}
+	
+	reader.iFD = *paramISocketFD;
+	reader.start = 0;
+	reader.end = 0;
+	
+	for (;;) {
+		
+		/* next frame once the previous one is out and the window is open */
+		if (cpFrame == NULL && !iEnd && ulSent - ulDone < window) {
+			if (sourceNext(source, &record, &id)) {
+				/* the end of a batch is not known ahead, its connection is closed by the client */
+				iKeepAlive = options.batch != NULL || source->iNext < options.message_count;
+				cpFrame = buildFrameRequest(&record, id, iKeepAlive, ulSent == 0, &frameLen);
+				frameSent = 0;
+				ids[ulSent % window] = id;
+			} else {
+				iEnd = 1;
+			}
+		}
+		if (cpFrame == NULL && ulDone == ulSent && iEnd) break;
+		
+		pfd.fd = *paramISocketFD;
+		pfd.events = (cpFrame != NULL ? POLLOUT : 0) | (ulDone < ulSent ? POLLIN : 0);
+		pfd.revents = 0;
+		
+		/* bytes the reader already holds do not show up in poll() */
+		if (ulDone < ulSent && reader.end > reader.start) {
+			pfd.revents = POLLIN;
+		} else if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR) continue;
+			exitWithError("poll()", strerror(errno));
+		}
+		
+		/* a response that has begun is complete soon - read all of it */
+		if (ulDone < ulSent && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+			if (ulDone == 0) {
+				if (readerPeek(&reader, PROTOCOL_PREAMBLE_SIZE) < PROTOCOL_PREAMBLE_SIZE ||
+						protocolGetPreamble((const unsigned char *) reader.cBuf + reader.start, PROTOCOL_PREAMBLE_SIZE) <= 0) {
+					/* turned away before the first request arrived: the busy answer is text */
+					if (readerGets(&reader, cBusy, sizeof(cBusy)) != NULL &&
+							sscanf(cBusy, "status=%d", &iStatus) == 1 && iStatus == PROTOCOL_STATUS_BUSY) {
+						exitWithError("runPipeline()", "server is busy - try again later");
+					}
+					exitWithError("runPipeline()", "server does not answer in protocol version 2");
+				}
+				reader.start += PROTOCOL_PREAMBLE_SIZE;
+			}
+			if (readFrameResponse(&reader, &status) != ids[ulDone % window]) {
+				exitWithError("runPipeline()", "response to an unexpected request");
+			}
+			reportRecord(source, ids[ulDone % window], status > LONG_MAX ? LONG_MAX : (long) status, NULL);
+			ulDone++;
+			continue;
+		}
+		
+		if (pfd.revents & (POLLOUT | POLLHUP | POLLERR)) {
+			n = send(*paramISocketFD, cpFrame + frameSent, frameLen - frameSent, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+				free(cpFrame);
+				exitWithError("send()", strerror(errno));
+			}
+			frameSent += (size_t) n;
+			if (frameSent == frameLen) {
+				free(cpFrame);
+				cpFrame = NULL;
+				ulSent++;
+			}
+		}
+	}
+	
+	free(ids);
+	verbose("Successful processed responses");
+}
+
+/**
+ * \brief parse a binary response frame into files
+ *
+ * The fields are read one after the other; file data is written with the
+ * selected transfer mode straight from the socket. Encoded file data is
+ * decoded on the way into the file.
+ *
+ * \param reader - reader on the socket, positioned after the preamble
+ * \param pStatus [OUT] - status of the response, EXIT_FAILURE if the server sent none
+ *
+ * \return id of the request answered
+ */
+uint32_t readFrameResponse(reader_t *reader, uint64_t *pStatus)
+{
+	protocol_header_t header;
+	const unsigned char *cpHead;
+	char *cpResponseFilename = NULL;
+	uint64_t fieldLen, encoding = 0, fileSize = 0, version = 0;
+	size_t remaining, headLen;
+	uint8_t tag;
+	int n, iHasVersion = 0;
+	
+	*pStatus = EXIT_FAILURE;
+	
+	verbose("Parse header of response");
+	if (readerPeek(reader, PROTOCOL_HEADER_SIZE) < PROTOCOL_HEADER_SIZE) {
+		exitWithError("readFrameResponse()", "Cannot read from socket");
+	}
+	protocolGetHeader((const unsigned char *) reader->cBuf + reader->start, &header);
+	reader->start += PROTOCOL_HEADER_SIZE;
+	if (header.type != PROTOCOL_FRAME_RESPONSE) {
+		exitWithError("readFrameResponse()", "Unexpected frame type");
+	}
+	
+	remaining = header.length;
+	while (remaining > 0) {
+		
+		/* tag and length of the next field - never ask for bytes past the frame */
+		headLen = remaining < 1 + PROTOCOL_VARINT_MAX ? remaining : 1 + PROTOCOL_VARINT_MAX;
+		if (readerPeek(reader, headLen) < headLen) {
+			exitWithError("readFrameResponse()", "Cannot read from socket");
+		}
+		cpHead = (const unsigned char *) reader->cBuf + reader->start;
+		n = protocolGetVarint(cpHead + 1, headLen - 1, &fieldLen);
+		if (n <= 0 || fieldLen > remaining - 1 - (size_t) n) {
+			exitWithError("readFrameResponse()", "Malformed response field");
+		}
+		tag = cpHead[0];
+		reader->start += 1 + (size_t) n;
+		remaining -= 1 + (size_t) n + (size_t) fieldLen;
+		
+		switch (tag) {
+		
+		case PROTOCOL_FIELD_STATUS:
+			verbose("Parse status of response");
+			if (readerReadVarint(reader, (size_t) fieldLen, pStatus) < 0) {
+				exitWithError("readFrameResponse()", "status could not be scanned");
+			}
+			break;
+		
+		case PROTOCOL_FIELD_FILE_ENCODING:
+			if (readerReadVarint(reader, (size_t) fieldLen, &encoding) < 0) {
+				exitWithError("readFrameResponse()", "file encoding could not be scanned");
+			}
+			break;
+		
+		case PROTOCOL_FIELD_FILE_SIZE:
+			if (readerReadVarint(reader, (size_t) fieldLen, &fileSize) < 0) {
+				exitWithError("readFrameResponse()", "file size could not be scanned");
+			}
+			break;
+		
+		case PROTOCOL_FIELD_FILE_NAME:
+			verbose("Parse filename of response");
+			free(cpResponseFilename);
+			if ((cpResponseFilename = malloc((size_t) fieldLen + 1)) == NULL) {
+				exitWithError("malloc()", strerror(errno));
+			}
+			if (readerReadFull(reader, cpResponseFilename, (size_t) fieldLen) < 0) {
+				exitWithError("readFrameResponse()", "Cannot read from socket");
+			}
+			cpResponseFilename[fieldLen] = '\0';
+			iHasVersion = 0;
+			break;
+		
+		case PROTOCOL_FIELD_FILE_VERSION:
+			if (readerReadVarint(reader, (size_t) fieldLen, &version) < 0) {
+				exitWithError("readFrameResponse()", "file version could not be scanned");
+			}
+			iHasVersion = 1;
+			break;
+		
+		case PROTOCOL_FIELD_FILE_UNCHANGED:
+			verbose("Response file unchanged, kept");
+			if (readerSkip(reader, (size_t) fieldLen) < 0) {
+				exitWithError("readFrameResponse()", "Cannot read from socket");
+			}
+			break;
+		
+		case PROTOCOL_FIELD_FILE_PATCH:
+			if (cpResponseFilename == NULL) {
+				exitWithError("readFrameResponse()", "file patch without file name");
+			}
+			patchResponseFile(reader, cpResponseFilename, (size_t) fieldLen);
+			if (options.conditional && options.batch == NULL) {
+				knownFileSet(cpResponseFilename, iHasVersion, version, 1);
+			}
+			break;
+		
+		case PROTOCOL_FIELD_FILE_DATA:
+			if (cpResponseFilename == NULL) {
+				exitWithError("readFrameResponse()", "file data without file name");
+			}
+			if (encoding != 0) {
+				writeEncodedFile(reader, cpResponseFilename, encoding, (size_t) fieldLen, fileSize);
+				encoding = 0;
+			} else {
+				if (fieldLen > INT_MAX) {
+					exitWithError("readFrameResponse()", "file too large");
+				}
+				writeResponseFile(reader, cpResponseFilename, (int) fieldLen);
+			}
+			if (options.conditional && options.batch == NULL) {
+				knownFileSet(cpResponseFilename, iHasVersion, version, 1);
+			}
+			break;
+		
+		default:
+			/* fields of newer servers are skipped */
+			if (readerSkip(reader, (size_t) fieldLen) < 0) {
+				exitWithError("readFrameResponse()", "Cannot read from socket");
+			}
+			break;
+		}
+	}
+	
+	free(cpResponseFilename);
+	return header.id;
+}
+
+/**
+ * \brief make at least size bytes available in the reader
+ *
+ * \param reader - reader on the socket
+ * \param size - number of bytes needed, at most MAX_BUF
+ *
+ * \return number of buffered bytes, less than size only at end of stream or on error
+ */
+size_t readerPeek(reader_t *reader, size_t size)
+{
+	ssize_t iRead;
+	
+	if (reader->start > 0) {
+		memmove(reader->cBuf, reader->cBuf + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+	
+	while (reader->end < size) {
+		iRead = read(reader->iFD, reader->cBuf + reader->end, sizeof(reader->cBuf) - reader->end);
+		if (iRead < 0 && errno == EINTR) continue;
+		if (iRead <= 0) break;
+		reader->end += (size_t) iRead;
+	}
+	
+	return reader->end;
+}
+
+/**
+ * \brief read exactly size bytes
+ *
+ * \return 0 on success, -1 on premature end of stream or error
+ */
+int readerReadFull(reader_t *reader, char *cpDest, size_t size)
+{
+	size_t done = 0, n;
+	
+	while (done < size) {
+		if ((n = readerRead(reader, cpDest + done, size - done)) == 0) return -1;
+		done += n;
+	}
+	
+	return 0;
+}
+
+/**
+ * \brief discard exactly size bytes
+ *
+ * \return 0 on success, -1 on premature end of stream or error
+ */
+int readerSkip(reader_t *reader, size_t size)
+{
+	ssize_t iAvail;
+	size_t n;
+	
+	while (size > 0) {
+		if ((iAvail = readerFill(reader)) <= 0) return -1;
+		n = (size_t) iAvail < size ? (size_t) iAvail : size;
+		reader->start += n;
+		size -= n;
+	}
+	
+	return 0;
 }
@@ -0,0 +1,385 @@
+/**
+ * @file simple_message_client_batch.c
+ * TCP/IP Server-Client project
+ *
+ * Record reader for the batch mode of the simple_message_client. The batch
+ * is read one line at a time, so its size is not limited by memory. Each
+ * non-empty line is one record in one of two formats:
+ *
+ *     message
+ *     user <TAB> message
+ *     user <TAB> image <TAB> message
+ *     {"user": "...", "image": "...", "message": "..."}
+ *
+ * A line starting with '{' is a JSON object (JSONL), other keys of it are
+ * ignored. In the tab separated format "\t", "\n", "\r" and "\\" stand for
+ * tab, newline, carriage return and backslash, and an empty image is none.
+ * Fields not given by the record are taken from the command line.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_client_batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static char *skipSpace(char *cp);
+static void unescapeTsv(char *cp);
+static void parseTsv(char *cpLine, smc_record_t *record);
+static size_t putUtf8(char *cpDest, unsigned long code);
+static int getHex4(const char *cp, unsigned long *code);
+static int parseJsonString(char **cpp, char **cpValue);
+static int skipJsonValue(char **cpp);
+static int parseJson(char *cpLine, smc_record_t *record, const char **error);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief open a batch file
+ *
+ * \param batch - batch to initialize
+ * \param path - name of the file, "-" for stdin
+ *
+ * \return 0 on success, -1 on error with errno set
+ */
+int batchOpen(smc_batch_t *batch, const char *path)
+{
+    batch->line = 0;
+    batch->buf = NULL;
+    batch->size = 0;
+
+    if (strcmp(path, "-") == 0) {
+        batch->fp = stdin;
+        return 0;
+    }
+
+    return (batch->fp = fopen(path, "r")) == NULL ? -1 : 0;
+}
+
+/**
+ * \brief read the next record
+ *
+ * Empty lines are skipped. The strings of the record stay valid until the
+ * next call.
+ *
+ * \param batch - the batch
+ * \param record [OUT] - the record
+ * \param error [OUT] - why the record is invalid
+ *
+ * \return BATCH_RECORD, BATCH_END, BATCH_INVALID for a malformed line (which
+ *         is consumed) or BATCH_ERROR if reading failed with errno set
+ */
+int batchNext(smc_batch_t *batch, smc_record_t *record, const char **error)
+{
+    ssize_t len;
+    char *cp;
+
+    for (;;) {
+        errno = 0;
+        if ((len = getline(&batch->buf, &batch->size, batch->fp)) < 0) {
+            return errno != 0 ? BATCH_ERROR : BATCH_END;
+        }
+        batch->line++;
+
+        while (len > 0 && (batch->buf[len - 1] == '\n' || batch->buf[len - 1] == '\r')) {
+            batch->buf[--len] = '\0';
+        }
+        if ((size_t) len != strlen(batch->buf)) {
+            *error = "NUL byte in line";
+            return BATCH_INVALID;
+        }
+
+        cp = skipSpace(batch->buf);
+        if (*cp == '\0') continue;
+
+        record->user = NULL;
+        record->image = NULL;
+        record->message = NULL;
+
+        if (*cp == '{') return parseJson(cp, record, error);
+
+        parseTsv(batch->buf, record);
+        return BATCH_RECORD;
+    }
+}
+
+/**
+ * \brief close a batch file
+ */
+void batchClose(smc_batch_t *batch)
+{
+    if (batch->fp != stdin) fclose(batch->fp);
+    free(batch->buf);
+}
+
+static char *skipSpace(char *cp)
+{
+    while (*cp == ' ' || *cp == '\t') cp++;
+    return cp;
+}
+
+/**
+ * \brief decode the escapes of a tab separated field in place
+ *
+ * Unknown escapes are kept as they are.
+ */
+static void unescapeTsv(char *cp)
+{
+    char *cpDest = cp;
+
+    for (; *cp != '\0'; cp++) {
+        if (*cp == '\\' && cp[1] != '\0') {
+            switch (cp[1]) {
+            case 't': *cpDest++ = '\t'; cp++; continue;
+            case 'n': *cpDest++ = '\n'; cp++; continue;
+            case 'r': *cpDest++ = '\r'; cp++; continue;
+            case '\\': *cpDest++ = '\\'; cp++; continue;
+            default: break;
+            }
+        }
+        *cpDest++ = *cp;
+    }
+    *cpDest = '\0';
+}
+
+/**
+ * \brief split a tab separated line into the fields of the record
+ *
+ * With three fields or more, the message is the rest of the line.
+ */
+static void parseTsv(char *cpLine, smc_record_t *record)
+{
+    char *cpTab, *cpImage;
+
+    if ((cpTab = strchr(cpLine, '\t')) == NULL) {
+        unescapeTsv(cpLine);
+        record->message = cpLine;
+        return;
+    }
+
+    *cpTab = '\0';
+    record->user = cpLine;
+    record->message = cpTab + 1;
+
+    cpImage = cpTab + 1;
+    if ((cpTab = strchr(cpImage, '\t')) != NULL) {
+        *cpTab = '\0';
+        record->image = cpImage;
+        record->message = cpTab + 1;
+        unescapeTsv(cpImage);
+        if (*cpImage == '\0') record->image = NULL;
+    }
+
+    unescapeTsv(cpLine);
+    unescapeTsv((char *) record->message);
+}
+
+/**
+ * \brief encode a code point as UTF-8
+ *
+ * \return number of bytes written
+ */
+static size_t putUtf8(char *cpDest, unsigned long code)
+{
+    if (code < 0x80) {
+        cpDest[0] = (char) code;
+        return 1;
+    }
+    if (code < 0x800) {
+        cpDest[0] = (char) (0xc0 | (code >> 6));
+        cpDest[1] = (char) (0x80 | (code & 0x3f));
+        return 2;
+    }
+    if (code < 0x10000) {
+        cpDest[0] = (char) (0xe0 | (code >> 12));
+        cpDest[1] = (char) (0x80 | ((code >> 6) & 0x3f));
+        cpDest[2] = (char) (0x80 | (code & 0x3f));
+        return 3;
+    }
+    cpDest[0] = (char) (0xf0 | (code >> 18));
+    cpDest[1] = (char) (0x80 | ((code >> 12) & 0x3f));
+    cpDest[2] = (char) (0x80 | ((code >> 6) & 0x3f));
+    cpDest[3] = (char) (0x80 | (code & 0x3f));
+    return 4;
+}
+
+static int getHex4(const char *cp, unsigned long *code)
+{
+    int i;
+
+    *code = 0;
+    for (i = 0; i < 4; i++) {
+        *code <<= 4;
+        if (cp[i] >= '0' && cp[i] <= '9') *code |= (unsigned long) (cp[i] - '0');
+        else if (cp[i] >= 'a' && cp[i] <= 'f') *code |= (unsigned long) (cp[i] - 'a' + 10);
+        else if (cp[i] >= 'A' && cp[i] <= 'F') *code |= (unsigned long) (cp[i] - 'A' + 10);
+        else return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief decode a JSON string in place
+ *
+ * The decoded string is never longer than its encoding, so it is written
+ * over it and terminated where the encoding ended at the latest.
+ *
+ * \param cpp [IN/OUT] - position of the opening quote, advanced past the closing one
+ * \param cpValue [OUT] - the decoded string
+ *
+ * \return 0 on success, -1 if malformed
+ */
+static int parseJsonString(char **cpp, char **cpValue)
+{
+    char *cp = *cpp + 1, *cpDest = *cpp;
+    unsigned long code, low;
+
+    *cpValue = cpDest;
+
+    for (;;) {
+        if (*cp == '"') break;
+        if (*cp == '\0' || (unsigned char) *cp < 0x20) return -1;
+        if (*cp != '\\') {
+            *cpDest++ = *cp++;
+            continue;
+        }
+
+        switch (cp[1]) {
+        case '"': *cpDest++ = '"'; break;
+        case '\\': *cpDest++ = '\\'; break;
+        case '/': *cpDest++ = '/'; break;
+        case 'b': *cpDest++ = '\b'; break;
+        case 'f': *cpDest++ = '\f'; break;
+        case 'n': *cpDest++ = '\n'; break;
+        case 'r': *cpDest++ = '\r'; break;
+        case 't': *cpDest++ = '\t'; break;
+        case 'u':
+            if (getHex4(cp + 2, &code) < 0) return -1;
+            cp += 4;
+            /* characters outside the BMP come as surrogate pair */
+            if (code >= 0xd800 && code < 0xdc00) {
+                if (cp[2] != '\\' || cp[3] != 'u' || getHex4(cp + 4, &low) < 0 ||
+                        low < 0xdc00 || low >= 0xe000) {
+                    return -1;
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                cp += 6;
+            } else if ((code >= 0xdc00 && code < 0xe000) || code == 0) {
+                return -1;
+            }
+            cpDest += putUtf8(cpDest, code);
+            break;
+        default:
+            return -1;
+        }
+        cp += 2;
+    }
+
+    *cpDest = '\0';
+    *cpp = cp + 1;
+    return 0;
+}
+
+/**
+ * \brief skip a JSON value of a key the client does not use
+ *
+ * Nested objects and arrays are only checked for balanced brackets.
+ */
+static int skipJsonValue(char **cpp)
+{
+    char *cp = *cpp, *cpString;
+    int depth = 0;
+
+    do {
+        cp = skipSpace(cp);
+        if (*cp == '"') {
+            if (parseJsonString(&cp, &cpString) < 0) return -1;
+        } else if (*cp == '{' || *cp == '[') {
+            depth++;
+            cp++;
+        } else if (*cp == '}' || *cp == ']') {
+            if (depth == 0) return -1;
+            depth--;
+            cp++;
+        } else if (depth > 0 && (*cp == ',' || *cp == ':')) {
+            cp++;
+        } else {
+            /* number, true, false or null */
+            if (strchr(",}] \t", *cp) != NULL) return -1;
+            while (*cp != '\0' && strchr(",:{}[]\" \t", *cp) == NULL) cp++;
+        }
+    } while (depth > 0);
+
+    *cpp = cp;
+    return 0;
+}
+
+/**
+ * \brief decode a JSON object record
+ */
+static int parseJson(char *cpLine, smc_record_t *record, const char **error)
+{
+    char *cp = cpLine + 1, *cpKey, *cpValue;
+
+    *error = "malformed JSON";
+
+    cp = skipSpace(cp);
+    if (*cp == '}') {
+        cp++;
+    } else for (;;) {
+        if (*cp != '"' || parseJsonString(&cp, &cpKey) < 0) return BATCH_INVALID;
+        cp = skipSpace(cp);
+        if (*cp++ != ':') return BATCH_INVALID;
+        cp = skipSpace(cp);
+
+        if (strcmp(cpKey, "user") == 0 || strcmp(cpKey, "image") == 0 ||
+                strcmp(cpKey, "img") == 0 || strcmp(cpKey, "message") == 0) {
+            if (*cp != '"' || parseJsonString(&cp, &cpValue) < 0) {
+                *error = "value is not a string";
+                return BATCH_INVALID;
+            }
+            if (cpKey[0] == 'u') record->user = cpValue;
+            else if (cpKey[0] == 'i') record->image = cpValue;
+            else record->message = cpValue;
+        } else if (skipJsonValue(&cp) < 0) {
+            return BATCH_INVALID;
+        }
+
+        cp = skipSpace(cp);
+        if (*cp == '}') {
+            cp++;
+            break;
+        }
+        if (*cp++ != ',') return BATCH_INVALID;
+        cp = skipSpace(cp);
+    }
+
+    if (*skipSpace(cp) != '\0') return BATCH_INVALID;
+    if (record->message == NULL) {
+        *error = "no message";
+        return BATCH_INVALID;
+    }
+
+    return BATCH_RECORD;
+}
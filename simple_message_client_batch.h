@@ -0,0 +1,61 @@
+/**
+ * @file simple_message_client_batch.h
+ * TCP/IP Server-Client project
+ *
+ * Record reader for the batch mode of the simple_message_client.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_BATCH_H
+#define SIMPLE_MESSAGE_CLIENT_BATCH_H
+
+#include <stdio.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+/* results of batchNext() */
+#define BATCH_RECORD 1
+#define BATCH_END 0
+#define BATCH_INVALID -1
+#define BATCH_ERROR -2
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+/** batch file read one line at a time */
+typedef struct
+{
+    FILE *fp;
+    unsigned long line;     /* number of the line read last */
+    char *buf;              /* the line, records point into it */
+    size_t size;
+} smc_batch_t;
+
+/** one record of the batch, fields not given are NULL */
+typedef struct
+{
+    const char *user;
+    const char *image;
+    const char *message;
+} smc_record_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+int batchOpen(smc_batch_t *batch, const char *path);
+int batchNext(smc_batch_t *batch, smc_record_t *record, const char **error);
+void batchClose(smc_batch_t *batch);
+
+#endif
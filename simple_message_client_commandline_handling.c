@@ -22,14 +22,25 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <getopt.h>
 
+#include "simple_message_protocol.h"
 #include "simple_message_client_commandline_handling.h"
 
 /*
  * --------------------------------------------------------------- defines --
  */
 
+/* getopt codes for long options without a short equivalent */
+#define OPT_BATCH 256
+#define OPT_INFLIGHT 257
+#define OPT_CONNECT_TIMEOUT 258
+#define OPT_FASTOPEN 259
+#define OPT_COMPRESS 260
+#define OPT_CONDITIONAL 261
+
 /*
  * -------------------------------------------------------------- typedefs --
  */
@@ -42,10 +53,35 @@
  * ------------------------------------------------- function declarations --
  */
 
+static int parse_count(const char *arg);
+
 /*
  * ------------------------------------------------------------- functions --
  */
 
+/**
+ *
+ * \brief Convert a positive decimal command line argument
+ *
+ * \param arg [IN] - argument string
+ *
+ * \return the value, or -1 if \a arg is not a number in the range [1, INT_MAX]
+ *
+ */
+static int parse_count(const char *arg)
+{
+    char *end;
+    long value;
+
+    value = strtol(arg, &end, 10);
+    if ((end == arg) || (*end != '\0') || (value < 1) || (value > INT_MAX))
+    {
+        return -1;
+    }
+
+    return (int) value;
+}
+
 /**
  *
  * \brief Parse the command line
@@ -61,10 +97,12 @@
  * \param message [OUT] - string containing the message
  * \param img_url [OUT] - string containing the image URL
  * \param verbose [OUT] - int containing info whether output shall be verbose or not
+ * \param options [OUT] - optional settings (defaults if not given)
  *
  * \return Upon successful execution, the function returns and the output parameters
  *         \a port, \a server, \a message, and  \a img_url are filled properly (Note that
- *         img_url might be NULL, since it's optional on the commandline.). - Upon
+ *         img_url might be NULL, since it's optional on the commandline. With --batch,
+ *         \a message is NULL and \a user might be NULL.). - Upon
  *         failure the function prints usage information and terminates the program by
  *         calling \a usagefunc.
  *
@@ -78,7 +116,8 @@ void smc_parsecommandline(
     const char **user,
     const char **message,
     const char **img_url,
-    int *verbose
+    int *verbose,
+    smc_options_t *options
     )
 {
     int c;
@@ -89,6 +128,16 @@ void smc_parsecommandline(
     *message = NULL;
     *img_url = NULL;
     *verbose = FALSE;
+    options->transfer = SMC_TRANSFER_COPY;
+    options->protocol = PROTOCOL_VERSION;
+    options->messages = NULL;
+    options->message_count = 0;
+    options->batch = NULL;
+    options->inflight = SMC_INFLIGHT_DEFAULT;
+    options->connect_timeout = 0;
+    options->fastopen = 0;
+    options->compress = 0;
+    options->conditional = 0;
 
     struct option long_options[] =
     {
@@ -98,6 +147,14 @@ void smc_parsecommandline(
         {"image", 1, NULL, 'i'},
         {"message", 1, NULL, 'm'},
         {"verbose", 0, NULL, 'v'},
+        {"transfer", 1, NULL, 't'},
+        {"protocol", 1, NULL, 'P'},
+        {"batch", 1, NULL, OPT_BATCH},
+        {"inflight", 1, NULL, OPT_INFLIGHT},
+        {"connect-timeout", 1, NULL, OPT_CONNECT_TIMEOUT},
+        {"fastopen", 0, NULL, OPT_FASTOPEN},
+        {"compress", 0, NULL, OPT_COMPRESS},
+        {"conditional", 0, NULL, OPT_CONDITIONAL},
         {"help", 0, NULL, 'h'},
         {0, 0, 0, 0}
     };
@@ -106,7 +163,7 @@ void smc_parsecommandline(
         (c = getopt_long(
              argc,
              (char ** const) argv,
-             "s:p:u:i:m:hv",
+             "s:p:u:i:m:t:P:hv",
              long_options,
              NULL
              )
@@ -132,13 +189,87 @@ void smc_parsecommandline(
                 break;
 
             case 'm':
-                *message = optarg;
+                /* every -m is a message of its own, *message is the first one */
+                if (options->messages == NULL &&
+                    (options->messages = malloc((size_t) argc * sizeof(*options->messages))) == NULL)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                options->messages[options->message_count++] = optarg;
+                if (*message == NULL)
+                {
+                    *message = optarg;
+                }
                 break;
 
             case 'v':
                 *verbose = TRUE;
                 break;
 
+            case 't':
+                if (strcmp(optarg, "copy") == 0)
+                {
+                    options->transfer = SMC_TRANSFER_COPY;
+                }
+                else if (strcmp(optarg, "splice") == 0)
+                {
+                    options->transfer = SMC_TRANSFER_SPLICE;
+                }
+                else if (strcmp(optarg, "mmap") == 0)
+                {
+                    options->transfer = SMC_TRANSFER_MMAP;
+                }
+                else
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case 'P':
+                if (strcmp(optarg, "1") == 0)
+                {
+                    options->protocol = PROTOCOL_VERSION_TEXT;
+                }
+                else if (strcmp(optarg, "2") == 0)
+                {
+                    options->protocol = PROTOCOL_VERSION;
+                }
+                else
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_BATCH:
+                options->batch = optarg;
+                break;
+
+            case OPT_INFLIGHT:
+                if ((options->inflight = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_FASTOPEN:
+                options->fastopen = 1;
+                break;
+
+            case OPT_COMPRESS:
+                options->compress = 1;
+                break;
+
+            case OPT_CONDITIONAL:
+                options->conditional = 1;
+                break;
+
+            case OPT_CONNECT_TIMEOUT:
+                if ((options->connect_timeout = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
             case 'h':
 	      usagefunc(stdout, argv[0], EXIT_SUCCESS);
                 break;
@@ -150,12 +281,13 @@ void smc_parsecommandline(
         }
     }
 
+    /* a batch brings its own messages, and maybe its own users */
     if (
         (optind != argc) ||
-        (*port == NULL) ||
         (*server == NULL) ||
-        (*user == NULL) ||
-        (*message == NULL)
+        ((*port == NULL) && (strncmp(*server, SMC_UNIX_PREFIX, SMC_UNIX_PREFIX_SIZE) != 0)) ||
+        ((options->batch == NULL) && (*user == NULL)) ||
+        ((options->batch == NULL) == (*message == NULL))
         )
     {
         usagefunc(stderr, argv[0], EXIT_FAILURE);
@@ -30,12 +30,42 @@
 #define TRUE (1==1)
 #define FALSE (!TRUE)
 
+/* requests kept in flight on a keep-alive connection unless --inflight is given */
+#define SMC_INFLIGHT_DEFAULT 32
+
+/* server address of a Unix domain socket on this host: unix:/path */
+#define SMC_UNIX_PREFIX "unix:"
+#define SMC_UNIX_PREFIX_SIZE 5
+
 /*
  * -------------------------------------------------------------- typedefs --
  */
 
 typedef void (* smc_usagefunc_t) (FILE *, const char *, int);
 
+/** how the body of a response file gets from the socket into the file */
+typedef enum
+{
+    SMC_TRANSFER_COPY = 0,  /* read() into a user-space buffer and fwrite() it (default) */
+    SMC_TRANSFER_SPLICE,    /* splice() socket -> pipe -> file without user-space copy */
+    SMC_TRANSFER_MMAP       /* receive into a pre-sized mapping of an O_TMPFILE, then link it */
+} smc_transfer_t;
+
+/** optional client settings filled in by smc_parsecommandline() */
+typedef struct
+{
+    smc_transfer_t transfer;
+    int protocol;           /* PROTOCOL_VERSION (binary, default) or PROTOCOL_VERSION_TEXT */
+    const char **messages;  /* all messages given with -m, in order */
+    int message_count;
+    const char *batch;      /* file of records to submit, "-" for stdin, NULL if not given */
+    int inflight;           /* requests sent ahead of their responses */
+    int fastopen;           /* send the request in the SYN (TCP Fast Open) */
+    int connect_timeout;    /* milliseconds for connecting to any address, 0 for no limit */
+    int compress;           /* ask for compressed response files (protocol 2) */
+    int conditional;        /* send hashes of received files, keep unchanged ones (protocol 2) */
+} smc_options_t;
+
 /*
  * --------------------------------------------------------------- globals --
  */
@@ -59,10 +89,12 @@ typedef void (* smc_usagefunc_t) (FILE *, const char *, int);
  * \param message [OUT] - string containing the message
  * \param img_url [OUT] - string containing the image URL
  * \param verbose [OUT] - int containing info whether output shall be verbose or not
+ * \param options [OUT] - optional settings (defaults if not given)
  *
  * \return Upon successful execution, the function returns and the output parameters
  *         \a port, \a server, \a message, and  \a img_url are filled properly (Note that
- *         img_url might be NULL, since it's optional on the commandline.). - Upon
+ *         img_url might be NULL, since it's optional on the commandline. With --batch,
+ *         \a message is NULL and \a user might be NULL.). - Upon
  *         failure the function prints usage information and terminates the program by
  *         calling \a usagefunc.
  *
@@ -76,7 +108,8 @@ extern void smc_parsecommandline(
     const char **user,
     const char **message,
     const char **img_url,
-    int *verbose
+    int *verbose,
+    smc_options_t *options
     );
 
 /*
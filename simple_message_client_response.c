@@ -0,0 +1,234 @@
+/**
+ * @file simple_message_client_response.c
+ * TCP/IP Server-Client project
+ *
+ * Incremental parser for text (protocol 1) responses:
+ *
+ *     status=<n>\n
+ *     (file=<name>\nlen=<bytes>\n<bytes of the file>)*
+ *
+ * The parser is fed whatever arrived and stops at every status and file
+ * header, so it serves a blocking reader as well as a non-blocking event
+ * loop. Lines are found with memchr() and dispatched on the length and
+ * bytes of their key in one pass; no copy is made of a line that arrived
+ * in one piece. Memory is only allocated while the arenas grow, so a
+ * parser reused for the responses of a connection stops allocating.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_client_response.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int arenaAppend(smc_arena_t *arena, const char *data, size_t len);
+static int parseNumber(const char *cp, size_t len, uint64_t *value);
+static int parseLine(smc_parser_t *parser, const char *line, size_t len);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief feed received bytes to the parser
+ *
+ * Stops after each status line and file header. After PARSER_FILE the
+ * caller either reads the length bytes of the body itself and feeds what
+ * follows them, or calls parserSkipBody() and keeps feeding.
+ *
+ * \param parser - parser of the response
+ * \param data - received bytes
+ * \param len - number of bytes
+ * \param consumed [OUT] - bytes of data taken by the parser
+ *
+ * \return PARSER_MORE, PARSER_STATUS, PARSER_FILE or PARSER_ERROR
+ */
+int parserFeed(smc_parser_t *parser, const char *data, size_t len, size_t *consumed)
+{
+    const char *newline;
+    size_t n, pos = 0;
+    int iResult;
+
+    while (pos < len) {
+
+        /* body bytes the caller does not want */
+        if (parser->skip > 0) {
+            n = len - pos < parser->skip ? len - pos : (size_t) parser->skip;
+            parser->skip -= n;
+            pos += n;
+            continue;
+        }
+
+        if ((newline = memchr(data + pos, '\n', len - pos)) == NULL) {
+            /* keep the start of the line for the next call */
+            if (parser->line.len + (len - pos) > PARSER_LINE_MAX ||
+                arenaAppend(&parser->line, data + pos, len - pos) < 0) {
+                *consumed = pos;
+                return PARSER_ERROR;
+            }
+            pos = len;
+            break;
+        }
+
+        n = (size_t) (newline - (data + pos));
+        if (parser->line.len == 0) {
+            iResult = parseLine(parser, data + pos, n);
+        } else if (parser->line.len + n > PARSER_LINE_MAX || arenaAppend(&parser->line, data + pos, n) < 0) {
+            iResult = PARSER_ERROR;
+        } else {
+            iResult = parseLine(parser, parser->line.data, parser->line.len);
+            parser->line.len = 0;
+        }
+        pos += n + 1;
+
+        if (iResult != PARSER_MORE) {
+            *consumed = pos;
+            return iResult;
+        }
+    }
+
+    *consumed = pos;
+    return PARSER_MORE;
+}
+
+/**
+ * \brief let parserFeed() pass over the body of the current file
+ */
+void parserSkipBody(smc_parser_t *parser)
+{
+    parser->skip = parser->length;
+}
+
+/**
+ * \brief prepare the parser for the next response, keeping its memory
+ */
+void parserReset(smc_parser_t *parser)
+{
+    smc_arena_t line = parser->line, names = parser->names;
+
+    line.len = 0;
+    names.len = 0;
+    memset(parser, 0, sizeof(*parser));
+    parser->line = line;
+    parser->names = names;
+}
+
+/**
+ * \brief release the memory of the parser
+ */
+void parserFree(smc_parser_t *parser)
+{
+    free(parser->line.data);
+    free(parser->names.data);
+    memset(parser, 0, sizeof(*parser));
+}
+
+/**
+ * \brief append to an arena, growing it by doubling
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int arenaAppend(smc_arena_t *arena, const char *data, size_t len)
+{
+    size_t cap = arena->cap > 0 ? arena->cap : 256;
+    char *cp;
+
+    while (cap - arena->len < len) cap *= 2;
+    if (cap != arena->cap) {
+        if ((cp = realloc(arena->data, cap)) == NULL) return -1;
+        arena->data = cp;
+        arena->cap = cap;
+    }
+
+    memcpy(arena->data + arena->len, data, len);
+    arena->len += len;
+    return 0;
+}
+
+/**
+ * \brief decimal number made of all bytes of cp
+ *
+ * \return 0 on success, -1 if not a number or too large
+ */
+static int parseNumber(const char *cp, size_t len, uint64_t *value)
+{
+    uint64_t v = 0;
+    size_t i;
+
+    if (len == 0) return -1;
+
+    for (i = 0; i < len; i++) {
+        if (cp[i] < '0' || cp[i] > '9' || v > (UINT64_MAX - 9) / 10) return -1;
+        v = v * 10 + (uint64_t) (cp[i] - '0');
+    }
+
+    *value = v;
+    return 0;
+}
+
+/**
+ * \brief act on one complete line, without its newline
+ *
+ * Lines with an unknown key are ignored, as the text protocol always did.
+ */
+static int parseLine(smc_parser_t *parser, const char *line, size_t len)
+{
+    const char *equal = memchr(line, '=', len);
+    const char *value;
+    size_t keyLen, valueLen;
+    uint64_t number;
+    int negative;
+
+    if (equal == NULL) return PARSER_MORE;
+    keyLen = (size_t) (equal - line);
+    value = equal + 1;
+    valueLen = len - keyLen - 1;
+
+    switch (keyLen) {
+
+    case 6:
+        if (memcmp(line, "status", 6) != 0 || parser->has_status) break;
+        negative = valueLen > 0 && value[0] == '-';
+        if (parseNumber(value + negative, valueLen - (size_t) negative, &number) < 0 ||
+            number > LONG_MAX) return PARSER_ERROR;
+        parser->status = negative ? -(long) number : (long) number;
+        parser->has_status = 1;
+        return PARSER_STATUS;
+
+    case 4:
+        if (memcmp(line, "file", 4) != 0) break;
+        /* the name is kept until the response ends, the line may not be */
+        parser->name_off = parser->names.len;
+        if (arenaAppend(&parser->names, value, valueLen) < 0 ||
+            arenaAppend(&parser->names, "", 1) < 0) return PARSER_ERROR;
+        parser->has_name = 1;
+        return PARSER_MORE;
+
+    case 3:
+        if (memcmp(line, "len", 3) != 0) break;
+        if (!parser->has_name || parseNumber(value, valueLen, &parser->length) < 0) return PARSER_ERROR;
+        return PARSER_FILE;
+
+    default:
+        break;
+    }
+
+    return PARSER_MORE;
+}
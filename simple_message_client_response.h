@@ -0,0 +1,78 @@
+/**
+ * @file simple_message_client_response.h
+ * TCP/IP Server-Client project
+ *
+ * Incremental parser for text (protocol 1) responses, shared by the
+ * simple_message_client and the simple_message_bench.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_RESPONSE_H
+#define SIMPLE_MESSAGE_CLIENT_RESPONSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+/* results of parserFeed() */
+#define PARSER_MORE 0       /* all input consumed, more is needed */
+#define PARSER_STATUS 1     /* status line parsed, see status */
+#define PARSER_FILE 2       /* file header parsed, see parserName() and length; the body follows */
+#define PARSER_ERROR -1     /* malformed response or out of memory */
+
+/* longest header line accepted, as a bound on what a server can make the client buffer */
+#define PARSER_LINE_MAX (1024 * 1024)
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+/** growable memory, reset instead of freed between responses */
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} smc_arena_t;
+
+/**
+ * A response being parsed. The input may be split anywhere; a line split
+ * over several calls is gathered in line. A zeroed structure is a parser
+ * at the start of a response.
+ */
+typedef struct
+{
+    smc_arena_t line;       /* start of a line whose end has not arrived yet */
+    smc_arena_t names;      /* file names of the response, NUL-terminated */
+    size_t name_off;        /* offset of the current file name in names */
+    int has_name;
+    int has_status;
+    long status;
+    uint64_t length;        /* body length of the current file */
+    uint64_t skip;          /* body bytes parserFeed() still passes over */
+} smc_parser_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+int parserFeed(smc_parser_t *parser, const char *data, size_t len, size_t *consumed);
+void parserSkipBody(smc_parser_t *parser);
+void parserReset(smc_parser_t *parser);
+void parserFree(smc_parser_t *parser);
+
+/* file name of the last PARSER_FILE, valid until the next parserFeed() */
+#define parserName(parser) ((const char *) (parser)->names.data + (parser)->name_off)
+
+#endif
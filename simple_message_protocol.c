@@ -0,0 +1,422 @@
+/**
+ * @file simple_message_protocol.c
+ * TCP/IP Server-Client project
+ *
+ * Encoding and decoding of the binary framing (protocol version 2). The
+ * functions only work on byte arrays; buffering and I/O are left to the
+ * client and the server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_protocol.h"
+#include <string.h>
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static void putUint32(unsigned char *dst, uint32_t value)
+{
+    dst[0] = (unsigned char) (value >> 24);
+    dst[1] = (unsigned char) (value >> 16);
+    dst[2] = (unsigned char) (value >> 8);
+    dst[3] = (unsigned char) value;
+}
+
+static uint32_t getUint32(const unsigned char *src)
+{
+    return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16) | ((uint32_t) src[2] << 8) | (uint32_t) src[3];
+}
+
+static void putUint64(unsigned char *dst, uint64_t value)
+{
+    putUint32(dst, (uint32_t) (value >> 32));
+    putUint32(dst + 4, (uint32_t) value);
+}
+
+static uint64_t getUint64(const unsigned char *src)
+{
+    return ((uint64_t) getUint32(src) << 32) | getUint32(src + 4);
+}
+
+/**
+ * \brief write the preamble announcing the given version
+ *
+ * \param dst - at least PROTOCOL_PREAMBLE_SIZE bytes
+ * \param version - highest version the sender speaks
+ *
+ * \return PROTOCOL_PREAMBLE_SIZE
+ */
+size_t protocolPutPreamble(unsigned char *dst, int version)
+{
+    memcpy(dst, PROTOCOL_MAGIC, PROTOCOL_MAGIC_SIZE);
+    dst[PROTOCOL_MAGIC_SIZE] = (unsigned char) version;
+    return PROTOCOL_PREAMBLE_SIZE;
+}
+
+/**
+ * \brief check for a preamble at the start of a stream
+ *
+ * \param src - first bytes of the stream
+ * \param len - number of bytes available
+ *
+ * \return the announced version, 0 if more bytes are needed to decide,
+ *         -1 if the stream does not start with a preamble (text protocol)
+ */
+int protocolGetPreamble(const unsigned char *src, size_t len)
+{
+    size_t n = len < PROTOCOL_MAGIC_SIZE ? len : PROTOCOL_MAGIC_SIZE;
+
+    if (memcmp(src, PROTOCOL_MAGIC, n) != 0) return -1;
+    if (len < PROTOCOL_PREAMBLE_SIZE) return 0;
+    if (src[PROTOCOL_MAGIC_SIZE] < PROTOCOL_VERSION) return -1;
+
+    return src[PROTOCOL_MAGIC_SIZE];
+}
+
+/**
+ * \brief encode a varint
+ *
+ * \param dst - at least PROTOCOL_VARINT_MAX bytes
+ *
+ * \return number of bytes written
+ */
+size_t protocolPutVarint(unsigned char *dst, uint64_t value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        dst[n++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = (unsigned char) value;
+
+    return n;
+}
+
+/**
+ * \brief decode a varint
+ *
+ * \return number of bytes consumed, 0 if more bytes are needed, -1 if malformed
+ */
+int protocolGetVarint(const unsigned char *src, size_t len, uint64_t *value)
+{
+    uint64_t result = 0;
+    size_t i;
+
+    for (i = 0; i < len && i < PROTOCOL_VARINT_MAX; i++) {
+        result |= (uint64_t) (src[i] & 0x7f) << (7 * i);
+        if ((src[i] & 0x80) == 0) {
+            *value = result;
+            return (int) i + 1;
+        }
+    }
+
+    return i == PROTOCOL_VARINT_MAX ? -1 : 0;
+}
+
+/**
+ * \brief encode a frame header
+ *
+ * \param dst - at least PROTOCOL_HEADER_SIZE bytes
+ */
+void protocolPutHeader(unsigned char *dst, const protocol_header_t *header)
+{
+    dst[0] = header->type;
+    dst[1] = header->flags;
+    dst[2] = 0;
+    dst[3] = 0;
+    putUint32(dst + 4, header->id);
+    putUint32(dst + 8, header->length);
+}
+
+/**
+ * \brief decode a frame header
+ *
+ * \param src - PROTOCOL_HEADER_SIZE bytes
+ */
+void protocolGetHeader(const unsigned char *src, protocol_header_t *header)
+{
+    header->type = src[0];
+    header->flags = src[1];
+    header->id = getUint32(src + 4);
+    header->length = getUint32(src + 8);
+}
+
+/**
+ * \brief number of payload bytes a field with len data bytes takes
+ */
+size_t protocolFieldSize(size_t len)
+{
+    unsigned char varint[PROTOCOL_VARINT_MAX];
+
+    return 1 + protocolPutVarint(varint, len) + len;
+}
+
+/**
+ * \brief encode tag and length of a field, the data follows
+ *
+ * \param dst - at least 1 + PROTOCOL_VARINT_MAX bytes
+ *
+ * \return number of bytes written
+ */
+size_t protocolPutFieldHead(unsigned char *dst, uint8_t tag, size_t len)
+{
+    dst[0] = tag;
+    return 1 + protocolPutVarint(dst + 1, len);
+}
+
+/**
+ * \brief encode a field holding one varint
+ *
+ * \param dst - at least 2 + PROTOCOL_VARINT_MAX bytes
+ *
+ * \return number of bytes written
+ */
+size_t protocolPutVarintField(unsigned char *dst, uint8_t tag, uint64_t value)
+{
+    size_t n = protocolPutVarint(dst + 2, value);
+
+    dst[0] = tag;
+    dst[1] = (unsigned char) n;     /* PROTOCOL_VARINT_MAX fits in one length byte */
+    return 2 + n;
+}
+
+/**
+ * \brief decode the next field of a complete payload
+ *
+ * \param payload - payload of the frame
+ * \param len - length of the payload
+ * \param pos [IN/OUT] - offset of the next field, advanced past it
+ * \param field [OUT] - the field, data points into payload
+ *
+ * \return 1 if a field was decoded, 0 at the end of the payload, -1 if malformed
+ */
+int protocolNextField(const unsigned char *payload, size_t len, size_t *pos, protocol_field_t *field)
+{
+    uint64_t fieldLen;
+    int n;
+
+    if (*pos >= len) return 0;
+
+    n = protocolGetVarint(payload + *pos + 1, len - *pos - 1, &fieldLen);
+    if (n <= 0 || fieldLen > len - *pos - 1 - (size_t) n) return -1;
+
+    field->tag = payload[*pos];
+    field->data = payload + *pos + 1 + n;
+    field->len = (size_t) fieldLen;
+    *pos += 1 + (size_t) n + field->len;
+
+    return 1;
+}
+
+static size_t putField(unsigned char *dst, uint8_t tag, const char *data)
+{
+    size_t len = strlen(data), n;
+
+    n = protocolPutFieldHead(dst, tag, len);
+    memcpy(dst + n, data, len);
+    return n + len;
+}
+
+/**
+ * \brief payload length of a request frame
+ *
+ * \param image - image URL, NULL if none
+ * \param encodings - PROTOCOL_ENCODING_* accepted for the response, 0 for none
+ * \param extraLen - length of further encoded fields
+ */
+size_t protocolRequestLength(const char *user, const char *image, const char *message, unsigned encodings,
+                             size_t extraLen)
+{
+    unsigned char varint[PROTOCOL_VARINT_MAX];
+    size_t len = protocolFieldSize(strlen(user)) + protocolFieldSize(strlen(message)) + extraLen;
+
+    if (image != NULL) len += protocolFieldSize(strlen(image));
+    if (encodings != 0) len += protocolFieldSize(protocolPutVarint(varint, encodings));
+    return len;
+}
+
+/**
+ * \brief encode a complete request frame, without preamble
+ *
+ * \param dst - at least PROTOCOL_HEADER_SIZE + protocolRequestLength() bytes
+ * \param id - request id echoed by the server
+ * \param flags - frame flags
+ * \param image - image URL, NULL if none
+ * \param encodings - PROTOCOL_ENCODING_* accepted for the response, 0 for none
+ * \param extra - further encoded fields (e.g. known files) appended as they are, NULL if none
+ * \param extraLen - length of extra
+ *
+ * \return number of bytes written
+ */
+size_t protocolPutRequest(unsigned char *dst, uint32_t id, uint8_t flags,
+                          const char *user, const char *image, const char *message, unsigned encodings,
+                          const unsigned char *extra, size_t extraLen)
+{
+    protocol_header_t header;
+    size_t pos = PROTOCOL_HEADER_SIZE;
+
+    header.type = PROTOCOL_FRAME_REQUEST;
+    header.flags = flags;
+    header.id = id;
+    header.length = (uint32_t) protocolRequestLength(user, image, message, encodings, extraLen);
+    protocolPutHeader(dst, &header);
+
+    pos += putField(dst + pos, PROTOCOL_FIELD_USER, user);
+    if (image != NULL) pos += putField(dst + pos, PROTOCOL_FIELD_IMAGE, image);
+    pos += putField(dst + pos, PROTOCOL_FIELD_MESSAGE, message);
+    if (encodings != 0) pos += protocolPutVarintField(dst + pos, PROTOCOL_FIELD_ACCEPT_ENCODING, encodings);
+    if (extraLen > 0) {
+        memcpy(dst + pos, extra, extraLen);
+        pos += extraLen;
+    }
+
+    return pos;
+}
+
+/**
+ * \brief number of payload bytes a known file field takes
+ */
+size_t protocolKnownFileSize(const char *name)
+{
+    return protocolFieldSize(PROTOCOL_KNOWN_HASH_SIZE + strlen(name));
+}
+
+/**
+ * \brief encode a known file field
+ *
+ * \param dst - at least protocolKnownFileSize() bytes
+ * \param hash - protocolHash() of the content the client holds
+ * \param name - file name as sent by the server
+ *
+ * \return number of bytes written
+ */
+size_t protocolPutKnownFile(unsigned char *dst, uint64_t hash, const char *name)
+{
+    size_t len = strlen(name), n;
+
+    n = protocolPutFieldHead(dst, PROTOCOL_FIELD_KNOWN_FILE, PROTOCOL_KNOWN_HASH_SIZE + len);
+    putUint64(dst + n, hash);
+    memcpy(dst + n + PROTOCOL_KNOWN_HASH_SIZE, name, len);
+    return n + PROTOCOL_KNOWN_HASH_SIZE + len;
+}
+
+/**
+ * \brief decode a known file field
+ *
+ * \return 0 on success, -1 if malformed
+ */
+int protocolGetKnownFile(const protocol_field_t *field, uint64_t *hash, const unsigned char **name, size_t *nameLen)
+{
+    if (field->len < PROTOCOL_KNOWN_HASH_SIZE) return -1;
+
+    *hash = getUint64(field->data);
+    *name = field->data + PROTOCOL_KNOWN_HASH_SIZE;
+    *nameLen = field->len - PROTOCOL_KNOWN_HASH_SIZE;
+    return 0;
+}
+
+/*
+ * XXH64 (seed 0) - fast, non-cryptographic, and the same on both sides
+ */
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint32_t readLe32(const unsigned char *src)
+{
+    return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static uint64_t readLe64(const unsigned char *src)
+{
+    return (uint64_t) readLe32(src) | ((uint64_t) readLe32(src + 4) << 32);
+}
+
+static uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    return rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static uint64_t xxhMerge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxhRound(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * \brief XXH64 hash of a byte array, as exchanged in known file fields
+ */
+uint64_t protocolHash(const void *data, size_t len)
+{
+    const unsigned char *p = data, *end = p + len;
+    uint64_t v1, v2, v3, v4, h;
+
+    if (len >= 32) {
+        v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+        v2 = XXH_PRIME64_2;
+        v3 = 0;
+        v4 = -XXH_PRIME64_1;
+        do {
+            v1 = xxhRound(v1, readLe64(p));
+            v2 = xxhRound(v2, readLe64(p + 8));
+            v3 = xxhRound(v3, readLe64(p + 16));
+            v4 = xxhRound(v4, readLe64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    } else {
+        h = XXH_PRIME64_5;
+    }
+
+    h += (uint64_t) len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxhRound(0, readLe64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) readLe32(p) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (uint64_t) *p * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
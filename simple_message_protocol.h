@@ -0,0 +1,154 @@
+/**
+ * @file simple_message_protocol.h
+ * TCP/IP Server-Client project
+ *
+ * Binary framing (protocol version 2) shared by the simple_message_client
+ * and the simple_message_server.
+ *
+ * Each side starts its direction of the connection with a preamble of the
+ * magic "SMP" and the highest version it speaks. A text (version 1) request
+ * starts with "user=" and a text response with "status=", so the first byte
+ * tells both formats apart. The preamble is followed by frames:
+ *
+ *     type (1) | flags (1) | reserved (2) | id (4) | payload length (4)
+ *     field*: tag (1) | varint length | data
+ *
+ * All fixed-size integers are big endian, varints are LEB128. Fields with
+ * unknown tags are skipped, so new fields do not break older peers.
+ *
+ * A request flagged keep-alive leaves the connection open for further
+ * request frames, which may be sent without waiting for the responses.
+ * The responses come back in request order and carry the id of their
+ * request. Only the first frame of each direction has a preamble.
+ *
+ * A request may list the encodings the client can decode. The server then
+ * may send file data encoded, announced by an encoding and the original
+ * size of the file in front of the data.
+ *
+ * A request may also name files the client holds, with the XXH64 hash of
+ * their content. A file whose content the client holds already is answered
+ * with a file-unchanged field instead of its data.
+ *
+ * A file the server sends with a version (the builtin board page) may be
+ * answered with a patch against the version the client reports holding:
+ * bytes to insert at an offset of the client's copy.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_PROTOCOL_H
+#define SIMPLE_MESSAGE_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define PROTOCOL_MAGIC "SMP"
+#define PROTOCOL_MAGIC_SIZE 3
+#define PROTOCOL_VERSION_TEXT 1
+#define PROTOCOL_VERSION 2
+#define PROTOCOL_PREAMBLE_SIZE (PROTOCOL_MAGIC_SIZE + 1)
+#define PROTOCOL_HEADER_SIZE 12
+/* longest encoding of a 64 bit varint */
+#define PROTOCOL_VARINT_MAX 10
+
+/* frame flags */
+#define PROTOCOL_FLAG_KEEP_ALIVE 0x01
+
+/* frame types */
+#define PROTOCOL_FRAME_REQUEST 1
+#define PROTOCOL_FRAME_RESPONSE 2
+
+/* request fields */
+#define PROTOCOL_FIELD_USER 1
+#define PROTOCOL_FIELD_IMAGE 2
+#define PROTOCOL_FIELD_MESSAGE 3
+/* varint, bit set of the PROTOCOL_ENCODING_* the client can decode */
+#define PROTOCOL_FIELD_ACCEPT_ENCODING 4
+/* hash (8, XXH64 of the content) | name of a file the client holds, repeatable */
+#define PROTOCOL_FIELD_KNOWN_FILE 5
+#define PROTOCOL_KNOWN_HASH_SIZE 8
+/* varint, version of the preceding known file */
+#define PROTOCOL_FIELD_KNOWN_VERSION 6
+
+/* status of a response sent without running the logic because the server is overloaded */
+#define PROTOCOL_STATUS_BUSY 2
+
+/* response fields: a status, then name/data pairs for each file */
+#define PROTOCOL_FIELD_STATUS 16
+#define PROTOCOL_FIELD_FILE_NAME 17
+#define PROTOCOL_FIELD_FILE_DATA 18
+/* varints in front of an encoded FILE_DATA: its PROTOCOL_ENCODING_* and original size */
+#define PROTOCOL_FIELD_FILE_ENCODING 19
+#define PROTOCOL_FIELD_FILE_SIZE 20
+/* empty, in place of FILE_DATA: the client holds the content already */
+#define PROTOCOL_FIELD_FILE_UNCHANGED 21
+/* varint in front of FILE_DATA or FILE_PATCH: version of the file */
+#define PROTOCOL_FIELD_FILE_VERSION 22
+/* varint offset | bytes, in place of FILE_DATA: insert the bytes into the client's copy */
+#define PROTOCOL_FIELD_FILE_PATCH 23
+
+/* encodings of file data */
+#define PROTOCOL_ENCODING_DEFLATE 0x01  /* zlib stream (RFC 1950) */
+
+/* encodings this build can produce and decode */
+#ifdef HAVE_ZLIB
+#define PROTOCOL_ENCODINGS_SUPPORTED PROTOCOL_ENCODING_DEFLATE
+#else
+#define PROTOCOL_ENCODINGS_SUPPORTED 0
+#endif
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    uint8_t type;
+    uint8_t flags;
+    uint32_t id;
+    uint32_t length;        /* payload bytes following the header */
+} protocol_header_t;
+
+typedef struct
+{
+    uint8_t tag;
+    const unsigned char *data;
+    size_t len;
+} protocol_field_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+size_t protocolPutPreamble(unsigned char *dst, int version);
+int protocolGetPreamble(const unsigned char *src, size_t len);
+size_t protocolPutVarint(unsigned char *dst, uint64_t value);
+int protocolGetVarint(const unsigned char *src, size_t len, uint64_t *value);
+void protocolPutHeader(unsigned char *dst, const protocol_header_t *header);
+void protocolGetHeader(const unsigned char *src, protocol_header_t *header);
+size_t protocolFieldSize(size_t len);
+size_t protocolPutFieldHead(unsigned char *dst, uint8_t tag, size_t len);
+size_t protocolPutVarintField(unsigned char *dst, uint8_t tag, uint64_t value);
+int protocolNextField(const unsigned char *payload, size_t len, size_t *pos, protocol_field_t *field);
+size_t protocolRequestLength(const char *user, const char *image, const char *message, unsigned encodings,
+                             size_t extraLen);
+size_t protocolPutRequest(unsigned char *dst, uint32_t id, uint8_t flags,
+                          const char *user, const char *image, const char *message, unsigned encodings,
+                          const unsigned char *extra, size_t extraLen);
+size_t protocolKnownFileSize(const char *name);
+size_t protocolPutKnownFile(unsigned char *dst, uint64_t hash, const char *name);
+int protocolGetKnownFile(const protocol_field_t *field, uint64_t *hash, const unsigned char **name, size_t *nameLen);
+uint64_t protocolHash(const void *data, size_t len);
+
+#endif
@@ -21,13 +21,33 @@
 /**
  * -------------------------------------------------------------- includes --
  */
+#define _GNU_SOURCE
 #include "simple_message_server_commandline_handling.h"
+#include "simple_message_server.h"
+#include "simple_message_server_epoll.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_loader.h"
+#include "simple_message_server_logic.h"
+#include "simple_message_server_prefork.h"
+#include "simple_message_server_shards.h"
+#include "simple_message_server_stats.h"
+#include "simple_message_server_store.h"
+#include "simple_message_server_uring.h"
+#include "simple_message_server_workers.h"
+#include "simple_message_protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/types.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -35,18 +55,22 @@
  * -------------------------------------------------------------- defines --
  */
 
-#define BACKLOG 6
+/* bursts of connections queue in the kernel until an engine accepts them; net.core.somaxconn caps it */
+#define BACKLOG SOMAXCONN
 
 /**
  * -------------------------------------------------------------- global variables --
  */
 const char *cpPort, *cpFilename;
 int save_errno;
+smc_options_t options;
 
 /**
  * --------------------------------------------------- function prototypes --
  */
 void usage(FILE * stream, const char * message, int exitcode);
+static int reapChildren(int sigfd);
+static int countWorkers(void);
 
 
 /**
@@ -59,11 +83,14 @@ int main(int argc, const char* argv[])
     
     save_errno = 0; //*value for saving errno bevor it will be overritten*/
     
-    int sfd, cfd;
+    int sfd, ufd, lfd, cfd, sigfd, iLive = 0;
+    char first;
     pid_t childpid;
-    
-    int optval; /* flag value for setsockopt */
-    struct sockaddr_in peer_addr; /* server's addr */
+    uint64_t forkStart;
+    sigset_t sigchld, oldmask;
+    struct pollfd pfds[3];
+    int *ipQueue = NULL;    /* connections waiting for admission, a ring */
+    int iQueueCap = 0, iQueueHead = 0, iQueueLen = 0, i;
     
     struct sockaddr_in clientaddr; /* client addr */
     socklen_t clientlen; /* byte size of client's address */
@@ -75,162 +102,176 @@ int main(int argc, const char* argv[])
     
     
 	/* function to parse parameter provided by Thomas M. Galla, Christian Fibich*/
-	smc_parsecommandline(argc, argv, &usage, &cpPort);
-    
+	smc_parsecommandline(argc, argv, &usage, &cpPort, &options);
     
     
     /*
-     * socket: create the parent socket
+     * metrics: the table must exist before any worker, the stats thread before the engine
      */
+    statsInit(countWorkers());
+    statsServe(options.stats_socket, options.stats_port);
     
-	//socket
-	sfd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sfd == -1) {
-	  
-        //RESET save_errno
-        save_errno = 0;
-        
-        //MAIN ERROR MESSAGE
-        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket()", "Could not create socket") < 0) save_errno= errno;
-        
-        
-        //EXIT LOGIC
-        if (save_errno != 0) exit (save_errno); //Wenn save_errno ungleich 0, dann exit mit save_errno -> andernfalls mit normalen exit fehler
-        exit(1);
-
-
-	}		   
-	
-    
-    /* setsockopt:
-     * retun to the server immediately after we kill it -> otherwise -> wait about 20 secs.
-     * Eliminates "ERROR on binding: Address already in use" error.
-     */
-    optval = 1;
-    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR,(const void *)&optval , sizeof(int));
-
     
     /*
-     * build the server's Internet address
+     * handler plugin: loaded once, every engine and forked process shares it
      */
-    bzero((char *) &peer_addr, sizeof(peer_addr)); //write zeroes to a byte string
+    if (options.logic == SMS_LOGIC_PLUGIN) {
+        loaderOpen(options.handler_path, options.handler_arg);
+    }
     
-    /* this is an Internet address */
-    peer_addr.sin_family = AF_INET;
     
-    /* let the system figure out our IP address */
-    peer_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    /*
+     * built-in logic: the page hashes are shared, the message store is
+     * recovered once before any process or thread appends to it
+     */
+    if (options.logic == SMS_LOGIC_BUILTIN) {
+        logicInit();
+        if (options.store_path != NULL) storeOpen(options.store_path);
+    }
     
-    //Convert char Array into INT
-    int int_cpPort = atoi( cpPort );
     
-    /* this is the port we will listen on */
-    peer_addr.sin_port = htons((unsigned short)int_cpPort);
-
+    /*
+     * thread-per-core shards: every shard opens its own listener
+     */
+    if (options.engine == SMS_ENGINE_SHARDS) {
+        runShardEngine(&options);
+    }
     
+    sfd = openListener(0);
+    ufd = openUnixListener();
     
     
     /*
-     * bind: associate the parent socket with a port
+     * pre-forked pool: workers accept on the listening socket themselves
      */
-    
-    // bind
-    if (bind(sfd, (struct sockaddr *) &peer_addr, sizeof(peer_addr)) < 0) {
-        
-        //RESET save_errno
-        save_errno = 0;
-        
-        //MAIN ERROR MESSAGE
-        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),bind()", "Could not bind socket") < 0) save_errno= errno;
-        
-        
-        //CLOSE PARENT SOCKET
-        if (close(sfd) < 0 ) {
-            if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),bind()-close()", "Could not bind socket and could not close socket") < 0) save_errno= errno;
-        }
-        
-        //EXIT LOGIC
-        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
-        exit(1);
-        
+    if (options.engine == SMS_ENGINE_PREFORK) {
+        runPreforkEngine(sfd, ufd, &options);
     }
-    
-    
+
+    /*
+     * logic workers: the parent accepts and hands the connections to them
+     */
+    if (options.engine == SMS_ENGINE_WORKERS) {
+        runWorkerEngine(sfd, ufd, &options);
+    }
+
+    /*
+     * event loop: one process serves all connections
+     */
+    if (options.engine == SMS_ENGINE_EPOLL) {
+        runEpollEngine(sfd, ufd, &options);
+    }
+
+    /*
+     * io_uring: only returns if io_uring is not available -> fork engine below
+     */
+    if (options.engine == SMS_ENGINE_URING) {
+        runUringEngine(sfd, ufd, &options);
+    }
+
     
     /*
-     * listen: make this socket ready to accept connection requests
+     * main loop: wait for a connection request
+     *
      */
 
-    /*CHECK IF BACKLOG IS BIGGER THAN SOMAXCONN -> IF SO, THAN EXIT -> IS NOT ALLOWED*/
-    if (BACKLOG > SOMAXCONN) {
     
+    /*
+     * supervisor: finished children are reported through a signalfd polled
+     * together with the listener, so the number of live handlers is exact
+     */
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &sigchld, &oldmask) < 0 ||
+        (sigfd = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+        fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) | O_NONBLOCK) < 0 ||
+        (ufd >= 0 && fcntl(ufd, F_SETFL, fcntl(ufd, F_GETFL) | O_NONBLOCK) < 0)) {
+        
         //RESET save_errno
         save_errno = 0;
         
-        //MAIN ERROR MESSAGE
-        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),BACKLOG_CHECK", "BACKLOG Value BACKLOG is bigger than allowed (SOMAXCONN)") < 0) save_errno= errno;
-        
-        //CLOSE PARENT SOCKET
-        if (close(sfd) < 0 ) {
-            if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),BACKLOG_CHECK-close()", "BACKLOG VALULE is bigger than allowed and could not close socket") < 0) save_errno= errno;
-        }
-      
-        //EXIT LOGIC
-        if (save_errno != 0) exit (save_errno); //Wenn save_errno ungleich 0, dann exit mit save_errno -> andernfalls mit normalen exit fehler
-        exit(1);
+        printError("PARENT-signalfd()", "Could not set up child supervision");
+        exitOnError();
+    }
     
+    /* over the limit, up to max_clients further connections wait for a free handler */
+    if (options.max_clients > 0 && options.overload == SMS_OVERLOAD_QUEUE) {
+        iQueueCap = options.max_clients;
+        if ((ipQueue = calloc((size_t) iQueueCap, sizeof(*ipQueue))) == NULL) {
+            
+            //RESET save_errno
+            save_errno = 0;
+            
+            printError("PARENT-calloc()", "Could not allocate connection queue");
+            exitOnError();
+        }
     }
     
+    lfd = sfd;
+    pfds[0].fd = sfd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = sigfd;
+    pfds[1].events = POLLIN;
+    pfds[2].fd = ufd;       /* ignored by poll() without --unix */
+    pfds[2].events = POLLIN;
     
-	// listen
-    if (listen(sfd,BACKLOG)==-1) {
-        
-        //RESET save_errno
-        save_errno = 0;
+	// WHILE LOOP - START
+	while (1) {
+		
         
-        //MAIN ERROR MESSAGE
-        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),listen()", "Could not start listener") < 0) save_errno= errno;
+        /*
+         * admission: a queued connection is served as soon as a handler is free
+         */
+        if (iQueueLen > 0 && iLive < options.max_clients) {
+            cfd = ipQueue[iQueueHead];
+            iQueueHead = (iQueueHead + 1) % iQueueCap;
+            iQueueLen--;
+            statsQueued(-1);
+            goto dispatch;
+        }
         
         
-        //CLOSE PARENT SOCKET
-        if (close(sfd) < 0 ) {
-            if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),listen()-close()", "Could not start listener and could not close socket") < 0) save_errno= errno;
+        /*
+         * poll: wait for a connection request or a finished child
+         */
+        if (poll(pfds, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            
+            //RESET save_errno
+            save_errno = 0;
+            
+            printError("PARENT-poll()", "Could not wait for connections");
+            exitOnError();
         }
         
-        //EXIT LOGIC
-        if (save_errno != 0) exit (save_errno); //Wenn save_errno ungleich 0, dann exit mit save_errno -> andernfalls mit normalen exit fehler
-        exit(1);
+        if (pfds[1].revents & POLLIN) iLive -= reapChildren(sigfd);
+        
+        /* both listeners ready: take turns, so neither starves the other */
+        if ((pfds[2].revents & POLLIN) && (lfd == sfd || !(pfds[0].revents & POLLIN))) lfd = ufd;
+        else if (pfds[0].revents & POLLIN) lfd = sfd;
+        else continue;
         
-	}       
-
-    
-    
-    /*
-     * main loop: wait for a connection request
-     *
-     */
-
-    
-    clientlen = sizeof(struct sockaddr_in);
-    
-	// WHILE LOOP - START
-	while (1) {
-		
         
         /*
-         * accept: wait for a connection request
+         * accept: take the connection request
          */
         
         //reset errno
         errno = 0;
         
-        cfd = accept(sfd, (struct sockaddr *) &clientaddr, &clientlen);
+        clientlen = sizeof(clientaddr);
+        cfd = accept4(lfd, (struct sockaddr *) &clientaddr, &clientlen, SOCK_CLOEXEC); /* no other connection leaks into a spawned logic */
         
         if (cfd < 0) {
             if(errno == EWOULDBLOCK || errno == EAGAIN) { /*The socket is marked nonblocking and no connections 
                                                            are present to be accepted. */
+                statsEagain();
                 continue; //try again
             
+            } else if (errno == EINTR || errno == ECONNABORTED) {
+                if (errno == ECONNABORTED) statsAcceptError(errno);
+                continue; //interrupted or gone before accepted - try again
+            
             } else {
                 
                 
@@ -251,23 +292,85 @@ int main(int argc, const char* argv[])
                 
             }
         }       
+        statsAccept();
+        
+        
+        /*
+         * overload: wait in the queue while there is room, otherwise get a busy reply
+         */
+        if (options.max_clients > 0 && iLive >= options.max_clients) {
+            if (iQueueLen < iQueueCap) {
+                ipQueue[(iQueueHead + iQueueLen) % iQueueCap] = cfd;
+                iQueueLen++;
+                statsQueued(1);
+            } else {
+                rejectBusy(cfd);
+            }
+            continue;
+        }
 
         
+dispatch:
+        /*
+         * external logic and a text request that has arrived: spawn the logic
+         * right on the socket - no copy of the server is forked for it
+         */
+        if (options.logic == SMS_LOGIC_EXEC &&
+            recv(cfd, &first, 1, MSG_PEEK | MSG_DONTWAIT) == 1 && first != PROTOCOL_MAGIC[0]) {
+            
+            limitLogicSocket(cfd);
+            
+            forkStart = statsNow();
+            childpid = spawnLogic(cfd, cfd);
+            statsSpawn(forkStart);
+            
+            if (childpid < (pid_t) 0) {
+                
+                //RESET save_errno
+                save_errno = 0;
+                
+                printError("PARENT-posix_spawn()", "Could not start simple_message_server_logic");
+                
+                //answer busy and close the socket - as if fork() had failed
+                rejectBusy(cfd);
+                continue;
+            }
+            
+            iLive++;
+            statsActive(1);
+            
+            //CLOSE CHILD SOCKET
+            if (close(cfd) < 0 ) {
+                printError("PARENT-posix_spawn()-close()", "Could not close CHILD socket");
+            }
+            continue;
+        }
+        
         //reset errno
         errno = 0;
         
 		// fork
+		forkStart = statsNow();
 		childpid = fork();
+		if (childpid != (pid_t) 0) statsSpawn(forkStart);
         
         
         // IF FORK FAILED
-        if (errno == EAGAIN) { /*The system-imposed limit on the total number
+        if (childpid < (pid_t) 0 && errno == EAGAIN) { /*The system-imposed limit on the total number
                                      of processes under execution would be exceeded..
-                                     --> TRY AGAIN -> MAYBE NEXT LOOP IS BETTER*/
+                                     --> DROP THIS CONNECTION -> MAYBE NEXT LOOP IS BETTER*/
+            
+            //RESET save_errno
+            save_errno = 0;
+            
+            printError("PARENT-fork()", "Process limit reached - rejecting connection");
+            
+            //answer busy and close the socket - the next finished child frees a process
+            rejectBusy(cfd);
             continue;
         }
         
-        if (errno == ENOMEM){ //ENOMEM: There is insufficient swap space for the new process
+        if (childpid < (pid_t) 0 && errno == ENOMEM){ //ENOMEM: There is insufficient swap space for the new process
             
             //RESET save_errno
             save_errno = 0;
@@ -296,6 +399,14 @@ int main(int argc, const char* argv[])
 			
             //RESET save_errno
             save_errno = 0;
+            
+            //the child neither supervises nor owns the queued connections
+            if (sigprocmask(SIG_SETMASK, &oldmask, NULL) < 0 || close(sigfd) < 0) {
+                printError("CHILD-sigprocmask()", "Could not restore signal mask");
+                exitOnError();
+            }
+            for (i = 0; i < iQueueLen; i++) close(ipQueue[(iQueueHead + i) % iQueueCap]);
+            if (ufd >= 0) close(ufd);
 
             
             //CLOSE PARENT SOCKET
@@ -308,79 +419,21 @@ int main(int argc, const char* argv[])
             }
             
             
-            if((dup2(cfd, 0) == -1)) {
-                
-                //RESET save_errno
-                save_errno = 0;
-
-                //MAIN ERROR MESSAGE
-                if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-dup2()", "Could not read -dup2") < 0) save_errno= errno;
-
-                //CLOSE CHILD SOCKET
-                if (close(cfd) < 0 ) {
-                    if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-dup2()-close()", "Could not read -dup2 and could not close socket") < 0) save_errno= errno;
-                }
-    
-                //EXIT LOGIC
-                if (save_errno != 0) exit (save_errno);
-                exit(1);
-                
-                
-            }
-            
-            if((dup2(cfd, 1) == -1)) {
-                
-                //RESET save_errno
-                save_errno = 0;
-                
-                //MAIN ERROR MESSAGE
-                if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-dup2()", "Could not write -dup2") < 0) save_errno= errno;
-                
-                //CLOSE CHILD SOCKET
-                if (close(cfd) < 0 ) {
-                    if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-dup2()-close()", "Could not write -dup2 and could not close socket") < 0) save_errno= errno;
-                }
-                
-                //EXIT LOGIC
-                if (save_errno != 0) exit (save_errno);
-                exit(1);
-            
-            }
-
-            //when everything is ok -> exec server logic
-           
-            //RESET save_errno
-            save_errno = 0;
-            
-            //CLOSE CHILD SOCKET
-            if (close(cfd) < 0 ) {
-                if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-fork()-close()", "Could not close CHILD socket") < 0) save_errno= errno;
-                
-                //EXIT LOGIC
-                if (save_errno != 0) exit (save_errno);
-                exit(1);
-            }
-
-            
-            if( execl("/usr/local/bin/simple_message_server_logic", "simple_message_server_logic", (char*) NULL)< 0) {
-                //RESET save_errno
-                save_errno = 0;
-
-                if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "CHILD-fork()-simple_message_server_logic()", "Could not START simple_message_server_logic properly") < 0) save_errno= errno;
-                
-                //EXIT LOGIC
-                if (save_errno != 0) exit (save_errno);
-                exit(1);
-                
+            //in-process logic (built-in or handler plugin): serve the connection right here
+            if (options.logic != SMS_LOGIC_EXEC) {
+                exit(serveConnection(cfd) == 0 ? 0 : 1);
             }
             
-            exit(1);
-            
+            //hand the connection over to the server logic -> does not return
+            execLogicOnConnection(cfd);
             
 		}
 		// PARENT process after fork
 		else if (childpid > (pid_t) 0) {
 			
+            iLive++;
+            statsActive(1);
+            
             //close child socket because parent is in the house
             
             //RESET save_errno
@@ -409,6 +462,287 @@ int main(int argc, const char* argv[])
 
 
 
+/**
+ * \brief reap all finished connection children
+ *
+ * Pending SIGCHLD are merged, so one signal may stand for several children.
+ *
+ * \param sigfd - signalfd for SIGCHLD
+ *
+ * \return number of children reaped
+ */
+static int reapChildren(int sigfd)
+{
+    struct signalfd_siginfo info;
+    int iReaped = 0;
+
+    while (read(sigfd, &info, sizeof(info)) == (ssize_t) sizeof(info));
+
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+        iReaped++;
+        statsActive(-1);
+    }
+
+    return iReaped;
+}
+
+/**
+ * \brief number of workers which count into stats slots of their own
+ */
+static int countWorkers(void)
+{
+    int iWorkers = 0;
+
+    if (options.engine == SMS_ENGINE_PREFORK) {
+        iWorkers = options.prefork_max;
+    } else if (options.engine == SMS_ENGINE_WORKERS) {
+        iWorkers = options.workers;
+    } else if (options.engine == SMS_ENGINE_SHARDS) {
+        iWorkers = options.shards;
+        if (iWorkers == 0) iWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    return iWorkers > 0 ? iWorkers : 0;
+}
+
+
+
+/**
+ * \brief create the listening socket on cpPort - exits the server on failure
+ *
+ * \param iReusePort - non-zero to allow several listeners on the port (SO_REUSEPORT)
+ *
+ * \return the listening socket
+ */
+int openListener(int iReusePort)
+{
+    int sfd;
+    
+    int optval; /* flag value for setsockopt */
+    struct sockaddr_in peer_addr; /* server's addr */
+    
+    
+    /*
+     * socket: create the parent socket
+     */
+    
+	//socket
+	sfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sfd == -1) {
+	  
+        //RESET save_errno
+        save_errno = 0;
+        
+        //MAIN ERROR MESSAGE
+        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket()", "Could not create socket") < 0) save_errno= errno;
+        
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //Wenn save_errno ungleich 0, dann exit mit save_errno -> andernfalls mit normalen exit fehler
+        exit(1);
+
+
+	}		   
+	
+    
+    /* setsockopt:
+     * retun to the server immediately after we kill it -> otherwise -> wait about 20 secs.
+     * Eliminates "ERROR on binding: Address already in use" error.
+     */
+    optval = 1;
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR,(const void *)&optval , sizeof(int));
+
+    /* SO_REUSEPORT: several listeners share the port, the kernel balances connections between them */
+    if (iReusePort && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (const void *)&optval, sizeof(int)) < 0) {
+        
+        //RESET save_errno
+        save_errno = 0;
+        
+        printError("socket(),setsockopt()", "Could not set SO_REUSEPORT");
+        
+        //CLOSE PARENT SOCKET
+        if (close(sfd) < 0 ) {
+            printError("socket(),setsockopt()-close()", "Could not set SO_REUSEPORT and could not close socket");
+        }
+        
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    
+    /*
+     * TCP Fast Open: a returning client sends its request in the SYN.
+     * TCP_DEFER_ACCEPT: accept() only returns once the request has arrived.
+     * Both are optimizations only - without them the server works as before.
+     */
+    if (options.fastopen > 0 &&
+        setsockopt(sfd, IPPROTO_TCP, TCP_FASTOPEN, (const void *)&options.fastopen, sizeof(int)) < 0) {
+        printError("socket(),setsockopt()", "TCP_FASTOPEN not available - continuing without");
+    }
+    if (options.defer_accept > 0 &&
+        setsockopt(sfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, (const void *)&options.defer_accept, sizeof(int)) < 0) {
+        printError("socket(),setsockopt()", "TCP_DEFER_ACCEPT not available - continuing without");
+    }
+
+    
+    /*
+     * build the server's Internet address
+     */
+    bzero((char *) &peer_addr, sizeof(peer_addr)); //write zeroes to a byte string
+    
+    /* this is an Internet address */
+    peer_addr.sin_family = AF_INET;
+    
+    /* let the system figure out our IP address */
+    peer_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    
+    //Convert char Array into INT
+    int int_cpPort = atoi( cpPort );
+    
+    /* this is the port we will listen on */
+    peer_addr.sin_port = htons((unsigned short)int_cpPort);
+
+    
+    
+    
+    /*
+     * bind: associate the parent socket with a port
+     */
+    
+    // bind
+    if (bind(sfd, (struct sockaddr *) &peer_addr, sizeof(peer_addr)) < 0) {
+        
+        //RESET save_errno
+        save_errno = 0;
+        
+        //MAIN ERROR MESSAGE
+        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),bind()", "Could not bind socket") < 0) save_errno= errno;
+        
+        
+        //CLOSE PARENT SOCKET
+        if (close(sfd) < 0 ) {
+            if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),bind()-close()", "Could not bind socket and could not close socket") < 0) save_errno= errno;
+        }
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+        exit(1);
+        
+    }
+    
+    
+    
+    /*
+     * listen: make this socket ready to accept connection requests
+     */
+
+	// listen
+    if (listen(sfd,BACKLOG)==-1) {
+        
+        //RESET save_errno
+        save_errno = 0;
+        
+        //MAIN ERROR MESSAGE
+        if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),listen()", "Could not start listener") < 0) save_errno= errno;
+        
+        
+        //CLOSE PARENT SOCKET
+        if (close(sfd) < 0 ) {
+            if(fprintf(stderr,"%s - %s: %s\n", cpFilename, "socket(),listen()-close()", "Could not start listener and could not close socket") < 0) save_errno= errno;
+        }
+        
+        //EXIT LOGIC
+        if (save_errno != 0) exit (save_errno); //Wenn save_errno ungleich 0, dann exit mit save_errno -> andernfalls mit normalen exit fehler
+        exit(1);
+        
+	}
+    
+    return sfd;
+}
+
+
+
+/**
+ * \brief create the Unix domain listening socket of --unix - exits the server on failure
+ *
+ * Co-located clients skip the TCP/IP stack. Requests and responses are the
+ * same as over TCP, so every engine serves both listeners alike. A stale
+ * socket file of an earlier run is replaced.
+ *
+ * \return the listening socket, -1 if no Unix domain socket was requested
+ */
+int openUnixListener(void)
+{
+    struct sockaddr_un addr;
+    int ufd;
+
+    if (options.unix_path == NULL) return -1;
+
+    if (strlen(options.unix_path) >= sizeof(addr.sun_path)) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("socket(AF_UNIX)", "Socket path too long");
+        exitOnError();
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, options.unix_path);
+
+    if ((ufd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("socket(AF_UNIX)", "Could not create socket");
+        exitOnError();
+    }
+
+    (void) unlink(options.unix_path);
+    if (bind(ufd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(ufd, BACKLOG) < 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("socket(AF_UNIX),bind()", "Could not bind socket");
+
+        //CLOSE PARENT SOCKET
+        if (close(ufd) < 0 ) {
+            printError("socket(AF_UNIX),bind()-close()", "Could not bind socket and could not close socket");
+        }
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    return ufd;
+}
+
+
+
+/**
+ * \brief print an error message of the server in the common format
+ *
+ * If printing fails, save_errno is set to the errno of the failed fprintf().
+ *
+ * \param cpWhere - function(s) in which the error occured
+ * \param cpMessage - error message
+ */
+void printError(const char *cpWhere, const char *cpMessage)
+{
+    if (fprintf(stderr,"%s - %s: %s\n", cpFilename, cpWhere, cpMessage) < 0) save_errno = errno;
+}
+
+/**
+ * \brief terminate the server after an error
+ *
+ * If save_errno is not 0, than exit with save_errno -> otherwise exit with normal failure
+ */
+void exitOnError(void)
+{
+    if (save_errno != 0) exit (save_errno);
+    exit(1);
+}
+
 /**
  * \brief function needed as error message in smc_parsecommandline
  *
@@ -424,6 +758,32 @@ void usage(FILE * stream, const char * message, int errcode)
             "\n usage: %s options\n"
             "options:\n"
             "        -p, --port <port>       port of the server [0 to 65535]\n"
+            "        -e, --engine <engine>   fork (default), epoll or io_uring\n"
+            "        -l, --logic <logic>     builtin (default) or exec (" LOGIC_PATH ")\n"
+            "        -b, --board <file>      board file of the builtin logic [default: simple_message_board.txt]\n"
+            "        --store <dir>           keep the posts of the builtin logic in an append-only store\n"
+            "                                instead of the board file\n"
+            "        --store-retain <n>      the store only keeps the newest n posts [default: all]\n"
+            "        --handler <file.so>     answer requests with a handler plugin (dlopen) in-process\n"
+            "        --handler-arg <arg>     argument passed to the init() of the handler\n"
+            "        --shards[=<n>]          n SO_REUSEPORT listeners with an event loop thread per core\n"
+            "                                [default: number of online CPUs]\n"
+            "        --prefork <n>           serve with a pool of n pre-forked workers\n"
+            "        --prefork-min <n>       smallest size of the worker pool [default: n]\n"
+            "        --prefork-max <n>       largest size of the worker pool [default: n]\n"
+            "        --workers <n>           hand connections to n long-running logic workers\n"
+            "        --stats-socket <path>   serve metrics in Prometheus text format on a Unix domain socket\n"
+            "        --stats-port <port>     serve metrics on a TCP port of the loopback interface\n"
+            "        --unix <path>           also listen on a Unix domain socket for local clients\n"
+            "        --max-clients <n>       fork engine: serve at most n connections at once\n"
+            "        --overload <mode>       beyond max-clients: queue (default) up to n connections\n"
+            "                                until a handler is free, or answer busy (status=2);\n"
+            "                                with --workers: while no worker is idle\n"
+            "        --no-fastopen           do not accept requests in the SYN (TCP Fast Open)\n"
+            "        --no-defer-accept       accept connections before their request has arrived\n"
+            "        --read-timeout <ms>     close a connection whose request takes longer [default: 30000]\n"
+            "        --write-timeout <ms>    close a connection whose response is not read in time [default: 30000]\n"
+            "        --total-timeout <ms>    close any connection open that long [default: 0 = no limit]\n"
             "        -h, --help\n", message) < 0) {
         errcode = errno; /*When fprintf fails, the new exit value is the errno value from the failed fprintf()*/
     }
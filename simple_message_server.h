@@ -0,0 +1,40 @@
+/**
+ * @file simple_message_server.h
+ * TCP/IP Server-Client project
+ *
+ * Declarations shared between the modules of the simple_message_server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_H
+#define SIMPLE_MESSAGE_SERVER_H
+
+#include "simple_message_server_commandline_handling.h"
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+extern const char *cpPort, *cpFilename;
+extern int save_errno;
+extern smc_options_t options;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+int openListener(int iReusePort);
+int openUnixListener(void);
+void printError(const char *cpWhere, const char *cpMessage);
+void exitOnError(void);
+
+#endif
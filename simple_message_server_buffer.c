@@ -0,0 +1,144 @@
+/**
+ * @file simple_message_server_buffer.c
+ * TCP/IP Server-Client project
+ *
+ * Growable byte buffer used for requests and responses of the server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define MIN_CAPACITY 512
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief make sure that at least size bytes of free space follow the pending data
+ *
+ * Already consumed bytes are discarded before the buffer is grown.
+ *
+ * \param buffer - buffer
+ * \param size - number of bytes needed
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int bufferReserve(sms_buffer_t *buffer, size_t size)
+{
+    size_t newCap;
+    char *newData;
+
+    if (buffer->cap - buffer->len >= size) return 0;
+
+    /* move pending data to the front first - maybe that is enough */
+    if (buffer->off > 0) {
+        memmove(buffer->data, buffer->data + buffer->off, buffer->len - buffer->off);
+        buffer->len -= buffer->off;
+        buffer->off = 0;
+        if (buffer->cap - buffer->len >= size) return 0;
+    }
+
+    newCap = buffer->cap < MIN_CAPACITY ? MIN_CAPACITY : buffer->cap;
+    while (newCap - buffer->len < size) {
+        newCap *= 2;
+    }
+
+    if ((newData = realloc(buffer->data, newCap)) == NULL) return -1;
+
+    buffer->data = newData;
+    buffer->cap = newCap;
+    return 0;
+}
+
+/**
+ * \brief append bytes to the buffer
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int bufferAppend(sms_buffer_t *buffer, const void *data, size_t size)
+{
+    if (bufferReserve(buffer, size) < 0) return -1;
+
+    memcpy(buffer->data + buffer->len, data, size);
+    buffer->len += size;
+    return 0;
+}
+
+/**
+ * \brief append formatted text (without terminating '\0') to the buffer
+ *
+ * \return 0 on success, -1 on error
+ */
+int bufferPrintf(sms_buffer_t *buffer, const char *format, ...)
+{
+    va_list args;
+    int iLen;
+
+    va_start(args, format);
+    iLen = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (iLen < 0 || bufferReserve(buffer, (size_t) iLen + 1) < 0) return -1;
+
+    va_start(args, format);
+    (void) vsnprintf(buffer->data + buffer->len, (size_t) iLen + 1, format, args);
+    va_end(args);
+
+    buffer->len += (size_t) iLen;
+    return 0;
+}
+
+/**
+ * \brief mark size pending bytes as processed
+ */
+void bufferConsume(sms_buffer_t *buffer, size_t size)
+{
+    buffer->off += size;
+    if (buffer->off >= buffer->len) {
+        buffer->off = 0;
+        buffer->len = 0;
+    }
+}
+
+/**
+ * \brief drop all data but keep the allocated memory
+ */
+void bufferReset(sms_buffer_t *buffer)
+{
+    buffer->off = 0;
+    buffer->len = 0;
+}
+
+/**
+ * \brief release the memory of the buffer, leaving an empty buffer
+ */
+void bufferFree(sms_buffer_t *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->off = 0;
+    buffer->len = 0;
+    buffer->cap = 0;
+}
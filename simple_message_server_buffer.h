@@ -0,0 +1,53 @@
+/**
+ * @file simple_message_server_buffer.h
+ * TCP/IP Server-Client project
+ *
+ * Growable byte buffer used for requests and responses of the server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_BUFFER_H
+#define SIMPLE_MESSAGE_SERVER_BUFFER_H
+
+#include <stddef.h>
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/**
+ * bytes [off, len) of data are pending, [len, cap) is free space.
+ * A zeroed buffer is a valid empty buffer.
+ */
+typedef struct
+{
+    char *data;
+    size_t off;
+    size_t len;
+    size_t cap;
+} sms_buffer_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+int bufferReserve(sms_buffer_t *buffer, size_t size);
+int bufferAppend(sms_buffer_t *buffer, const void *data, size_t size);
+int bufferPrintf(sms_buffer_t *buffer, const char *format, ...);
+void bufferConsume(sms_buffer_t *buffer, size_t size);
+void bufferReset(sms_buffer_t *buffer);
+void bufferFree(sms_buffer_t *buffer);
+
+#define bufferPending(buffer) ((buffer)->len - (buffer)->off)
+
+#endif
@@ -22,6 +22,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <getopt.h>
 
 #include "simple_message_server_commandline_handling.h"
@@ -30,6 +32,27 @@
  * --------------------------------------------------------------- defines --
  */
 
+/* getopt codes for long options without a short equivalent */
+#define OPT_PREFORK 256
+#define OPT_PREFORK_MIN 257
+#define OPT_PREFORK_MAX 258
+#define OPT_SHARDS 259
+#define OPT_STATS_SOCKET 260
+#define OPT_STATS_PORT 261
+#define OPT_MAX_CLIENTS 262
+#define OPT_OVERLOAD 263
+#define OPT_NO_FASTOPEN 264
+#define OPT_NO_DEFER_ACCEPT 265
+#define OPT_UNIX 266
+#define OPT_WORKERS 267
+#define OPT_HANDLER 268
+#define OPT_HANDLER_ARG 269
+#define OPT_READ_TIMEOUT 270
+#define OPT_WRITE_TIMEOUT 271
+#define OPT_TOTAL_TIMEOUT 272
+#define OPT_STORE 273
+#define OPT_STORE_RETAIN 274
+
 /*
  * -------------------------------------------------------------- typedefs --
  */
@@ -42,10 +65,55 @@
  * ------------------------------------------------- function declarations --
  */
 
+static int parse_count(const char *arg);
+static int parse_millis(const char *arg);
+
 /*
  * ------------------------------------------------------------- functions --
  */
 
+/**
+ *
+ * \brief Convert a positive decimal command line argument
+ *
+ * \param arg [IN] - argument string
+ *
+ * \return the value, or -1 if \a arg is not a number in the range [1, INT_MAX]
+ *
+ */
+static int parse_count(const char *arg)
+{
+    char *end;
+    long value;
+
+    value = strtol(arg, &end, 10);
+    if ((end == arg) || (*end != '\0') || (value < 1) || (value > INT_MAX))
+    {
+        return -1;
+    }
+
+    return (int) value;
+}
+
+/**
+ *
+ * \brief Convert a timeout in milliseconds given on the command line
+ *
+ * \param arg [IN] - argument string
+ *
+ * \return the value, 0 meaning no limit, or -1 if \a arg is not a number in the range [0, INT_MAX]
+ *
+ */
+static int parse_millis(const char *arg)
+{
+    if (strcmp(arg, "0") == 0)
+    {
+        return 0;
+    }
+
+    return parse_count(arg);
+}
+
 /**
  *
  * \brief Parse the command line
@@ -56,6 +124,7 @@
  * \param argv [IN] - array of command line arguments.
  * \param usagefunc [IN] - pointer to a function called for diplaying usage information.
  * \param port [OUT] - string containing the port number or the service name
+ * \param options [OUT] - optional engine settings (defaults if not given)
  *
  * \return Upon successful execution, the function returns and the output parameters
  *         \a port, \a server, \a message, and  \a img_url are filled properly (Note that
@@ -68,16 +137,61 @@ void smc_parsecommandline(
     int argc,
     const char * const argv[],
     smc_usagefunc_t usagefunc,
-    const char **port
+    const char **port,
+    smc_options_t *options
     )
 {
     int c;
 
     *port = NULL;
+    options->engine = SMS_ENGINE_FORK;
+    options->logic = SMS_LOGIC_BUILTIN;
+    options->board_path = "simple_message_board.txt";
+    options->store_path = NULL;
+    options->store_retain = 0;
+    options->handler_path = NULL;
+    options->handler_arg = NULL;
+    options->prefork_start = 0;
+    options->prefork_min = 0;
+    options->prefork_max = 0;
+    options->shards = 0;
+    options->workers = 0;
+    options->stats_socket = NULL;
+    options->stats_port = NULL;
+    options->max_clients = 0;
+    options->overload = SMS_OVERLOAD_QUEUE;
+    options->fastopen = SMS_FASTOPEN_QUEUE;
+    options->defer_accept = SMS_DEFER_ACCEPT;
+    options->unix_path = NULL;
+    options->read_timeout = SMS_READ_TIMEOUT;
+    options->write_timeout = SMS_WRITE_TIMEOUT;
+    options->total_timeout = SMS_TOTAL_TIMEOUT;
 
     struct option long_options[] =
     {
         {"port", 1, NULL, 'p'},
+        {"engine", 1, NULL, 'e'},
+        {"logic", 1, NULL, 'l'},
+        {"board", 1, NULL, 'b'},
+        {"store", 1, NULL, OPT_STORE},
+        {"store-retain", 1, NULL, OPT_STORE_RETAIN},
+        {"prefork", 1, NULL, OPT_PREFORK},
+        {"prefork-min", 1, NULL, OPT_PREFORK_MIN},
+        {"prefork-max", 1, NULL, OPT_PREFORK_MAX},
+        {"shards", 2, NULL, OPT_SHARDS},
+        {"stats-socket", 1, NULL, OPT_STATS_SOCKET},
+        {"stats-port", 1, NULL, OPT_STATS_PORT},
+        {"max-clients", 1, NULL, OPT_MAX_CLIENTS},
+        {"overload", 1, NULL, OPT_OVERLOAD},
+        {"no-fastopen", 0, NULL, OPT_NO_FASTOPEN},
+        {"no-defer-accept", 0, NULL, OPT_NO_DEFER_ACCEPT},
+        {"unix", 1, NULL, OPT_UNIX},
+        {"workers", 1, NULL, OPT_WORKERS},
+        {"handler", 1, NULL, OPT_HANDLER},
+        {"handler-arg", 1, NULL, OPT_HANDLER_ARG},
+        {"read-timeout", 1, NULL, OPT_READ_TIMEOUT},
+        {"write-timeout", 1, NULL, OPT_WRITE_TIMEOUT},
+        {"total-timeout", 1, NULL, OPT_TOTAL_TIMEOUT},
         {"help", 0, NULL, 'h'},
         {0, 0, 0, 0}
     };
@@ -86,7 +200,7 @@ void smc_parsecommandline(
         (c = getopt_long(
              argc,
              (char ** const) argv,
-             "p:h",
+             "p:e:l:b:h",
              long_options,
              NULL
              )
@@ -99,6 +213,165 @@ void smc_parsecommandline(
                 *port = optarg;
                 break;
 
+            case 'e':
+                if (strcmp(optarg, "fork") == 0)
+                {
+                    options->engine = SMS_ENGINE_FORK;
+                }
+                else if (strcmp(optarg, "epoll") == 0)
+                {
+                    options->engine = SMS_ENGINE_EPOLL;
+                }
+                else if (strcmp(optarg, "io_uring") == 0)
+                {
+                    options->engine = SMS_ENGINE_URING;
+                }
+                else
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SHARDS:
+                options->engine = SMS_ENGINE_SHARDS;
+                if (optarg != NULL && (options->shards = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case 'l':
+                if (strcmp(optarg, "builtin") == 0)
+                {
+                    options->logic = SMS_LOGIC_BUILTIN;
+                }
+                else if (strcmp(optarg, "exec") == 0)
+                {
+                    options->logic = SMS_LOGIC_EXEC;
+                }
+                else
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case 'b':
+                options->board_path = optarg;
+                break;
+
+            case OPT_STORE:
+                options->store_path = optarg;
+                break;
+
+            case OPT_STORE_RETAIN:
+                if ((options->store_retain = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_HANDLER:
+                options->logic = SMS_LOGIC_PLUGIN;
+                options->handler_path = optarg;
+                break;
+
+            case OPT_HANDLER_ARG:
+                options->handler_arg = optarg;
+                break;
+
+            case OPT_PREFORK:
+                options->engine = SMS_ENGINE_PREFORK;
+                if ((options->prefork_start = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_PREFORK_MIN:
+                if ((options->prefork_min = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_PREFORK_MAX:
+                if ((options->prefork_max = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_WORKERS:
+                options->engine = SMS_ENGINE_WORKERS;
+                if ((options->workers = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_STATS_SOCKET:
+                options->stats_socket = optarg;
+                break;
+
+            case OPT_STATS_PORT:
+                options->stats_port = optarg;
+                break;
+
+            case OPT_UNIX:
+                options->unix_path = optarg;
+                break;
+
+            case OPT_MAX_CLIENTS:
+                if ((options->max_clients = parse_count(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_OVERLOAD:
+                if (strcmp(optarg, "queue") == 0)
+                {
+                    options->overload = SMS_OVERLOAD_QUEUE;
+                }
+                else if (strcmp(optarg, "busy") == 0)
+                {
+                    options->overload = SMS_OVERLOAD_BUSY;
+                }
+                else
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_READ_TIMEOUT:
+                if ((options->read_timeout = parse_millis(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_WRITE_TIMEOUT:
+                if ((options->write_timeout = parse_millis(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_TOTAL_TIMEOUT:
+                if ((options->total_timeout = parse_millis(optarg)) < 0)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_NO_FASTOPEN:
+                options->fastopen = 0;
+                break;
+
+            case OPT_NO_DEFER_ACCEPT:
+                options->defer_accept = 0;
+                break;
+
             case 'h':
                 usagefunc(stdout, argv[0], EXIT_SUCCESS);
                 break;
@@ -117,6 +390,32 @@ void smc_parsecommandline(
     {
         usagefunc(stderr, argv[0], EXIT_FAILURE);
     }
+
+    /* the pool bounds default to a fixed size pool of prefork_start workers */
+    if (options->engine == SMS_ENGINE_PREFORK)
+    {
+        if (options->prefork_min == 0)
+        {
+            options->prefork_min = options->prefork_start;
+        }
+        if (options->prefork_max == 0)
+        {
+            options->prefork_max = (options->prefork_start > options->prefork_min) ?
+                options->prefork_start : options->prefork_min;
+        }
+        if (options->prefork_min > options->prefork_max)
+        {
+            usagefunc(stderr, argv[0], EXIT_FAILURE);
+        }
+        if (options->prefork_start < options->prefork_min)
+        {
+            options->prefork_start = options->prefork_min;
+        }
+        if (options->prefork_start > options->prefork_max)
+        {
+            options->prefork_start = options->prefork_max;
+        }
+    }
 }
 
 /*
@@ -17,6 +17,9 @@
  * $Id:$
  */
 
+#ifndef SIMPLE_MESSAGE_SERVER_COMMANDLINE_HANDLING_H
+#define SIMPLE_MESSAGE_SERVER_COMMANDLINE_HANDLING_H
+
 /*
  * -------------------------------------------------------------- includes --
  */
@@ -30,12 +33,74 @@
 #define TRUE (1==1)
 #define FALSE (!TRUE)
 
+/* TCP Fast Open queue length and TCP_DEFER_ACCEPT seconds of the listener */
+#define SMS_FASTOPEN_QUEUE 256
+#define SMS_DEFER_ACCEPT 5
+
+/* default deadlines of a connection in milliseconds, 0 disables one */
+#define SMS_READ_TIMEOUT 30000
+#define SMS_WRITE_TIMEOUT 30000
+#define SMS_TOTAL_TIMEOUT 0
+
 /*
  * -------------------------------------------------------------- typedefs --
  */
 
 typedef void (* smc_usagefunc_t) (FILE *, const char *, int);
 
+/** engine used to serve accepted connections */
+typedef enum
+{
+    SMS_ENGINE_FORK = 0,    /* fork() + exec per connection (default) */
+    SMS_ENGINE_PREFORK,     /* pool of long-lived workers blocking in accept() */
+    SMS_ENGINE_EPOLL,       /* single process non-blocking epoll event loop */
+    SMS_ENGINE_SHARDS,      /* SO_REUSEPORT listener and event loop thread per core */
+    SMS_ENGINE_URING,       /* io_uring completion loop, falls back to SMS_ENGINE_FORK */
+    SMS_ENGINE_WORKERS      /* long-running logic workers, connections passed with SCM_RIGHTS */
+} smc_engine_t;
+
+/** implementation of the bulletin board logic */
+typedef enum
+{
+    SMS_LOGIC_BUILTIN = 0,  /* compiled into the server (default) */
+    SMS_LOGIC_EXEC,         /* external simple_message_server_logic binary */
+    SMS_LOGIC_PLUGIN        /* handler shared object loaded with dlopen() */
+} smc_logic_t;
+
+/** what happens to connections beyond max_clients */
+typedef enum
+{
+    SMS_OVERLOAD_QUEUE = 0, /* wait until a handler finishes, up to max_clients of them (default) */
+    SMS_OVERLOAD_BUSY       /* answered right away with a busy status */
+} smc_overload_t;
+
+/** optional server settings filled in by smc_parsecommandline() */
+typedef struct
+{
+    smc_engine_t engine;    /* selected engine */
+    smc_logic_t logic;      /* selected logic */
+    const char *board_path; /* board file of the built-in logic */
+    const char *store_path; /* message store directory of the built-in logic, NULL for the board file */
+    int store_retain;       /* posts the store keeps, 0 for all */
+    const char *handler_path;   /* handler plugin of SMS_LOGIC_PLUGIN */
+    const char *handler_arg;    /* argument for the init() of the handler, NULL for none */
+    int prefork_start;      /* number of workers spawned at startup */
+    int prefork_min;        /* pool never shrinks below this size */
+    int prefork_max;        /* pool never grows beyond this size */
+    int shards;             /* number of shards, 0 for one per online CPU */
+    int workers;            /* number of logic workers */
+    const char *stats_socket;   /* Unix domain socket serving the stats, NULL for none */
+    const char *stats_port;     /* loopback TCP port serving the stats, NULL for none */
+    int max_clients;        /* connections served at once by the fork engine, 0 for no limit */
+    smc_overload_t overload;    /* handling of connections beyond max_clients */
+    int fastopen;           /* TCP Fast Open queue length, 0 if disabled */
+    int defer_accept;       /* seconds accept() waits for the request, 0 if disabled */
+    const char *unix_path;  /* Unix domain socket listening besides the TCP port, NULL for none */
+    int read_timeout;       /* ms a client may take to send a request, 0 for no limit */
+    int write_timeout;      /* ms a client may take to read a response, 0 for no limit */
+    int total_timeout;      /* ms a connection may last, 0 for no limit */
+} smc_options_t;
+
 /*
  * --------------------------------------------------------------- globals --
  */
@@ -54,6 +119,7 @@ typedef void (* smc_usagefunc_t) (FILE *, const char *, int);
  * \param argv [IN] - array of command line arguments.
  * \param usagefunc [IN] - pointer to a function called for diplaying usage information.
  * \param port [OUT] - string containing the port number or the service name
+ * \param options [OUT] - optional engine settings (defaults if not given)
  *
  * \return Upon successful execution, the function returns and the output parameters
  *         \a port, \a server, \a message, and  \a img_url are filled properly (Note that
@@ -66,9 +132,12 @@ extern void smc_parsecommandline(
     int argc,
     const char * const argv[],
     smc_usagefunc_t usagefunc,
-    const char **port
+    const char **port,
+    smc_options_t *options
     );
 
+#endif
+
 /*
  * =================================================================== eof ==
  */
@@ -0,0 +1,798 @@
+/**
+ * @file simple_message_server_epoll.c
+ * TCP/IP Server-Client project
+ *
+ * Single process epoll event loop engine of the simple_message_server.
+ *
+ * The listening sockets (TCP and optionally Unix domain) and all client
+ * sockets are non-blocking and driven by one epoll reactor. A connection only costs its bookkeeping and buffers
+ * while the request trickles in; it is parsed incrementally and rejected as
+ * soon as it is malformed. Once the request is complete the built-in logic
+ * renders the response right into the output buffer of the connection. The
+ * external logic is started with the request on stdin (a memfd) and its
+ * stdout connected to a pipe, which is relayed to the client. Either way the
+ * response is sent with partial-write handling. Keep-alive connections go
+ * back to reading after each response; pipelined requests are answered in
+ * order.
+ *
+ * Every connection has one timer in the wheel of its reactor, armed for
+ * the earliest of its deadlines: the request must be complete within
+ * --read-timeout, a pending response taken within --write-timeout and the
+ * whole connection done within --total-timeout. A connection whose timer
+ * expires is closed, so slow clients cannot pile up.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_epoll.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_logic.h"
+#include "simple_message_server_request.h"
+#include "simple_message_server_response.h"
+#include "simple_message_server_stats.h"
+#include "simple_message_server_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define MAX_EVENTS 256
+#define READ_CHUNK 4096
+/* stop reading the logic output while this much is waiting for the client */
+#define RESPONSE_HIGH_WATER (64 * 1024)
+/* the TCP listener and the optional Unix domain listener */
+#define MAX_LISTENERS 2
+/* connection a deadline timer is embedded in */
+#define TIMER_CONNECTION(timer) ((connection_t *) ((char *) (timer) - offsetof(connection_t, timer)))
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef enum
+{
+    WATCH_LISTENER,
+    WATCH_CLIENT,
+    WATCH_LOGIC
+} watch_type_t;
+
+struct connection;
+
+struct listener;
+
+/** what an epoll event refers to */
+typedef struct
+{
+    watch_type_t type;
+    struct connection *conn;
+    struct listener *listener;  /* for WATCH_LISTENER */
+} watch_t;
+
+typedef struct listener
+{
+    int fd;                 /* -1 if unused */
+    int paused;             /* removed from epoll because we ran out of descriptors */
+    watch_t watch;
+} listener_t;
+
+typedef enum
+{
+    CONN_READING,           /* receiving the request */
+    CONN_RUNNING,           /* logic started, relaying its output */
+    CONN_DRAINING           /* response complete, sending the rest */
+} conn_state_t;
+
+typedef struct connection
+{
+    int fd;                 /* client socket */
+    int logic_fd;           /* read end of the stdout pipe of the logic, -1 if none */
+    conn_state_t state;
+    uint32_t client_events; /* events currently registered for fd */
+    uint32_t logic_events;  /* events currently registered for logic_fd */
+    watch_t client_watch;
+    watch_t logic_watch;
+    sms_request_t request;
+    sms_buffer_t response;
+    sms_buffer_t logic_output;  /* output of the logic for a binary request, framed when complete */
+    uint64_t logic_start;   /* when the logic was started for the request */
+    uint64_t read_deadline; /* timerNow() times, 0 for none */
+    uint64_t write_deadline;
+    uint64_t total_deadline;
+    sms_timer_t timer;      /* armed for the earliest deadline */
+    int closed;             /* closed in the current batch, freed after it */
+    struct connection *next_closed;
+} connection_t;
+
+typedef struct
+{
+    int epfd;
+    listener_t listeners[MAX_LISTENERS];
+    connection_t *closed;   /* connections to free once the current batch of events is done */
+    sms_timer_wheel_t timers;   /* deadlines of the connections */
+} reactor_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int setNonBlocking(int fd);
+static void raiseFileLimit(void);
+static int watchFd(reactor_t *reactor, int op, int fd, uint32_t events, watch_t *watch);
+static void acceptConnections(reactor_t *reactor, listener_t *listener);
+static void closeConnection(reactor_t *reactor, connection_t *conn);
+static void readRequest(reactor_t *reactor, connection_t *conn);
+static void handleRequests(reactor_t *reactor, connection_t *conn, int eof);
+static void nextRequest(connection_t *conn);
+static void rejectRequest(reactor_t *reactor, connection_t *conn);
+static void startLogic(reactor_t *reactor, connection_t *conn);
+static void finishLogic(reactor_t *reactor, connection_t *conn);
+static void readLogic(reactor_t *reactor, connection_t *conn);
+static void flushResponse(reactor_t *reactor, connection_t *conn);
+static void setClientEvents(reactor_t *reactor, connection_t *conn, uint32_t events);
+static void setLogicEvents(reactor_t *reactor, connection_t *conn, uint32_t events);
+static void armDeadline(reactor_t *reactor, connection_t *conn);
+static void expireConnections(reactor_t *reactor);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static int setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * \brief every idle client costs a descriptor - allow as many as permitted
+ */
+static void raiseFileLimit(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        (void) setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static int watchFd(reactor_t *reactor, int op, int fd, uint32_t events, watch_t *watch)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = watch;
+
+    return epoll_ctl(reactor->epfd, op, fd, &event);
+}
+
+static void setClientEvents(reactor_t *reactor, connection_t *conn, uint32_t events)
+{
+    if (conn->client_events == events) return;
+
+    if (watchFd(reactor, EPOLL_CTL_MOD, conn->fd, events, &conn->client_watch) == 0) {
+        conn->client_events = events;
+    }
+}
+
+static void setLogicEvents(reactor_t *reactor, connection_t *conn, uint32_t events)
+{
+    if (conn->logic_fd < 0 || conn->logic_events == events) return;
+
+    if (watchFd(reactor, EPOLL_CTL_MOD, conn->logic_fd, events, &conn->logic_watch) == 0) {
+        conn->logic_events = events;
+    }
+}
+
+/**
+ * \brief arm the timer of a connection for its earliest deadline
+ */
+static void armDeadline(reactor_t *reactor, connection_t *conn)
+{
+    timerArm(&reactor->timers, &conn->timer,
+             timerEarliest(timerEarliest(conn->read_deadline, conn->write_deadline), conn->total_deadline));
+}
+
+/**
+ * \brief close the connections whose deadline has passed
+ */
+static void expireConnections(reactor_t *reactor)
+{
+    sms_timer_t *timer;
+
+    timerExpire(&reactor->timers, timerNow());
+
+    while ((timer = timerNextExpired(&reactor->timers)) != NULL) {
+        statsTimeout();
+        closeConnection(reactor, TIMER_CONNECTION(timer));
+    }
+}
+
+/**
+ * \brief accept all pending connections of a listener
+ */
+static void acceptConnections(reactor_t *reactor, listener_t *listener)
+{
+    connection_t *conn;
+    uint64_t now;
+    int cfd;
+
+    while (1) {
+
+        cfd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (cfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+
+            statsAcceptError(errno);
+            if (errno == ECONNABORTED) continue;
+
+            if (errno == EMFILE || errno == ENFILE) {
+                /* level triggered: keep the listener out of epoll until a descriptor is freed */
+                printError("EPOLL-accept()", "Out of descriptors - pausing accept");
+                if (epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, listener->fd, NULL) == 0) {
+                    listener->paused = 1;
+                }
+                return;
+            }
+
+            printError("EPOLL-accept()", "Could not accept connection");
+            return;
+        }
+
+        statsAccept();
+
+        if ((conn = calloc(1, sizeof(*conn))) == NULL) {
+            printError("EPOLL-calloc()", "Could not allocate connection");
+            close(cfd);
+            continue;
+        }
+
+        conn->fd = cfd;
+        conn->logic_fd = -1;
+        conn->state = CONN_READING;
+        conn->client_watch.type = WATCH_CLIENT;
+        conn->client_watch.conn = conn;
+        conn->logic_watch.type = WATCH_LOGIC;
+        conn->logic_watch.conn = conn;
+        conn->client_events = EPOLLIN;
+
+        if (watchFd(reactor, EPOLL_CTL_ADD, cfd, conn->client_events, &conn->client_watch) < 0) {
+            printError("EPOLL-epoll_ctl()", "Could not watch connection");
+            close(cfd);
+            free(conn);
+            continue;
+        }
+
+        now = timerNow();
+        conn->read_deadline = timerDeadline(now, options.read_timeout);
+        conn->total_deadline = timerDeadline(now, options.total_timeout);
+        armDeadline(reactor, conn);
+
+        statsActive(1);
+    }
+}
+
+/**
+ * \brief close a connection
+ *
+ * The memory is released after the current batch of events, which may
+ * still contain events referring to this connection.
+ */
+static void closeConnection(reactor_t *reactor, connection_t *conn)
+{
+    listener_t *listener;
+
+    /* closing removes the descriptors from epoll, the logic dies by SIGPIPE if still running */
+    if (conn->logic_fd >= 0) close(conn->logic_fd);
+    close(conn->fd);
+    conn->logic_fd = -1;
+    conn->fd = -1;
+    timerCancel(&reactor->timers, &conn->timer);
+
+    requestFree(&conn->request);
+    bufferFree(&conn->response);
+    bufferFree(&conn->logic_output);
+    conn->closed = 1;
+    conn->next_closed = reactor->closed;
+    statsActive(-1);
+    reactor->closed = conn;
+
+    for (listener = reactor->listeners; listener < reactor->listeners + MAX_LISTENERS; listener++) {
+        if (listener->paused &&
+            watchFd(reactor, EPOLL_CTL_ADD, listener->fd, EPOLLIN, &listener->watch) == 0) {
+            listener->paused = 0;
+        }
+    }
+}
+
+/**
+ * \brief read whatever the client has sent and answer the requests completed by it
+ *
+ * Reading pauses while the responses to pipelined requests pile up.
+ */
+static void readRequest(reactor_t *reactor, connection_t *conn)
+{
+    sms_buffer_t *raw = &conn->request.raw;
+    ssize_t n;
+
+    while (conn->state == CONN_READING && bufferPending(&conn->response) < RESPONSE_HIGH_WATER) {
+
+        if (bufferReserve(raw, READ_CHUNK) < 0) {
+            printError("EPOLL-bufferReserve()", "Could not allocate request buffer");
+            closeConnection(reactor, conn);
+            return;
+        }
+
+        n = recv(conn->fd, raw->data + raw->len, raw->cap - raw->len, 0);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                statsEagain();
+                break;
+            }
+            closeConnection(reactor, conn);
+            return;
+        }
+
+        statsBytesIn((size_t) n);
+
+        /* a text request is complete when the client half-closes, a binary one when its frame is */
+        raw->len += (size_t) n;
+        handleRequests(reactor, conn, n == 0);
+        if (conn->closed) return;
+    }
+
+    flushResponse(reactor, conn);
+}
+
+/**
+ * \brief answer the requests which are complete
+ *
+ * The requests of a keep-alive connection are answered in order; any other
+ * request ends the connection once it is answered. The external logic
+ * serves one request at a time.
+ *
+ * \param eof - non-zero if the client has closed its sending direction
+ */
+static void handleRequests(reactor_t *reactor, connection_t *conn, int eof)
+{
+    sms_request_t *request = &conn->request;
+    sms_request_state_t state;
+    uint64_t requestStart;
+
+    while (conn->state == CONN_READING) {
+
+        /* the client closed a keep-alive connection between two requests */
+        if (eof && request->raw.len == 0 && request->sequence > 0) {
+            conn->state = CONN_DRAINING;
+            return;
+        }
+
+        state = requestParse(request, eof);
+
+        if (state == REQUEST_INVALID || (eof && state != REQUEST_COMPLETE)) {
+            rejectRequest(reactor, conn);
+            return;
+        }
+
+        if (state != REQUEST_COMPLETE) return;
+
+        if (options.logic == SMS_LOGIC_EXEC) {
+            startLogic(reactor, conn);
+            return;
+        }
+
+        requestStart = statsNow();
+        if (logicRespond(request, &conn->response) < 0) {
+            printError("EPOLL-logicRespond()", "Could not build response");
+            closeConnection(reactor, conn);
+            return;
+        }
+        statsRequest(requestStart);
+
+        nextRequest(conn);
+    }
+}
+
+/**
+ * \brief after a response: wait for the next request of a keep-alive connection or finish
+ */
+static void nextRequest(connection_t *conn)
+{
+    if (conn->request.keep_alive) {
+        requestNext(&conn->request);
+        conn->state = CONN_READING;
+        conn->read_deadline = timerDeadline(timerNow(), options.read_timeout);
+    } else {
+        requestFree(&conn->request);
+        conn->state = CONN_DRAINING;
+    }
+}
+
+/**
+ * \brief answer a malformed request without bothering the logic
+ */
+static void rejectRequest(reactor_t *reactor, connection_t *conn)
+{
+    /* in the protocol of the request: a protocol 2 client cannot read a text status */
+    int iResult = responseReject(&conn->response, &conn->request, STATUS_ERROR);
+
+    requestFree(&conn->request);
+    conn->state = CONN_DRAINING;
+
+    if (iResult < 0) closeConnection(reactor, conn);
+}
+
+/**
+ * \brief run the external logic on the complete request
+ *
+ * The logic reads the request from a memfd and writes its response into a
+ * pipe watched by the reactor. The output for a text request is relayed to
+ * the client as it comes. The logic only speaks text, so a binary request
+ * is rewritten first and the output is framed once it is complete.
+ */
+static void startLogic(reactor_t *reactor, connection_t *conn)
+{
+    sms_buffer_t *raw = &conn->request.raw;
+    sms_buffer_t text = { NULL, 0, 0, 0 };
+    int requestFd, pipeFds[2];
+    size_t written = 0;
+    ssize_t n;
+    pid_t childpid;
+    uint64_t forkStart;
+
+    conn->logic_start = statsNow();
+
+    if ((requestFd = memfd_create("simple_message_request", MFD_CLOEXEC)) < 0) {
+        printError("EPOLL-memfd_create()", "Could not store request");
+        closeConnection(reactor, conn);
+        return;
+    }
+
+    if (conn->request.version != 0) {
+        if (requestToText(&conn->request, &text) < 0) {
+            printError("EPOLL-requestToText()", "Could not store request");
+            bufferFree(&text);
+            close(requestFd);
+            closeConnection(reactor, conn);
+            return;
+        }
+        raw = &text;
+    }
+
+    while (written < raw->len) {
+        if ((n = write(requestFd, raw->data + written, raw->len - written)) < 0) {
+            if (errno == EINTR) continue;
+            printError("EPOLL-write()", "Could not store request");
+            bufferFree(&text);
+            close(requestFd);
+            closeConnection(reactor, conn);
+            return;
+        }
+        written += (size_t) n;
+    }
+    (void) lseek(requestFd, 0, SEEK_SET);
+    bufferFree(&text);
+
+    if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+        printError("EPOLL-pipe2()", "Could not create logic pipe");
+        close(requestFd);
+        closeConnection(reactor, conn);
+        return;
+    }
+
+    forkStart = statsNow();
+    childpid = spawnLogic(requestFd, pipeFds[1]);
+    statsSpawn(forkStart);
+    close(requestFd);
+    close(pipeFds[1]);
+
+    if (childpid < (pid_t) 0) {
+        /* EAGAIN or ENOMEM - drop this connection, but keep serving the others */
+        printError("EPOLL-posix_spawn()", "Could not start simple_message_server_logic");
+        close(pipeFds[0]);
+        closeConnection(reactor, conn);
+        return;
+    }
+
+    /* only our end is non-blocking, the logic writes in blocking mode */
+    conn->logic_fd = pipeFds[0];
+    conn->logic_events = EPOLLIN;
+    if (setNonBlocking(conn->logic_fd) < 0 ||
+        watchFd(reactor, EPOLL_CTL_ADD, conn->logic_fd, conn->logic_events, &conn->logic_watch) < 0) {
+        printError("EPOLL-epoll_ctl()", "Could not watch logic pipe");
+        closeConnection(reactor, conn);
+        return;
+    }
+
+    conn->state = CONN_RUNNING;
+}
+
+/**
+ * \brief the logic has finished: complete its response
+ */
+static void finishLogic(reactor_t *reactor, connection_t *conn)
+{
+    sms_response_t framed;
+
+    statsRequest(conn->logic_start);
+
+    if (conn->request.version == 0) {
+        /* relayed as it came */
+        conn->state = CONN_DRAINING;
+        return;
+    }
+
+    if (responseBegin(&framed, &conn->response, &conn->request) < 0 ||
+        responseAddText(&framed, conn->logic_output.data, conn->logic_output.len) < 0) {
+        printError("EPOLL-responseAddText()", "Could not build response");
+        closeConnection(reactor, conn);
+        return;
+    }
+    responseEnd(&framed);
+    bufferReset(&conn->logic_output);
+
+    nextRequest(conn);
+    /* pipelined requests may already be waiting */
+    if (conn->state == CONN_READING) handleRequests(reactor, conn, 0);
+}
+
+/**
+ * \brief move the output of the logic into the response buffer
+ */
+static void readLogic(reactor_t *reactor, connection_t *conn)
+{
+    int relay = conn->request.version == 0;
+    sms_buffer_t *output = relay ? &conn->response : &conn->logic_output;
+    ssize_t n;
+
+    while (!relay || bufferPending(output) < RESPONSE_HIGH_WATER) {
+
+        if (bufferReserve(output, READ_CHUNK) < 0) {
+            printError("EPOLL-bufferReserve()", "Could not allocate response buffer");
+            closeConnection(reactor, conn);
+            return;
+        }
+
+        n = read(conn->logic_fd, output->data + output->len, output->cap - output->len);
+
+        if (n > 0) {
+            output->len += (size_t) n;
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        /* end of output (or a broken pipe) - the response is complete */
+        close(conn->logic_fd);
+        conn->logic_fd = -1;
+        finishLogic(reactor, conn);
+        if (conn->closed) return;
+        break;
+    }
+
+    if (conn->state == CONN_RUNNING && relay && bufferPending(output) >= RESPONSE_HIGH_WATER) {
+        /* client is slow - let the logic block on the full pipe */
+        setLogicEvents(reactor, conn, 0);
+    }
+
+    flushResponse(reactor, conn);
+}
+
+/**
+ * \brief send as much of the response as the socket takes
+ */
+static void flushResponse(reactor_t *reactor, connection_t *conn)
+{
+    sms_buffer_t *response = &conn->response;
+    uint32_t events = 0;
+    ssize_t n;
+
+    while (bufferPending(response) > 0) {
+
+        n = send(conn->fd, response->data + response->off, bufferPending(response), MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                statsEagain();
+                break;
+            }
+            closeConnection(reactor, conn);
+            return;
+        }
+
+        statsBytesOut((size_t) n);
+        bufferConsume(response, (size_t) n);
+    }
+
+    if (bufferPending(response) == 0 && conn->state == CONN_DRAINING) {
+        closeConnection(reactor, conn);
+        return;
+    }
+
+    /* the client has write_timeout to take a response from the moment it is pending */
+    if (bufferPending(response) == 0) {
+        conn->write_deadline = 0;
+    } else if (conn->write_deadline == 0) {
+        conn->write_deadline = timerDeadline(timerNow(), options.write_timeout);
+    }
+    if (conn->state != CONN_READING) conn->read_deadline = 0;
+    armDeadline(reactor, conn);
+
+    /* wait for the socket to take more, and for further requests unless their responses pile up */
+    if (bufferPending(response) > 0) events |= EPOLLOUT;
+    if (conn->state == CONN_READING && bufferPending(response) < RESPONSE_HIGH_WATER) events |= EPOLLIN;
+    setClientEvents(reactor, conn, events);
+
+    /* the logic may write again once its relayed output has drained */
+    if (conn->state == CONN_RUNNING && bufferPending(response) < RESPONSE_HIGH_WATER) {
+        setLogicEvents(reactor, conn, EPOLLIN);
+    }
+}
+
+/**
+ * \brief process wide preparations needed by any number of reactors
+ */
+void prepareReactors(void)
+{
+    raiseFileLimit();
+
+    /* the logic children are never waited for - let the kernel reap them */
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+/**
+ * \brief run an event loop serving the connections of its listeners - does not return
+ *
+ * The reactor keeps all of its state on its own stack, so several reactors
+ * can run in threads of one process.
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ */
+void runReactor(int sfd, int ufd)
+{
+    reactor_t reactor;
+    struct epoll_event events[MAX_EVENTS];
+    listener_t *listener;
+    watch_t *watch;
+    connection_t *conn;
+    int i, n, iFailed;
+
+    memset(&reactor, 0, sizeof(reactor));
+    timerWheelInit(&reactor.timers);
+    reactor.listeners[0].fd = sfd;
+    reactor.listeners[1].fd = ufd;
+
+    iFailed = (reactor.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0;
+
+    for (listener = reactor.listeners; listener < reactor.listeners + MAX_LISTENERS; listener++) {
+
+        listener->watch.type = WATCH_LISTENER;
+        listener->watch.listener = listener;
+
+        if (iFailed || listener->fd < 0) continue;
+
+        iFailed = setNonBlocking(listener->fd) < 0 || fcntl(listener->fd, F_SETFD, FD_CLOEXEC) < 0 ||
+                  watchFd(&reactor, EPOLL_CTL_ADD, listener->fd, EPOLLIN, &listener->watch) < 0;
+    }
+
+    if (iFailed) {
+
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("EPOLL-epoll_create1()", "Could not set up event loop");
+
+        //CLOSE PARENT SOCKETS
+        if (close(sfd) < 0 || (ufd >= 0 && close(ufd) < 0)) {
+            printError("EPOLL-epoll_create1()-close()", "Could not set up event loop and could not close socket");
+        }
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    // EVENT LOOP - START
+    while (1) {
+
+        n = epoll_wait(reactor.epfd, events, MAX_EVENTS, timerTimeout(&reactor.timers, timerNow()));
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+
+            //RESET save_errno
+            save_errno = 0;
+
+            printError("EPOLL-epoll_wait()", "Could not wait for events");
+            exitOnError();
+        }
+
+        for (i = 0; i < n; i++) {
+
+            watch = events[i].data.ptr;
+            conn = watch->conn;
+
+            if (conn != NULL && conn->closed) continue;
+
+            switch (watch->type) {
+
+            case WATCH_LISTENER:
+                acceptConnections(&reactor, watch->listener);
+                break;
+
+            case WATCH_CLIENT:
+                if (conn->state == CONN_READING) {
+                    readRequest(&reactor, conn);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    closeConnection(&reactor, conn);
+                } else {
+                    flushResponse(&reactor, conn);
+                }
+                break;
+
+            case WATCH_LOGIC:
+                readLogic(&reactor, conn);
+                break;
+            }
+        }
+
+        expireConnections(&reactor);
+
+        while ((conn = reactor.closed) != NULL) {
+            reactor.closed = conn->next_closed;
+            free(conn);
+        }
+    }
+    // EVENT LOOP - END
+}
+
+/**
+ * \brief run the epoll engine - does not return
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param options - server settings
+ */
+void runEpollEngine(int sfd, int ufd, const smc_options_t *options)
+{
+    (void) options;
+
+    prepareReactors();
+    runReactor(sfd, ufd);
+}
@@ -0,0 +1,599 @@
+/**
+ * @file simple_message_server_handler.c
+ * TCP/IP Server-Client project
+ *
+ * Serving of a single accepted connection by the server logic.
+ *
+ * The blocking engines enforce the deadlines of a connection here: the
+ * socket is only waited for with poll() up to the read, write or total
+ * deadline, whichever comes first. The external logic reading the socket
+ * itself only gets its reads and writes bounded by socket timeouts.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_logic.h"
+#include "simple_message_server_request.h"
+#include "simple_message_server_response.h"
+#include "simple_message_server_stats.h"
+#include "simple_message_server_timer.h"
+#include "simple_message_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define READ_CHUNK 4096
+/* request bytes rejectBusy() reads at most before closing */
+#define BUSY_DRAIN_MAX (16 * READ_CHUNK)
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief replace the calling (child) process by the server logic
+ *
+ * The request source is mapped onto stdin and the response sink onto stdout
+ * of the logic - usually both are the connected client socket. The function
+ * only returns by terminating the process if anything goes wrong.
+ *
+ * \param infd - descriptor the logic reads the request from
+ * \param outfd - descriptor the logic writes the response to
+ */
+void execLogic(int infd, int outfd)
+{
+    if((dup2(infd, 0) == -1)) {
+
+        //RESET save_errno
+        save_errno = 0;
+
+        //MAIN ERROR MESSAGE
+        printError("CHILD-dup2()", "Could not read -dup2");
+
+        //CLOSE CHILD SOCKET
+        if (close(infd) < 0 ) {
+            printError("CHILD-dup2()-close()", "Could not read -dup2 and could not close socket");
+        }
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    if((dup2(outfd, 1) == -1)) {
+
+        //RESET save_errno
+        save_errno = 0;
+
+        //MAIN ERROR MESSAGE
+        printError("CHILD-dup2()", "Could not write -dup2");
+
+        //CLOSE CHILD SOCKET
+        if (close(outfd) < 0 ) {
+            printError("CHILD-dup2()-close()", "Could not write -dup2 and could not close socket");
+        }
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    //when everything is ok -> exec server logic
+
+    //RESET save_errno
+    save_errno = 0;
+
+    //CLOSE CHILD SOCKET
+    if (infd > 1 && close(infd) < 0 ) {
+        printError("CHILD-fork()-close()", "Could not close CHILD socket");
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+    if (outfd > 1 && outfd != infd && close(outfd) < 0 ) {
+        printError("CHILD-fork()-close()", "Could not close CHILD socket");
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    if( execl(LOGIC_PATH, LOGIC_NAME, (char*) NULL)< 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("CHILD-fork()-simple_message_server_logic()", "Could not START simple_message_server_logic properly");
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    exit(1);
+}
+
+/**
+ * \brief start the server logic with infd as stdin and outfd as stdout
+ *
+ * Unlike fork() + execLogic(), posix_spawn() does not copy the page tables
+ * of the caller (glibc runs the child on the memory of the parent until the
+ * exec, like vfork()), so starting the logic does not get slower as the
+ * server grows. The dup2() calls become file actions; the logic starts
+ * with an empty signal mask and the default SIGPIPE action.
+ *
+ * \param infd - stdin of the logic, closed in the logic if not 0 or 1
+ * \param outfd - stdout of the logic, closed in the logic if not 0 or 1
+ *
+ * \return pid of the logic, or -1 with errno set if it could not be started
+ */
+pid_t spawnLogic(int infd, int outfd)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask, defaults;
+    char *argv[] = { (char *) LOGIC_NAME, NULL };
+    pid_t childpid;
+    int iResult;
+
+    if ((iResult = posix_spawn_file_actions_init(&actions)) != 0) {
+        errno = iResult;
+        return -1;
+    }
+    if ((iResult = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        errno = iResult;
+        return -1;
+    }
+
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+
+    iResult = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    if (iResult == 0) iResult = posix_spawnattr_setsigmask(&attr, &mask);
+    if (iResult == 0) iResult = posix_spawnattr_setsigdefault(&attr, &defaults);
+    if (iResult == 0) iResult = posix_spawn_file_actions_adddup2(&actions, infd, 0);
+    if (iResult == 0) iResult = posix_spawn_file_actions_adddup2(&actions, outfd, 1);
+    if (iResult == 0 && infd > 1) iResult = posix_spawn_file_actions_addclose(&actions, infd);
+    if (iResult == 0 && outfd > 1 && outfd != infd) iResult = posix_spawn_file_actions_addclose(&actions, outfd);
+    if (iResult == 0) iResult = posix_spawn(&childpid, LOGIC_PATH, &actions, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (iResult != 0) {
+        errno = iResult;
+        return -1;
+    }
+
+    return childpid;
+}
+
+/**
+ * \brief bound the reads and writes of the external logic on the client socket
+ *
+ * The logic blocks on the socket as it likes, so it gets --read-timeout and
+ * --write-timeout for every single read and write instead of deadlines.
+ *
+ * \param cfd - connected client socket
+ */
+void limitLogicSocket(int cfd)
+{
+    struct timeval tv;
+
+    if (options.read_timeout > 0) {
+        tv.tv_sec = options.read_timeout / 1000;
+        tv.tv_usec = (options.read_timeout % 1000) * 1000;
+        (void) setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    if (options.write_timeout > 0) {
+        tv.tv_sec = options.write_timeout / 1000;
+        tv.tv_usec = (options.write_timeout % 1000) * 1000;
+        (void) setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+}
+
+/**
+ * \brief wait until the socket is ready or the deadline has passed
+ *
+ * \param events - POLLIN or POLLOUT
+ * \param deadline - timerNow() time, 0 for none
+ *
+ * \return 0 if ready, -1 if the deadline passed (counted) or poll() failed
+ */
+static int waitSocket(int cfd, short events, uint64_t deadline)
+{
+    struct pollfd pfd;
+    uint64_t now;
+    int n;
+
+    pfd.fd = cfd;
+    pfd.events = events;
+
+    while (1) {
+
+        now = timerNow();
+        if (deadline != 0 && now >= deadline) {
+            statsTimeout();
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        n = poll(&pfd, 1, deadline == 0 ? -1 : (int) (deadline - now));
+        if (n > 0) return 0;
+        if (n < 0 && errno != EINTR) return -1;
+    }
+}
+
+/**
+ * \brief peek at the first byte of a connection to tell text from binary requests
+ *
+ * Waits no longer than --read-timeout (and --total-timeout), so a client
+ * sending nothing does not hold the process.
+ *
+ * \return 1 if the byte has arrived, 0 if the client closed, -1 if the
+ *         deadline passed (counted) or the socket failed
+ */
+static ssize_t peekFirst(int cfd, char *first)
+{
+    uint64_t now = timerNow();
+    uint64_t deadline = timerEarliest(timerDeadline(now, options.read_timeout), timerDeadline(now, options.total_timeout));
+    ssize_t n;
+
+    while (1) {
+        n = recv(cfd, first, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n >= 0) return n;
+        if (errno == EINTR) continue;
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitSocket(cfd, POLLIN, deadline) == 0) continue;
+        return -1;
+    }
+}
+
+/**
+ * \brief receive a request from a blocking socket until it is complete or invalid
+ *
+ * Bytes of a pipelined request already received are parsed first.
+ *
+ * \param deadline - timerNow() time the request must be complete by, 0 for none
+ *
+ * \return the final state, or -1 if the socket or the memory failed, the
+ *         deadline passed or the client closed a keep-alive connection
+ *         between two requests
+ */
+static int receiveRequest(int cfd, sms_request_t *request, uint64_t deadline)
+{
+    sms_request_state_t state = requestParse(request, 0);
+    ssize_t n;
+
+    while (state != REQUEST_COMPLETE && state != REQUEST_INVALID) {
+
+        if (bufferReserve(&request->raw, READ_CHUNK) < 0) return -1;
+
+        /* only wait when there is nothing to read, most requests are there already */
+        n = recv(cfd, request->raw.data + request->raw.len, request->raw.cap - request->raw.len, MSG_DONTWAIT);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitSocket(cfd, POLLIN, deadline) == 0) continue;
+            return -1;
+        }
+
+        if (n == 0 && request->raw.len == 0 && request->sequence > 0) return -1;
+
+        statsBytesIn((size_t) n);
+        request->raw.len += (size_t) n;
+        state = requestParse(request, n == 0);
+    }
+
+    return (int) state;
+}
+
+/**
+ * \brief answer a request with the external logic run in a child
+ *
+ * The logic gets the request as text in a memfd; its output is collected
+ * and appended in the format of the request.
+ *
+ * \param request - complete request
+ * \param response - buffer the response is appended to
+ *
+ * \return 0 on success, -1 on error
+ */
+static int respondExternal(const sms_request_t *request, sms_buffer_t *response)
+{
+    sms_buffer_t text = { NULL, 0, 0, 0 };
+    sms_buffer_t output = { NULL, 0, 0, 0 };
+    sms_response_t framed;
+    int requestFd, pipeFds[2] = { -1, -1 }, status, iResult = -1;
+    pid_t childpid;
+    uint64_t forkStart;
+    ssize_t n;
+
+    if ((requestFd = memfd_create("simple_message_request", MFD_CLOEXEC)) < 0 ||
+        requestToText(request, &text) < 0 ||
+        write(requestFd, text.data, text.len) != (ssize_t) text.len ||
+        lseek(requestFd, 0, SEEK_SET) < 0 ||
+        pipe2(pipeFds, O_CLOEXEC) < 0) {
+        printError("HANDLER-memfd_create()", "Could not store request");
+        goto out;
+    }
+
+    forkStart = statsNow();
+    childpid = spawnLogic(requestFd, pipeFds[1]);
+    statsSpawn(forkStart);
+
+    close(pipeFds[1]);
+    pipeFds[1] = -1;
+
+    if (childpid < (pid_t) 0) {
+        printError("HANDLER-posix_spawn()", "Could not start simple_message_server_logic");
+        goto out;
+    }
+
+    while (1) {
+        if (bufferReserve(&output, READ_CHUNK) < 0) break;
+        n = read(pipeFds[0], output.data + output.len, output.cap - output.len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        output.len += (size_t) n;
+    }
+
+    /* ECHILD if an engine lets the kernel reap its children */
+    while (waitpid(childpid, &status, 0) < 0 && errno == EINTR);
+
+    iResult = responseBegin(&framed, response, request);
+    if (iResult == 0) iResult = responseAddText(&framed, output.data, output.len);
+    if (iResult == 0) responseEnd(&framed);
+
+out:
+    if (requestFd >= 0) close(requestFd);
+    if (pipeFds[0] >= 0) close(pipeFds[0]);
+    if (pipeFds[1] >= 0) close(pipeFds[1]);
+    bufferFree(&text);
+    bufferFree(&output);
+    return iResult;
+}
+
+/**
+ * \brief replace the calling (child) process by the server logic serving cfd
+ *
+ * A text request is read by the logic straight from the socket. The logic
+ * does not know binary requests, so those connections are served by
+ * serveConnection(), which runs the logic once per request.
+ *
+ * \param cfd - connected client socket
+ */
+void execLogicOnConnection(int cfd)
+{
+    char first;
+    ssize_t n;
+
+    if ((n = peekFirst(cfd, &first)) < 0) {
+        if (close(cfd) < 0 ) {
+            printError("HANDLER-close()", "Could not close CHILD socket");
+        }
+        exit(1);
+    }
+
+    if (n == 0 || first != PROTOCOL_MAGIC[0]) {
+        limitLogicSocket(cfd);
+        execLogic(cfd, cfd);
+    }
+
+    exit(serveConnection(cfd) == 0 ? 0 : 1);
+}
+
+/**
+ * \brief serve one connection in the calling process
+ *
+ * Reads a request until it is complete (a text request when the client
+ * half-closes) and answers it with the configured logic. Keep-alive
+ * connections carry further requests; requests which are already received
+ * are answered together before the responses are sent. The connection is
+ * dropped when a deadline passes. \a cfd is closed at the end.
+ *
+ * \param cfd - connected (blocking) client socket
+ *
+ * \return 0 if all responses were sent, -1 otherwise
+ */
+int serveConnection(int cfd)
+{
+    sms_request_t request = { 0 };
+    sms_buffer_t response = { NULL, 0, 0, 0 };
+    int state, keepAlive = 1, iResult = -1;
+    uint64_t requestStart, deadline, total = timerDeadline(timerNow(), options.total_timeout);
+    ssize_t n;
+
+    while (keepAlive) {
+
+        deadline = timerEarliest(timerDeadline(timerNow(), options.read_timeout), total);
+        if ((state = receiveRequest(cfd, &request, deadline)) < 0) {
+            /* end of a keep-alive connection */
+            if (request.sequence > 0 && request.raw.len == 0) iResult = 0;
+            goto out;
+        }
+
+        requestStart = statsNow();
+        if (options.logic != SMS_LOGIC_EXEC || state != REQUEST_COMPLETE) {
+            if (logicRespond(&request, &response) < 0) goto out;
+        } else {
+            if (respondExternal(&request, &response) < 0) goto out;
+        }
+        if (state == REQUEST_COMPLETE) statsRequest(requestStart);
+
+        keepAlive = state == REQUEST_COMPLETE && request.keep_alive;
+        if (keepAlive) {
+            requestNext(&request);
+            /* pipelined request already here: answer it before sending */
+            if (requestParse(&request, 0) == REQUEST_COMPLETE) continue;
+        }
+
+        deadline = timerEarliest(timerDeadline(timerNow(), options.write_timeout), total);
+        while (bufferPending(&response) > 0) {
+            n = send(cfd, response.data + response.off, bufferPending(&response), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitSocket(cfd, POLLOUT, deadline) == 0) continue;
+                goto out;
+            }
+            statsBytesOut((size_t) n);
+            bufferConsume(&response, (size_t) n);
+        }
+        bufferReset(&response);
+    }
+
+    iResult = 0;
+
+out:
+    if (close(cfd) < 0 ) {
+        printError("HANDLER-close()", "Could not close CHILD socket");
+    }
+
+    requestFree(&request);
+    bufferFree(&response);
+    return iResult;
+}
+
+/**
+ * \brief serve one connection and wait until it is finished
+ *
+ * Used by engines whose processes outlive a single connection. The built-in
+ * logic and a handler plugin run in the calling process. The external logic
+ * is spawned on the socket for a text request, and the caller blocks until
+ * the request has been answered; binary requests are served by
+ * serveConnection(), which spawns the logic for every request. \a cfd is
+ * always closed.
+ *
+ * \param cfd - connected client socket
+ *
+ * \return 0 if the connection was served successfully, -1 otherwise
+ */
+int handleConnection(int cfd)
+{
+    pid_t childpid;
+    uint64_t forkStart;
+    int status;
+    char first;
+    ssize_t n;
+
+    if (options.logic != SMS_LOGIC_EXEC) return serveConnection(cfd);
+
+    if ((n = peekFirst(cfd, &first)) < 0) {
+        if (close(cfd) < 0 ) {
+            printError("HANDLER-close()", "Could not close CHILD socket");
+        }
+        return -1;
+    }
+
+    if (n > 0 && first == PROTOCOL_MAGIC[0]) return serveConnection(cfd);
+
+    //RESET save_errno
+    save_errno = 0;
+
+    limitLogicSocket(cfd);
+
+    forkStart = statsNow();
+    childpid = spawnLogic(cfd, cfd);
+    statsSpawn(forkStart);
+
+    if (childpid < (pid_t) 0) {
+        printError("HANDLER-posix_spawn()", "Could not start simple_message_server_logic");
+    }
+
+    //CLOSE CHILD SOCKET
+    if (close(cfd) < 0 ) {
+        printError("HANDLER-close()", "Could not close CHILD socket");
+    }
+
+    if (childpid < (pid_t) 0) return -1;
+
+    while (waitpid(childpid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            printError("HANDLER-waitpid()", "Could not wait for simple_message_server_logic");
+            return -1;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+
+    return 0;
+}
+
+/**
+ * \brief turn a connection away because the server is overloaded
+ *
+ * Answers with PROTOCOL_STATUS_BUSY in the format of the request, as far
+ * as it has arrived, and never blocks. A binary response carries the id of
+ * the first request if its header is already there. What has arrived of
+ * the request is read before closing, so the answer is not lost to a
+ * connection reset. \a cfd is always closed.
+ *
+ * \param cfd - connected client socket
+ */
+void rejectBusy(int cfd)
+{
+    unsigned char head[PROTOCOL_PREAMBLE_SIZE + PROTOCOL_HEADER_SIZE];
+    char drain[READ_CHUNK];
+    sms_request_t request = { 0 };
+    sms_buffer_t reply = { NULL, 0, 0, 0 };
+    sms_response_t framed;
+    protocol_header_t header;
+    size_t drained = 0;
+    ssize_t n;
+
+    n = recv(cfd, head, sizeof(head), MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0 && head[0] == PROTOCOL_MAGIC[0]) {
+        request.version = PROTOCOL_VERSION;
+        if (n == (ssize_t) sizeof(head)) {
+            protocolGetHeader(head + PROTOCOL_PREAMBLE_SIZE, &header);
+            request.id = header.id;
+        }
+    }
+
+    if (responseBegin(&framed, &reply, &request) == 0 &&
+        responseAddStatus(&framed, PROTOCOL_STATUS_BUSY) == 0) {
+        responseEnd(&framed);
+        if (send(cfd, reply.data + reply.off, bufferPending(&reply), MSG_DONTWAIT | MSG_NOSIGNAL) > 0) {
+            statsBytesOut(bufferPending(&reply));
+        }
+    }
+    (void) shutdown(cfd, SHUT_WR);
+
+    while (drained < BUSY_DRAIN_MAX && (n = recv(cfd, drain, sizeof(drain), MSG_DONTWAIT)) > 0) {
+        drained += (size_t) n;
+    }
+
+    statsBusy();
+    bufferFree(&reply);
+
+    if (close(cfd) < 0 ) {
+        printError("HANDLER-close()", "Could not close CHILD socket");
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * @file simple_message_server_handler.h
+ * TCP/IP Server-Client project
+ *
+ * Serving of a single accepted connection by the server logic.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_HANDLER_H
+#define SIMPLE_MESSAGE_SERVER_HANDLER_H
+
+#include <sys/types.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define LOGIC_PATH "/usr/local/bin/simple_message_server_logic"
+#define LOGIC_NAME "simple_message_server_logic"
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void execLogic(int infd, int outfd);
+pid_t spawnLogic(int infd, int outfd);
+void limitLogicSocket(int cfd);
+void execLogicOnConnection(int cfd);
+int serveConnection(int cfd);
+int handleConnection(int cfd);
+void rejectBusy(int cfd);
+
+#endif
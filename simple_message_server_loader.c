@@ -0,0 +1,174 @@
+/**
+ * @file simple_message_server_loader.c
+ * TCP/IP Server-Client project
+ *
+ * Loading and calling of handler plugins (see simple_message_server_plugin.h).
+ *
+ * The handler is opened once in the main process, before the engine starts,
+ * so every process the engine forks inherits the loaded handler and the
+ * state its init() built. A handler which is not SMS_PLUGIN_THREAD_SAFE is
+ * called under a mutex, which only matters for the sharded engine.
+ *
+ * The response starts with STATUS_OK and gets the files of the handler
+ * appended as they come. If the handler fails, what it appended is cut off
+ * again and the response is an error status.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server.h"
+#include "simple_message_server_loader.h"
+#include "simple_message_server_plugin.h"
+#include "simple_message_server_response.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** what sms_plugin_response_t stands for */
+struct sms_plugin_response
+{
+    sms_response_t framed;
+    int failed;             /* a file could not be appended */
+};
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static const sms_plugin_t *spPlugin;
+static void *vpState;
+static pid_t loaderPid;     /* the process which ran init() and runs shutdown() */
+static pthread_mutex_t handlerLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int hostAddFile(sms_plugin_response_t *response, const char *name, const void *data, size_t len);
+static void loaderClose(void);
+
+static const sms_plugin_host_t host = { SMS_PLUGIN_ABI_VERSION, hostAddFile };
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static int hostAddFile(sms_plugin_response_t *response, const char *name, const void *data, size_t len)
+{
+    if (response->failed || responseAddFile(&response->framed, name, data, len) < 0) {
+        response->failed = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief shut the handler down, in the process which opened it only
+ */
+static void loaderClose(void)
+{
+    if (spPlugin == NULL || getpid() != loaderPid) return;
+
+    if (spPlugin->shutdown != NULL) spPlugin->shutdown(vpState);
+    spPlugin = NULL;
+}
+
+/**
+ * \brief open a handler plugin and run its init() - exits the server on failure
+ *
+ * \param cpPath - shared object, looked up like dlopen() does if it has no slash
+ * \param cpArg - argument for init(), NULL for none
+ */
+void loaderOpen(const char *cpPath, const char *cpArg)
+{
+    void *handle;
+
+    //RESET save_errno
+    save_errno = 0;
+
+    if ((handle = dlopen(cpPath, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        printError("LOADER-dlopen()", dlerror());
+        exitOnError();
+    }
+
+    if ((spPlugin = dlsym(handle, SMS_PLUGIN_SYMBOL)) == NULL) {
+        printError("LOADER-dlsym()", "Handler does not export " SMS_PLUGIN_SYMBOL);
+        exitOnError();
+    }
+
+    if (spPlugin->abi_version < 1 || spPlugin->abi_version > SMS_PLUGIN_ABI_VERSION ||
+        spPlugin->handle_request == NULL) {
+        printError("LOADER-dlsym()", "Handler was built for another server");
+        exitOnError();
+    }
+
+    if (spPlugin->init != NULL && spPlugin->init(&host, cpArg, &vpState) < 0) {
+        printError("LOADER-init()", "Handler could not be initialized");
+        exitOnError();
+    }
+
+    loaderPid = getpid();
+    atexit(loaderClose);
+}
+
+/**
+ * \brief answer a complete request with the loaded handler
+ *
+ * \param request - complete request
+ * \param response - buffer the framed response is appended to
+ *
+ * \return 0 on success, -1 if the response could not be built (out of memory)
+ */
+int loaderRespond(const sms_request_t *request, sms_buffer_t *response)
+{
+    sms_plugin_request_t in;
+    sms_plugin_response_t out;
+    size_t start = bufferPending(response);
+    int iResult;
+
+    in.user = request->raw.data + request->user_off;
+    in.user_len = request->user_len;
+    in.image = request->has_image ? request->raw.data + request->image_off : NULL;
+    in.image_len = request->has_image ? request->image_len : 0;
+    in.message = request->raw.data + request->message_off;
+    in.message_len = request->message_len;
+
+    out.failed = 0;
+    if (responseBegin(&out.framed, response, request) < 0 ||
+        responseAddStatus(&out.framed, STATUS_OK) < 0) return -1;
+
+    if (!(spPlugin->flags & SMS_PLUGIN_THREAD_SAFE)) pthread_mutex_lock(&handlerLock);
+    iResult = spPlugin->handle_request(vpState, &in, &out);
+    if (!(spPlugin->flags & SMS_PLUGIN_THREAD_SAFE)) pthread_mutex_unlock(&handlerLock);
+
+    if (out.failed) return -1;
+
+    if (iResult < 0) {
+        /* drop the files of the failed handler, keep what was pending before */
+        response->len = response->off + start;
+        if (responseBegin(&out.framed, response, request) < 0 ||
+            responseAddStatus(&out.framed, STATUS_ERROR) < 0) return -1;
+    }
+
+    responseEnd(&out.framed);
+    return 0;
+}
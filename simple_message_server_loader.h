@@ -0,0 +1,32 @@
+/**
+ * @file simple_message_server_loader.h
+ * TCP/IP Server-Client project
+ *
+ * Loading and calling of handler plugins.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_LOADER_H
+#define SIMPLE_MESSAGE_SERVER_LOADER_H
+
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_request.h"
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void loaderOpen(const char *cpPath, const char *cpArg);
+int loaderRespond(const sms_request_t *request, sms_buffer_t *response);
+
+#endif
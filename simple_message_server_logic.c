@@ -0,0 +1,700 @@
+/**
+ * @file simple_message_server_logic.c
+ * TCP/IP Server-Client project
+ *
+ * Built-in bulletin board logic of the simple_message_server.
+ *
+ * Every post is appended as one line to the board file:
+ *
+ *     <unix time>\t<user>\t<image url>\t<message>\n
+ *
+ * with backslash, tab and newline escaped inside the fields. The response
+ * is the rendered HTML page of the whole board. The board file is locked
+ * with flock() for every access, so any number of processes and threads
+ * can share it.
+ *
+ * The length of the board file is the version of the page. A client that
+ * reports holding the page of an earlier version gets just the posts added
+ * since, to be inserted behind the page header.
+ *
+ * With --store the posts go to the message store instead (see
+ * simple_message_server_store.c), and the sequence number of the newest
+ * post is the version.
+ *
+ * The hashes of the pages of recent versions are remembered in a table
+ * shared by all processes and threads, so a patch is made without
+ * rendering the page the client holds once more. Every entry carries a tag
+ * of the board line its version ends on, which keeps a board file that was
+ * rewritten from matching the hashes of its former content. A client
+ * holding a version no longer remembered gets the whole page.
+ *
+ * Every thread keeps the page it rendered last and brings it up to date by
+ * rendering just the posts added since, so the cost of a post does not
+ * grow with the number of posts rendered before. The children of the fork
+ * engine start with an empty cache and render the whole page.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server.h"
+#include "simple_message_server_loader.h"
+#include "simple_message_server_logic.h"
+#include "simple_message_server_response.h"
+#include "simple_message_server_store.h"
+#include "simple_message_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define PAGE_HEADER \
+    "<!DOCTYPE html>\n" \
+    "<html>\n" \
+    "<head><meta charset=\"utf-8\"><title>Bulletin Board</title></head>\n" \
+    "<body>\n" \
+    "<h1>Bulletin Board</h1>\n"
+#define PAGE_FOOTER \
+    "</body>\n" \
+    "</html>\n"
+
+/* number of fields of a board line */
+#define FIELD_COUNT 4
+
+/* versions whose page hash is remembered (a power of two) */
+#define PAGE_HASH_BITS 10
+#define PAGE_HASH_SLOTS (1U << PAGE_HASH_BITS)
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** the hash of the page of one version, check guards against torn writes */
+typedef struct
+{
+    uint64_t version;
+    uint64_t oldest;        /* version the page starts behind */
+    uint64_t tag;           /* boardTag() of the version */
+    uint64_t hash;
+    uint64_t check;         /* protocolHash() of the fields above */
+} page_hash_t;
+
+/** the page a thread rendered last */
+typedef struct
+{
+    int valid;
+    uint64_t version;
+    uint64_t oldest;
+    uint64_t tag;
+    uint64_t hash;
+    sms_buffer_t page;
+} page_cache_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static page_hash_t *spPageHashes;
+static _Thread_local page_cache_t sPageCache;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int appendEscaped(sms_buffer_t *line, const char *data, size_t len);
+static size_t unescape(char *out, const char *data, size_t len);
+static int appendHtml(sms_buffer_t *page, const char *data, size_t len);
+static int appendPost(const sms_request_t *request);
+static int readBoard(sms_buffer_t *board);
+static int renderPost(sms_buffer_t *page, const sms_post_t *post);
+static int renderEntry(sms_buffer_t *page, sms_buffer_t *scratch, const char *line, size_t len);
+static int renderEntries(sms_buffer_t *page, const char *data, size_t len);
+static int renderStored(sms_buffer_t *page, uint64_t from, uint64_t to);
+static int renderPosts(sms_buffer_t *page, const sms_buffer_t *board, uint64_t from, uint64_t to);
+static uint64_t boardTag(const sms_buffer_t *board, uint64_t version);
+static page_hash_t *pageHashSlot(uint64_t version);
+static int pageHashFind(uint64_t version, uint64_t oldest, uint64_t tag, uint64_t *pHash);
+static void pageHashRemember(uint64_t version, uint64_t oldest, uint64_t tag, uint64_t hash);
+static int pageCacheUpdate(const sms_buffer_t *board, uint64_t version, uint64_t oldest, uint64_t tag,
+                           const sms_buffer_t *patch, uint64_t patchFrom);
+static int renderBoard(const sms_request_t *request, sms_buffer_t *page, uint64_t *pVersion, int *pPatch);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief append a field to a board line, escaping the separators
+ */
+static int appendEscaped(sms_buffer_t *line, const char *data, size_t len)
+{
+    size_t i;
+    int iResult = 0;
+
+    for (i = 0; i < len && iResult == 0; i++) {
+        switch (data[i]) {
+        case '\\': iResult = bufferAppend(line, "\\\\", 2); break;
+        case '\t': iResult = bufferAppend(line, "\\t", 2); break;
+        case '\n': iResult = bufferAppend(line, "\\n", 2); break;
+        default: iResult = bufferAppend(line, &data[i], 1); break;
+        }
+    }
+
+    return iResult;
+}
+
+/**
+ * \brief undo appendEscaped(), out needs room for len bytes
+ *
+ * \return the length of the unescaped field
+ */
+static size_t unescape(char *out, const char *data, size_t len)
+{
+    size_t i, j;
+
+    for (i = 0, j = 0; i < len; i++, j++) {
+        if (data[i] == '\\' && i + 1 < len) {
+            i++;
+            out[j] = data[i] == 't' ? '\t' : (data[i] == 'n' ? '\n' : data[i]);
+        } else {
+            out[j] = data[i];
+        }
+    }
+
+    return j;
+}
+
+/**
+ * \brief append text to the page with the HTML special characters escaped
+ */
+static int appendHtml(sms_buffer_t *page, const char *data, size_t len)
+{
+    size_t i, start = 0;
+    const char *entity;
+
+    for (i = 0; i < len; i++) {
+        switch (data[i]) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\'': entity = "&#39;"; break;
+        default: continue;
+        }
+        if (bufferAppend(page, data + start, i - start) < 0 ||
+            bufferAppend(page, entity, strlen(entity)) < 0) return -1;
+        start = i + 1;
+    }
+
+    return bufferAppend(page, data + start, len - start);
+}
+
+/**
+ * \brief append the post of the request to the board file
+ *
+ * \return 0 on success, -1 on error
+ */
+static int appendPost(const sms_request_t *request)
+{
+    const char *data = request->raw.data;
+    sms_buffer_t line = { NULL, 0, 0, 0 };
+    sms_post_t post;
+    ssize_t n;
+    size_t written = 0;
+    int fd, iResult = -1;
+
+    if (options.store_path != NULL) {
+        post.time = (int64_t) time(NULL);
+        post.user = data + request->user_off;
+        post.user_len = request->user_len;
+        post.image = request->has_image ? data + request->image_off : "";
+        post.image_len = request->has_image ? request->image_len : 0;
+        post.message = data + request->message_off;
+        post.message_len = request->message_len;
+
+        if ((iResult = storeAppend(&post)) < 0) printError("LOGIC-storeAppend()", "Could not append post to store");
+        return iResult;
+    }
+
+    if (bufferPrintf(&line, "%ld\t", (long) time(NULL)) < 0 ||
+        appendEscaped(&line, data + request->user_off, request->user_len) < 0 ||
+        bufferAppend(&line, "\t", 1) < 0 ||
+        (request->has_image && appendEscaped(&line, data + request->image_off, request->image_len) < 0) ||
+        bufferAppend(&line, "\t", 1) < 0 ||
+        appendEscaped(&line, data + request->message_off, request->message_len) < 0 ||
+        bufferAppend(&line, "\n", 1) < 0) {
+        bufferFree(&line);
+        return -1;
+    }
+
+    if ((fd = open(options.board_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        printError("LOGIC-open()", "Could not open board");
+        bufferFree(&line);
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX) == 0) {
+        while (written < line.len) {
+            if ((n = write(fd, line.data + written, line.len - written)) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            written += (size_t) n;
+        }
+        if (written == line.len) iResult = 0;
+    }
+
+    if (iResult < 0) printError("LOGIC-write()", "Could not append post to board");
+
+    close(fd);
+    bufferFree(&line);
+    return iResult;
+}
+
+/**
+ * \brief read the whole board file
+ *
+ * \return 0 on success (also if there is no board yet), -1 on error
+ */
+static int readBoard(sms_buffer_t *board)
+{
+    struct stat st;
+    ssize_t n;
+    int fd, iResult = 0;
+
+    if ((fd = open(options.board_path, O_RDONLY | O_CLOEXEC)) < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    if (flock(fd, LOCK_SH) < 0 || fstat(fd, &st) < 0 ||
+        bufferReserve(board, (size_t) st.st_size + 1) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    while (1) {
+        if (bufferReserve(board, 4096) < 0) {
+            iResult = -1;
+            break;
+        }
+        n = read(fd, board->data + board->len, board->cap - board->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) iResult = -1;
+            break;
+        }
+        board->len += (size_t) n;
+    }
+
+    close(fd);
+    return iResult;
+}
+
+/**
+ * \brief render one post as HTML
+ */
+static int renderPost(sms_buffer_t *page, const sms_post_t *post)
+{
+    char cTime[64];
+    time_t timestamp = (time_t) post->time;
+    struct tm tmPost;
+
+    if (localtime_r(&timestamp, &tmPost) == NULL ||
+        strftime(cTime, sizeof(cTime), "%Y-%m-%d %H:%M:%S", &tmPost) == 0) {
+        cTime[0] = '\0';
+    }
+
+    if (bufferPrintf(page, "<div class=\"post\">\n<p class=\"meta\"><b>") < 0 ||
+        appendHtml(page, post->user, post->user_len) < 0 ||
+        bufferPrintf(page, "</b> %s</p>\n", cTime) < 0) return -1;
+
+    if (post->image_len > 0) {
+        if (bufferPrintf(page, "<img src=\"") < 0 ||
+            appendHtml(page, post->image, post->image_len) < 0 ||
+            bufferPrintf(page, "\" alt=\"\">\n") < 0) return -1;
+    }
+
+    if (bufferPrintf(page, "<p>") < 0 ||
+        appendHtml(page, post->message, post->message_len) < 0 ||
+        bufferPrintf(page, "</p>\n</div>\n") < 0) return -1;
+
+    return 0;
+}
+
+/**
+ * \brief render one board line as HTML
+ *
+ * The fields are unescaped into scratch, the board itself is left as it is:
+ * boardTag() and later renderings still need the original line.
+ */
+static int renderEntry(sms_buffer_t *page, sms_buffer_t *scratch, const char *line, size_t len)
+{
+    char *field[FIELD_COUNT];
+    size_t fieldLen[FIELD_COUNT];
+    const char *start = line, *tab;
+    sms_post_t post;
+    int i;
+
+    bufferReset(scratch);
+    if (bufferReserve(scratch, len) < 0) return -1;
+
+    for (i = 0; i < FIELD_COUNT; i++) {
+        tab = i < FIELD_COUNT - 1 ? memchr(line, '\t', len) : NULL;
+        if (tab == NULL) {
+            if (i < FIELD_COUNT - 1) return 0; /* damaged line - skip it */
+            fieldLen[i] = len;
+        } else {
+            fieldLen[i] = (size_t) (tab - line);
+        }
+        field[i] = scratch->data + scratch->len;
+        fieldLen[i] = unescape(field[i], line, fieldLen[i]);
+        scratch->len += fieldLen[i];
+        if (tab != NULL) {
+            len -= (size_t) (tab - line) + 1;
+            line = tab + 1;
+        }
+    }
+
+    /* read on the board line, where the tab behind it ends the number */
+    post.time = (int64_t) strtol(start, NULL, 10);
+    post.user = field[1];
+    post.user_len = fieldLen[1];
+    post.image = field[2];
+    post.image_len = fieldLen[2];
+    post.message = field[3];
+    post.message_len = fieldLen[3];
+
+    return renderPost(page, &post);
+}
+
+/**
+ * \brief render the board lines in data as HTML, newest post first
+ */
+static int renderEntries(sms_buffer_t *page, const char *data, size_t len)
+{
+    const char *end = data + len, *start;
+    sms_buffer_t scratch = { NULL, 0, 0, 0 };
+    int iResult = 0;
+
+    /* walk the lines backwards */
+    while (iResult == 0 && len > 0 && end > data) {
+        if (end[-1] == '\n') end--;
+        start = end;
+        while (start > data && start[-1] != '\n') start--;
+        if (end > start) iResult = renderEntry(page, &scratch, start, (size_t) (end - start));
+        end = start;
+    }
+
+    bufferFree(&scratch);
+    return iResult;
+}
+
+/**
+ * \brief render the posts of the store with sequence numbers from + 1 to to, newest first
+ *
+ * Posts the compaction has deleted meanwhile are left out.
+ */
+static int renderStored(sms_buffer_t *page, uint64_t from, uint64_t to)
+{
+    sms_post_t post;
+    uint64_t seq;
+
+    for (seq = to; seq > from; seq--) {
+        if (storeGet(seq, &post) < 0) continue;
+        if (renderPost(page, &post) < 0) return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief render the posts between two versions of the board, newest first
+ *
+ * \param board - the board file (not used with the store)
+ * \param from - version the posts follow
+ * \param to - version the posts lead up to
+ */
+static int renderPosts(sms_buffer_t *page, const sms_buffer_t *board, uint64_t from, uint64_t to)
+{
+    if (options.store_path != NULL) return renderStored(page, from, to);
+
+    return renderEntries(page, board->data + from, (size_t) (to - from));
+}
+
+/**
+ * \brief create the table of page hashes - before any worker is started
+ */
+void logicInit(void)
+{
+    spPageHashes = mmap(NULL, sizeof(page_hash_t) * PAGE_HASH_SLOTS, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (spPageHashes == MAP_FAILED) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("LOGIC-mmap()", "Could not create page hash table");
+        exitOnError();
+    }
+}
+
+/**
+ * \brief tell apart versions of the same number but of different content
+ *
+ * \return hash of the board line the version ends on, 0 with the store
+ */
+static uint64_t boardTag(const sms_buffer_t *board, uint64_t version)
+{
+    uint64_t start;
+
+    if (options.store_path != NULL || version == 0) return 0;
+
+    for (start = version - 1; start > 0 && board->data[start - 1] != '\n'; start--);
+    return protocolHash(board->data + start, (size_t) (version - start));
+}
+
+static page_hash_t *pageHashSlot(uint64_t version)
+{
+    return &spPageHashes[(version * 0x9e3779b97f4a7c15ULL) >> (64 - PAGE_HASH_BITS)];
+}
+
+/**
+ * \brief look up the hash of the page of a version
+ *
+ * \return 1 if it is known, 0 if not
+ */
+static int pageHashFind(uint64_t version, uint64_t oldest, uint64_t tag, uint64_t *pHash)
+{
+    page_hash_t *slot, entry;
+
+    if (spPageHashes == NULL) return 0;
+
+    slot = pageHashSlot(version);
+    entry.version = __atomic_load_n(&slot->version, __ATOMIC_RELAXED);
+    entry.oldest = __atomic_load_n(&slot->oldest, __ATOMIC_RELAXED);
+    entry.tag = __atomic_load_n(&slot->tag, __ATOMIC_RELAXED);
+    entry.hash = __atomic_load_n(&slot->hash, __ATOMIC_RELAXED);
+    entry.check = __atomic_load_n(&slot->check, __ATOMIC_RELAXED);
+
+    /* an entry half written by another process fails the check */
+    if (entry.version != version || entry.oldest != oldest || entry.tag != tag ||
+        entry.check != protocolHash(&entry, offsetof(page_hash_t, check))) return 0;
+
+    *pHash = entry.hash;
+    return 1;
+}
+
+/**
+ * \brief remember the hash of the page of a version, replacing the one in its slot
+ */
+static void pageHashRemember(uint64_t version, uint64_t oldest, uint64_t tag, uint64_t hash)
+{
+    page_hash_t *slot, entry;
+
+    if (spPageHashes == NULL) return;
+
+    entry.version = version;
+    entry.oldest = oldest;
+    entry.tag = tag;
+    entry.hash = hash;
+    entry.check = protocolHash(&entry, offsetof(page_hash_t, check));
+
+    slot = pageHashSlot(version);
+    __atomic_store_n(&slot->version, entry.version, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->oldest, entry.oldest, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->tag, entry.tag, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->hash, entry.hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->check, entry.check, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief bring the page cache of the calling thread up to a version and remember its hash
+ *
+ * Only the posts added since the cached version are put in front of the
+ * older ones, taken from patch if it starts there and rendered otherwise.
+ * The page is rendered anew only if the cache is empty, newer, or starts
+ * behind another version.
+ *
+ * \param board - the board file (not used with the store)
+ * \param tag - boardTag() of the version
+ * \param patch - posts already rendered from patchFrom up to the version, or NULL
+ *
+ * \return 0 on success, -1 on error
+ */
+static int pageCacheUpdate(const sms_buffer_t *board, uint64_t version, uint64_t oldest, uint64_t tag,
+                           const sms_buffer_t *patch, uint64_t patchFrom)
+{
+    page_cache_t *cache = &sPageCache;
+    sms_buffer_t rendered = { NULL, 0, 0, 0 };
+    const sms_buffer_t *added = &rendered;
+    size_t headerLen = strlen(PAGE_HEADER);
+    int iResult = 0;
+
+    /* up to date already - its hash may have been pushed out of the table since */
+    if (cache->valid && cache->version == version && cache->oldest == oldest && cache->tag == tag) {
+        pageHashRemember(version, oldest, cache->tag, cache->hash);
+        return 0;
+    }
+
+    if (cache->valid && cache->version < version && cache->oldest == oldest &&
+        cache->tag == boardTag(board, cache->version)) {
+        if (patch != NULL && patchFrom == cache->version) {
+            added = patch;
+        } else if (renderPosts(&rendered, board, cache->version, version) < 0) {
+            iResult = -1;
+        }
+        if (iResult == 0 && bufferReserve(&cache->page, added->len) < 0) iResult = -1;
+        if (iResult == 0) {
+            memmove(cache->page.data + headerLen + added->len, cache->page.data + headerLen,
+                    cache->page.len - headerLen);
+            memcpy(cache->page.data + headerLen, added->data, added->len);
+            cache->page.len += added->len;
+        }
+    } else {
+        bufferReset(&cache->page);
+        if (bufferAppend(&cache->page, PAGE_HEADER, headerLen) < 0 ||
+            renderPosts(&cache->page, board, oldest, version) < 0 ||
+            bufferAppend(&cache->page, PAGE_FOOTER, strlen(PAGE_FOOTER)) < 0) iResult = -1;
+    }
+
+    bufferFree(&rendered);
+    if (iResult < 0) {
+        cache->valid = 0;
+        return -1;
+    }
+
+    cache->valid = 1;
+    cache->version = version;
+    cache->oldest = oldest;
+    cache->tag = tag;
+    cache->hash = protocolHash(cache->page.data, cache->page.len);
+    pageHashRemember(version, oldest, cache->tag, cache->hash);
+    return 0;
+}
+
+/**
+ * \brief render the HTML page of the whole board, or the patch to the client's copy
+ *
+ * The client's copy is patched if it is the page of a version that ends on
+ * a line of the board (any version of the store that is still kept) and its
+ * hash matches the one remembered for that version. Then page gets just the
+ * posts added since, otherwise the whole page, from the page cache.
+ *
+ * \param request - request naming the copy the client holds, if any
+ * \param page [OUT] - page or patch, empty on entry
+ * \param pVersion [OUT] - version of the page
+ * \param pPatch [OUT] - non-zero if page is a patch, inserted behind PAGE_HEADER
+ *
+ * \return 0 on success, -1 on error
+ */
+static int renderBoard(const sms_request_t *request, sms_buffer_t *page, uint64_t *pVersion, int *pPatch)
+{
+    const sms_known_file_t *known = requestKnownFile(request, BOARD_FILE_NAME);
+    sms_buffer_t board = { NULL, 0, 0, 0 };
+    uint64_t oldest = 0, version, baseVersion = 0, tag, baseTag, hash;
+    int iResult;
+
+    *pPatch = 0;
+
+    if (options.store_path != NULL) {
+        /* the page starts behind the posts the store no longer keeps */
+        if (storeRange(&oldest, &version) < 0) return -1;
+        oldest--;
+
+        if (known != NULL && known->has_version && known->version <= version) baseVersion = known->version;
+    } else {
+        if (readBoard(&board) < 0) {
+            bufferFree(&board);
+            return -1;
+        }
+        version = board.len;
+
+        if (known != NULL && known->has_version && known->version <= board.len &&
+            (known->version == 0 || board.data[known->version - 1] == '\n')) {
+            baseVersion = known->version;
+        }
+    }
+    *pVersion = version;
+    tag = boardTag(&board, version);
+    baseTag = boardTag(&board, baseVersion);
+
+    if (baseVersion > oldest && pageHashFind(baseVersion, oldest, baseTag, &hash) && hash == known->hash) {
+        /* the posts added since the version of the client; the hash of the
+         * page it ends up with is needed for its next request */
+        *pPatch = 1;
+        iResult = renderPosts(page, &board, baseVersion, version);
+        if (iResult == 0 && !pageHashFind(version, oldest, tag, &hash)) {
+            iResult = pageCacheUpdate(&board, version, oldest, tag, page, baseVersion);
+        }
+    } else {
+        iResult = pageCacheUpdate(&board, version, oldest, tag, NULL, 0);
+        if (iResult == 0) iResult = bufferAppend(page, sPageCache.page.data, sPageCache.page.len);
+    }
+
+    bufferFree(&board);
+    return iResult;
+}
+
+/**
+ * \brief serve a complete request: store the post and answer with the board page
+ *
+ * If the post cannot be stored, the response just carries an error status.
+ * A client holding an earlier page gets a patch instead of the page.
+ * With --handler the loaded handler plugin answers instead.
+ *
+ * \param request - complete request
+ * \param response - buffer the framed response is appended to
+ *
+ * \return 0 on success, -1 if the response could not be built (out of memory)
+ */
+int logicRespond(const sms_request_t *request, sms_buffer_t *response)
+{
+    sms_buffer_t page = { NULL, 0, 0, 0 };
+    sms_response_t framed;
+    uint64_t version;
+    int iResult, iPatch;
+
+    /* a loaded handler answers in place of the board, malformed requests still get the error status */
+    if (options.logic == SMS_LOGIC_PLUGIN && request->state == REQUEST_COMPLETE) {
+        return loaderRespond(request, response);
+    }
+
+    iResult = responseBegin(&framed, response, request);
+
+    if (request->state != REQUEST_COMPLETE || appendPost(request) < 0 ||
+        renderBoard(request, &page, &version, &iPatch) < 0) {
+        if (iResult == 0) iResult = responseAddStatus(&framed, STATUS_ERROR);
+    } else {
+        if (iResult == 0) iResult = responseAddStatus(&framed, STATUS_OK);
+        if (iResult == 0 && iPatch) {
+            iResult = responseAddPatch(&framed, BOARD_FILE_NAME, version, strlen(PAGE_HEADER), page.data, page.len);
+        } else if (iResult == 0) {
+            iResult = responseAddVersionedFile(&framed, BOARD_FILE_NAME, version, page.data, page.len);
+        }
+    }
+
+    if (iResult == 0) responseEnd(&framed);
+
+    bufferFree(&page);
+    return iResult;
+}
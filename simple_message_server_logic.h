@@ -0,0 +1,37 @@
+/**
+ * @file simple_message_server_logic.h
+ * TCP/IP Server-Client project
+ *
+ * Built-in bulletin board logic of the simple_message_server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_LOGIC_H
+#define SIMPLE_MESSAGE_SERVER_LOGIC_H
+
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_request.h"
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define BOARD_FILE_NAME "bulletin_board.html"
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void logicInit(void);
+int logicRespond(const sms_request_t *request, sms_buffer_t *response);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file simple_message_server_plugin.h
+ * TCP/IP Server-Client project
+ *
+ * C ABI of handler plugins of the simple_message_server.
+ *
+ * A handler is a shared object exporting an sms_plugin_t named
+ * SMS_PLUGIN_SYMBOL. The server loads it with dlopen() (--handler <file>)
+ * and answers every complete request by calling handle_request() in the
+ * process serving the connection, in any engine. This header is all a
+ * handler needs; it does not depend on the server's own headers.
+ *
+ * init() is called once in the main process before any connection is
+ * accepted, so forked handler processes inherit its state. State built up
+ * by handle_request() lasts as long as the process calling it: one
+ * connection with the fork engine, the life of the process with the other
+ * engines. shutdown() is called when the main process exits normally.
+ *
+ * The ABI only grows by appending members; a handler built for an older
+ * SMS_PLUGIN_ABI_VERSION keeps working.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_PLUGIN_H
+#define SIMPLE_MESSAGE_SERVER_PLUGIN_H
+
+#include <stddef.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define SMS_PLUGIN_ABI_VERSION 1
+/* name of the exported sms_plugin_t */
+#define SMS_PLUGIN_SYMBOL "sms_plugin"
+
+/* flags of sms_plugin_t */
+#define SMS_PLUGIN_THREAD_SAFE 0x01     /* handle_request() may run in several threads at once */
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** a complete request; the fields are not NUL-terminated and only valid during the call */
+typedef struct
+{
+    const char *user;
+    size_t user_len;
+    const char *image;      /* NULL if the request has no image URL */
+    size_t image_len;
+    const char *message;
+    size_t message_len;
+} sms_plugin_request_t;
+
+/** the response being built, only used through the host */
+typedef struct sms_plugin_response sms_plugin_response_t;
+
+/** functions of the server a handler calls */
+typedef struct
+{
+    unsigned abi_version;   /* SMS_PLUGIN_ABI_VERSION of the server */
+
+    /* append a file to the response; 0 on success, -1 if out of memory */
+    int (*add_file)(sms_plugin_response_t *response, const char *name, const void *data, size_t len);
+} sms_plugin_host_t;
+
+/** what a handler exports as SMS_PLUGIN_SYMBOL */
+typedef struct
+{
+    unsigned abi_version;   /* SMS_PLUGIN_ABI_VERSION the handler was built for */
+    unsigned flags;         /* SMS_PLUGIN_* */
+    const char *name;
+
+    /* set up; arg is the --handler-arg or NULL. 0 on success, -1 stops the server */
+    int (*init)(const sms_plugin_host_t *host, const char *arg, void **state);
+
+    /* answer a request with files; 0 on success, -1 to answer with an error status instead */
+    int (*handle_request)(void *state, const sms_plugin_request_t *request, sms_plugin_response_t *response);
+
+    /* release the state, may be NULL */
+    void (*shutdown)(void *state);
+} sms_plugin_t;
+
+#endif
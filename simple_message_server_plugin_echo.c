@@ -0,0 +1,169 @@
+/**
+ * @file simple_message_server_plugin_echo.c
+ * TCP/IP Server-Client project
+ *
+ * Example handler plugin of the simple_message_server:
+ *
+ *     simple_message_server -p <port> --handler ./simple_message_server_plugin_echo.so
+ *
+ * Answers every request with response.html echoing the request, like the
+ * test logic script, plus the number of requests the serving process has
+ * answered. The page is built in a buffer that is kept from request to
+ * request, so a warm handler no longer allocates. The buffer is shared,
+ * so the handler is not SMS_PLUGIN_THREAD_SAFE and the server calls it
+ * under a lock. --handler-arg sets the title of the page.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server_plugin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    const sms_plugin_host_t *host;
+    const char *title;
+    unsigned long served;   /* requests answered by this process */
+    char *page;             /* kept between requests */
+    size_t len;
+    size_t cap;
+} echo_state_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int echoInit(const sms_plugin_host_t *host, const char *arg, void **state);
+static int echoHandle(void *state, const sms_plugin_request_t *request, sms_plugin_response_t *response);
+static void echoShutdown(void *state);
+static int append(echo_state_t *echo, const char *data, size_t len);
+static int appendHtml(echo_state_t *echo, const char *data, size_t len);
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+const sms_plugin_t sms_plugin =
+{
+    SMS_PLUGIN_ABI_VERSION,
+    0,
+    "echo",
+    echoInit,
+    echoHandle,
+    echoShutdown
+};
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static int echoInit(const sms_plugin_host_t *host, const char *arg, void **state)
+{
+    echo_state_t *echo;
+
+    if ((echo = calloc(1, sizeof(*echo))) == NULL) return -1;
+
+    echo->host = host;
+    echo->title = arg != NULL ? arg : "echo";
+    *state = echo;
+    return 0;
+}
+
+static void echoShutdown(void *state)
+{
+    echo_state_t *echo = state;
+
+    free(echo->page);
+    free(echo);
+}
+
+/**
+ * \brief append to the page, growing it by doubling
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int append(echo_state_t *echo, const char *data, size_t len)
+{
+    size_t cap = echo->cap > 0 ? echo->cap : 1024;
+    char *cp;
+
+    while (cap - echo->len < len) cap *= 2;
+    if (cap != echo->cap) {
+        if ((cp = realloc(echo->page, cap)) == NULL) return -1;
+        echo->page = cp;
+        echo->cap = cap;
+    }
+
+    memcpy(echo->page + echo->len, data, len);
+    echo->len += len;
+    return 0;
+}
+
+/**
+ * \brief append text with the HTML special characters escaped
+ */
+static int appendHtml(echo_state_t *echo, const char *data, size_t len)
+{
+    size_t i, start = 0;
+    const char *entity;
+
+    for (i = 0; i < len; i++) {
+        switch (data[i]) {
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '&': entity = "&amp;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\n': entity = "<br>\n"; break;
+        default: continue;
+        }
+        if (append(echo, data + start, i - start) < 0 || append(echo, entity, strlen(entity)) < 0) return -1;
+        start = i + 1;
+    }
+
+    return append(echo, data + start, len - start);
+}
+
+static int echoHandle(void *state, const sms_plugin_request_t *request, sms_plugin_response_t *response)
+{
+    echo_state_t *echo = state;
+    char count[64];
+
+    echo->len = 0;
+    echo->served++;
+    snprintf(count, sizeof(count), "<p>request %lu of this process</p>\n", echo->served);
+
+    if (append(echo, "<html><head><title>", 19) < 0 ||
+        appendHtml(echo, echo->title, strlen(echo->title)) < 0 ||
+        append(echo, "</title></head><body>\n<p>user=", 30) < 0 ||
+        appendHtml(echo, request->user, request->user_len) < 0 ||
+        append(echo, "</p>\n", 5) < 0) return -1;
+
+    if (request->image != NULL &&
+        (append(echo, "<p>img=", 7) < 0 ||
+         appendHtml(echo, request->image, request->image_len) < 0 ||
+         append(echo, "</p>\n", 5) < 0)) return -1;
+
+    if (append(echo, "<p>", 3) < 0 ||
+        appendHtml(echo, request->message, request->message_len) < 0 ||
+        append(echo, "</p>\n", 5) < 0 ||
+        append(echo, count, strlen(count)) < 0 ||
+        append(echo, "</body></html>\n", 15) < 0) return -1;
+
+    return echo->host->add_file(response, "response.html", echo->page, echo->len);
+}
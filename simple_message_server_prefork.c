@@ -0,0 +1,360 @@
+/**
+ * @file simple_message_server_prefork.c
+ * TCP/IP Server-Client project
+ *
+ * Pre-forked worker pool engine of the simple_message_server.
+ *
+ * The parent spawns a pool of long-lived workers which all block in accept()
+ * on the shared listening socket and serve one connection after the other.
+ * With a Unix domain listener as well, the workers wait in poll() for either
+ * listener and race for the connection with a non-blocking accept().
+ * Every worker owns a slot in a scoreboard shared with the parent, so the
+ * parent can see how many workers are busy. Once per tick (or whenever a
+ * worker died) the parent respawns dead workers, grows the pool if no idle
+ * worker is left and retires idle workers if there are too many of them.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_prefork.h"
+#include "simple_message_server_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+
+/* seconds between two maintenance runs of the parent */
+#define POOL_TICK 1
+/* upper limit of workers spawned within one tick while the pool grows */
+#define MAX_SPAWN_RATE 32
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** scoreboard entry of one worker, shared between parent and workers */
+typedef struct
+{
+    volatile pid_t pid;             /* 0 if the slot is free */
+    volatile sig_atomic_t busy;     /* 1 while a connection is served */
+} pool_slot_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static pool_slot_t *spSlots;
+static int iSlotCount;
+static volatile sig_atomic_t iStop = 0;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static void onStopSignal(int signo);
+static void onChildSignal(int signo);
+static void installHandler(int signo, void (*handler)(int));
+static int spawnWorker(int sfd, int ufd, int slot);
+static void runWorker(int sfd, int ufd, int slot);
+static void reapWorkers(void);
+static void stopPool(void);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static void onStopSignal(int signo)
+{
+    (void) signo;
+    iStop = 1;
+}
+
+static void onChildSignal(int signo)
+{
+    /* nothing to do - just interrupt the sleep of the parent */
+    (void) signo;
+}
+
+/**
+ * \brief install a signal handler which interrupts blocking system calls
+ *
+ * \param signo - signal number
+ * \param handler - handler function
+ */
+static void installHandler(int signo, void (*handler)(int))
+{
+    struct sigaction sa;
+
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; /* no SA_RESTART: accept() and sleep() shall return EINTR */
+
+    if (sigaction(signo, &sa, NULL) < 0) {
+        printError("PREFORK-sigaction()", "Could not install signal handler");
+    }
+}
+
+/**
+ * \brief loop of a worker process: accept and serve connections until told to stop
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param slot - scoreboard slot of this worker
+ */
+static void runWorker(int sfd, int ufd, int slot)
+{
+    struct pollfd pfds[2];
+    int lfd = sfd, cfd;
+
+    signal(SIGCHLD, SIG_DFL);
+    installHandler(SIGTERM, onStopSignal);
+    signal(SIGINT, SIG_IGN);
+    statsBind(slot);
+
+    pfds[0].fd = sfd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = ufd;
+    pfds[1].events = POLLIN;
+
+    while (!iStop) {
+
+        if (ufd >= 0) {
+            if (poll(pfds, 2, -1) < 0) continue; //EINTR: maybe told to stop
+            /* both listeners ready: take turns, so neither starves the other */
+            if ((pfds[1].revents & POLLIN) && (lfd == sfd || !(pfds[0].revents & POLLIN))) lfd = ufd;
+            else lfd = sfd;
+        }
+
+        cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC); /* not inherited by the logic besides stdin/stdout */
+
+        if (cfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) statsEagain();
+            else if (errno != EINTR) statsAcceptError(errno);
+
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue; //try again
+            }
+
+            //RESET save_errno
+            save_errno = 0;
+
+            //MAIN ERROR MESSAGE -> keep the worker, the error might be temporary (e.g. EMFILE)
+            printError("PREFORK-WORKER-accept()", "Could not accept connection");
+            sleep(POOL_TICK);
+            continue;
+        }
+
+        statsAccept();
+        statsActive(1);
+        spSlots[slot].busy = 1;
+        (void) handleConnection(cfd);
+        spSlots[slot].busy = 0;
+        statsActive(-1);
+    }
+
+    exit(0);
+}
+
+/**
+ * \brief fork a new worker into the given scoreboard slot
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param slot - free scoreboard slot
+ *
+ * \return 0 on success, -1 if fork() failed
+ */
+static int spawnWorker(int sfd, int ufd, int slot)
+{
+    pid_t childpid;
+    uint64_t forkStart;
+
+    spSlots[slot].busy = 0;
+
+    forkStart = statsNow();
+    childpid = fork();
+
+    if (childpid < (pid_t) 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("PREFORK-fork()", "Could not spawn worker");
+        return -1;
+    }
+
+    if (childpid == (pid_t) 0) {
+        runWorker(sfd, ufd, slot);
+    }
+
+    statsSpawn(forkStart);
+    spSlots[slot].pid = childpid;
+    return 0;
+}
+
+/**
+ * \brief collect all terminated workers and free their slots
+ */
+static void reapWorkers(void)
+{
+    pid_t pid;
+    int i;
+
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (i = 0; i < iSlotCount; i++) {
+            if (spSlots[i].pid == pid) {
+                spSlots[i].pid = 0;
+                spSlots[i].busy = 0;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * \brief terminate all workers and wait for them (busy workers finish their connection first)
+ */
+static void stopPool(void)
+{
+    int i;
+
+    for (i = 0; i < iSlotCount; i++) {
+        if (spSlots[i].pid != 0) kill(spSlots[i].pid, SIGTERM);
+    }
+
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+        /* wait until all children are gone */
+    }
+}
+
+/**
+ * \brief run the pre-forked worker pool - does not return
+ *
+ * \param sfd - listening socket shared by all workers
+ * \param ufd - Unix domain listening socket shared by all workers, -1 if none
+ * \param options - pool sizes
+ */
+void runPreforkEngine(int sfd, int ufd, const smc_options_t *options)
+{
+    int i, iLive, iBusy, iIdle, iSpawn, iSpawnRate = 1;
+
+    iSlotCount = options->prefork_max;
+
+    /* scoreboard in shared memory, inherited by every worker */
+    spSlots = mmap(NULL, sizeof(pool_slot_t) * iSlotCount, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (spSlots == MAP_FAILED) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("PREFORK-mmap()", "Could not create worker scoreboard");
+        if (close(sfd) < 0 ) {
+            printError("PREFORK-mmap()-close()", "Could not create worker scoreboard and could not close socket");
+        }
+
+        //EXIT LOGIC
+        exitOnError();
+    }
+
+    for (i = 0; i < iSlotCount; i++) {
+        spSlots[i].pid = 0;
+        spSlots[i].busy = 0;
+    }
+
+    /* two listeners: a worker woken for a connection another worker took must not block in accept() */
+    if (ufd >= 0 && (fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) | O_NONBLOCK) < 0 ||
+                     fcntl(ufd, F_SETFL, fcntl(ufd, F_GETFL) | O_NONBLOCK) < 0)) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("PREFORK-fcntl()", "Could not make listeners non-blocking");
+        exitOnError();
+    }
+
+    installHandler(SIGCHLD, onChildSignal);
+    installHandler(SIGTERM, onStopSignal);
+    installHandler(SIGINT, onStopSignal);
+
+    for (i = 0; i < options->prefork_start; i++) {
+        (void) spawnWorker(sfd, ufd, i);
+    }
+
+    // MAINTENANCE LOOP - START
+    while (!iStop) {
+
+        reapWorkers();
+
+        iLive = 0;
+        iBusy = 0;
+        for (i = 0; i < iSlotCount; i++) {
+            if (spSlots[i].pid != 0) {
+                iLive++;
+                if (spSlots[i].busy) iBusy++;
+            }
+        }
+        iIdle = iLive - iBusy;
+
+        /* respawn died workers up to the minimum, grow while nobody is idle */
+        iSpawn = options->prefork_min - iLive;
+        if (iIdle == 0 && iLive >= options->prefork_min) {
+            iSpawn = iSpawnRate;
+            if (iSpawnRate < MAX_SPAWN_RATE) iSpawnRate *= 2;
+        } else {
+            iSpawnRate = 1;
+        }
+
+        for (i = 0; i < iSlotCount && iSpawn > 0; i++) {
+            if (spSlots[i].pid == 0) {
+                if (spawnWorker(sfd, ufd, i) < 0) break;
+                iSpawn--;
+            }
+        }
+
+        /* shrink: retire one idle worker per tick while more than half of the pool idles */
+        if (iLive > options->prefork_min && iIdle > iLive / 2 + 1) {
+            for (i = iSlotCount - 1; i >= 0; i--) {
+                if (spSlots[i].pid != 0 && !spSlots[i].busy) {
+                    kill(spSlots[i].pid, SIGTERM);
+                    break;
+                }
+            }
+        }
+
+        /* returns early if a worker terminated */
+        sleep(POOL_TICK);
+    }
+    // MAINTENANCE LOOP - END
+
+    stopPool();
+
+    if (close(sfd) < 0 || (ufd >= 0 && close(ufd) < 0)) {
+        printError("PREFORK-close()", "Could not close PARENT socket");
+        exitOnError();
+    }
+
+    exit(0);
+}
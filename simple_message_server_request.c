@@ -0,0 +1,330 @@
+/**
+ * @file simple_message_server_request.c
+ * TCP/IP Server-Client project
+ *
+ * Incremental parser for the requests sent by the simple_message_client.
+ *
+ * The caller appends received bytes to request->raw and calls
+ * requestParse() after every read. Only bytes that have not been looked at
+ * before are scanned, so a request arriving in many small pieces costs no
+ * more than one arriving at once. A binary request is only decoded once its
+ * frame is complete; the header tells how long to wait.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server_request.h"
+#include "simple_message_protocol.h"
+#include <string.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define USER_PREFIX "user="
+#define IMAGE_PREFIX "img="
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief compare the available bytes with a prefix which may not be complete yet
+ *
+ * \return 1 if the bytes match the prefix as far as they are available, 0 otherwise
+ */
+static int matchesPrefix(const char *data, size_t len, const char *prefix)
+{
+    size_t prefixLen = strlen(prefix);
+
+    if (len == 0) return 1;
+
+    return memcmp(data, prefix, len < prefixLen ? len : prefixLen) == 0;
+}
+
+/**
+ * \brief decode a binary request frame once all of it has been received
+ *
+ * Only the first request of a connection starts with the preamble.
+ *
+ * \return the new state, REQUEST_FRAME if more data is needed
+ */
+static sms_request_state_t parseFrame(sms_request_t *request, int eof)
+{
+    const unsigned char *data = (const unsigned char *) request->raw.data;
+    size_t len = request->raw.len;
+    size_t start = request->sequence == 0 ? PROTOCOL_PREAMBLE_SIZE : 0;
+    protocol_header_t header;
+    protocol_field_t field;
+    const unsigned char *name;
+    sms_known_file_t *known = NULL;
+    size_t pos = 0, nameLen;
+    uint64_t value;
+    int version, hasUser = 0, iResult;
+
+    request->scan = len;
+
+    if (start > 0) {
+        if ((version = protocolGetPreamble(data, len)) < 0) return REQUEST_INVALID;
+        if (version == 0) return eof ? REQUEST_INVALID : REQUEST_FRAME;
+    }
+    /* known as soon as possible, so that even a rejection is framed */
+    request->version = PROTOCOL_VERSION;
+    if (len < start + PROTOCOL_HEADER_SIZE) return eof ? REQUEST_INVALID : REQUEST_FRAME;
+
+    protocolGetHeader(data + start, &header);
+    request->id = header.id;
+    if (header.type != PROTOCOL_FRAME_REQUEST || header.length > REQUEST_MAX_SIZE) return REQUEST_INVALID;
+    if (len - start - PROTOCOL_HEADER_SIZE < header.length) {
+        return eof ? REQUEST_INVALID : REQUEST_FRAME;
+    }
+
+    data += start + PROTOCOL_HEADER_SIZE;
+    while ((iResult = protocolNextField(data, header.length, &pos, &field)) > 0) {
+        switch (field.tag) {
+        case PROTOCOL_FIELD_USER:
+            hasUser = 1;
+            request->user_off = (size_t) (field.data - (const unsigned char *) request->raw.data);
+            request->user_len = field.len;
+            break;
+        case PROTOCOL_FIELD_IMAGE:
+            request->has_image = 1;
+            request->image_off = (size_t) (field.data - (const unsigned char *) request->raw.data);
+            request->image_len = field.len;
+            break;
+        case PROTOCOL_FIELD_MESSAGE:
+            request->message_off = (size_t) (field.data - (const unsigned char *) request->raw.data);
+            request->message_len = field.len;
+            break;
+        case PROTOCOL_FIELD_ACCEPT_ENCODING:
+            if (protocolGetVarint(field.data, field.len, &value) > 0) request->encodings = (unsigned) value;
+            break;
+        case PROTOCOL_FIELD_KNOWN_FILE:
+            known = NULL;
+            if (request->known_count < REQUEST_KNOWN_FILES_MAX &&
+                protocolGetKnownFile(&field, &value, &name, &nameLen) == 0) {
+                known = &request->known[request->known_count++];
+                known->name_hash = protocolHash(name, nameLen);
+                known->hash = value;
+            }
+            break;
+        case PROTOCOL_FIELD_KNOWN_VERSION:
+            /* belongs to the known file in front of it, if that was kept */
+            if (known != NULL && protocolGetVarint(field.data, field.len, &value) > 0) {
+                known->has_version = 1;
+                known->version = value;
+            }
+            break;
+        default:
+            /* unknown fields are skipped */
+            break;
+        }
+    }
+
+    if (iResult < 0 || !hasUser) return REQUEST_INVALID;
+
+    request->keep_alive = (header.flags & PROTOCOL_FLAG_KEEP_ALIVE) != 0;
+    request->frame_len = start + PROTOCOL_HEADER_SIZE + header.length;
+    return REQUEST_COMPLETE;
+}
+
+/**
+ * \brief continue parsing the request with the bytes appended since the last call
+ *
+ * \param request - request to parse
+ * \param eof - non-zero if the peer has closed its sending direction
+ *
+ * \return the new state: REQUEST_COMPLETE and REQUEST_INVALID are final,
+ *         all other states mean that more data is needed
+ */
+sms_request_state_t requestParse(sms_request_t *request, int eof)
+{
+    const char *data = request->raw.data;
+    size_t len = request->raw.len;
+    const char *newline;
+
+    if (len > REQUEST_MAX_SIZE) {
+        request->state = REQUEST_INVALID;
+    }
+
+    while (request->state != REQUEST_COMPLETE && request->state != REQUEST_INVALID) {
+
+        switch (request->state) {
+
+        case REQUEST_USER:
+            /* the first byte tells a binary request from a text one */
+            if (len > 0 && data[0] == PROTOCOL_MAGIC[0]) {
+                request->state = REQUEST_FRAME;
+                break;
+            }
+            /* reject garbage as soon as the first bytes are there */
+            if (!matchesPrefix(data, len, USER_PREFIX)) {
+                request->state = REQUEST_INVALID;
+                break;
+            }
+            newline = len > request->scan ? memchr(data + request->scan, '\n', len - request->scan) : NULL;
+            if (newline == NULL) {
+                request->scan = len;
+                if (eof) request->state = REQUEST_INVALID;
+                return request->state;
+            }
+            request->user_off = strlen(USER_PREFIX);
+            request->user_len = (size_t) (newline - data) - request->user_off;
+            request->scan = (size_t) (newline - data) + 1;
+            request->message_off = request->scan;
+            request->state = REQUEST_IMAGE;
+            break;
+
+        case REQUEST_IMAGE:
+            /* the line start decides whether an img= line or the message follows */
+            if (!matchesPrefix(data + request->message_off, len - request->message_off, IMAGE_PREFIX)) {
+                request->state = REQUEST_MESSAGE;
+                break;
+            }
+            if (len - request->message_off < strlen(IMAGE_PREFIX)) {
+                /* a message that is shorter than the prefix */
+                if (eof) {
+                    request->state = REQUEST_MESSAGE;
+                    break;
+                }
+                return request->state;
+            }
+            newline = memchr(data + request->scan, '\n', len - request->scan);
+            if (newline == NULL) {
+                request->scan = len;
+                if (eof) request->state = REQUEST_INVALID;
+                return request->state;
+            }
+            request->has_image = 1;
+            request->image_off = request->message_off + strlen(IMAGE_PREFIX);
+            request->image_len = (size_t) (newline - data) - request->image_off;
+            request->scan = (size_t) (newline - data) + 1;
+            request->message_off = request->scan;
+            request->state = REQUEST_MESSAGE;
+            break;
+
+        case REQUEST_MESSAGE:
+            request->scan = len;
+            if (!eof) return request->state;
+            /* the client terminates the message with a newline */
+            request->message_len = len - request->message_off;
+            if (request->message_len > 0 && data[len - 1] == '\n') request->message_len--;
+            request->state = REQUEST_COMPLETE;
+            break;
+
+        case REQUEST_FRAME:
+            request->state = parseFrame(request, eof);
+            if (request->state == REQUEST_FRAME) return request->state;
+            break;
+
+        default:
+            request->state = REQUEST_INVALID;
+            break;
+        }
+    }
+
+    return request->state;
+}
+
+/**
+ * \brief render a complete request in the text format read by the external logic
+ *
+ * \param request - complete request (text or binary)
+ * \param text - buffer the text request is appended to
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int requestToText(const sms_request_t *request, sms_buffer_t *text)
+{
+    const char *data = request->raw.data;
+
+    if (bufferAppend(text, USER_PREFIX, strlen(USER_PREFIX)) < 0 ||
+        bufferAppend(text, data + request->user_off, request->user_len) < 0 ||
+        bufferAppend(text, "\n", 1) < 0) return -1;
+
+    if (request->has_image &&
+        (bufferAppend(text, IMAGE_PREFIX, strlen(IMAGE_PREFIX)) < 0 ||
+         bufferAppend(text, data + request->image_off, request->image_len) < 0 ||
+         bufferAppend(text, "\n", 1) < 0)) return -1;
+
+    if (bufferAppend(text, data + request->message_off, request->message_len) < 0) return -1;
+
+    return bufferAppend(text, "\n", 1);
+}
+
+/**
+ * \brief continue with the next request of a keep-alive connection
+ *
+ * Bytes of pipelined requests received after the current frame are kept.
+ *
+ * \param request - complete binary request
+ */
+void requestNext(sms_request_t *request)
+{
+    sms_buffer_t raw = request->raw;
+    unsigned sequence = request->sequence;
+
+    if (request->frame_len < raw.len) {
+        memmove(raw.data, raw.data + request->frame_len, raw.len - request->frame_len);
+        raw.len -= request->frame_len;
+    } else {
+        raw.len = 0;
+    }
+
+    memset(request, 0, sizeof(*request));
+    request->raw = raw;
+    request->sequence = sequence + 1;
+    request->state = REQUEST_FRAME;
+}
+
+/**
+ * \brief look up a file the client holds
+ *
+ * \return the known file, NULL if the client did not name it
+ */
+const sms_known_file_t *requestKnownFile(const sms_request_t *request, const char *name)
+{
+    uint64_t nameHash;
+    unsigned i;
+
+    if (request->known_count == 0) return NULL;
+
+    nameHash = protocolHash(name, strlen(name));
+    for (i = 0; i < request->known_count; i++) {
+        if (request->known[i].name_hash == nameHash) return &request->known[i];
+    }
+    return NULL;
+}
+
+/**
+ * \brief prepare the request for the next use, keeping its memory
+ */
+void requestReset(sms_request_t *request)
+{
+    sms_buffer_t raw = request->raw;
+
+    bufferReset(&raw);
+    memset(request, 0, sizeof(*request));
+    request->raw = raw;
+}
+
+/**
+ * \brief release the memory of the request
+ */
+void requestFree(sms_request_t *request)
+{
+    bufferFree(&request->raw);
+    memset(request, 0, sizeof(*request));
+}
@@ -0,0 +1,102 @@
+/**
+ * @file simple_message_server_request.h
+ * TCP/IP Server-Client project
+ *
+ * Incremental parser for the requests sent by the simple_message_client:
+ *
+ *     user=<user>\n
+ *     img=<image url>\n     (optional)
+ *     <message>             (everything up to the end of the stream)
+ *
+ * or a binary request frame (protocol version 2, see simple_message_protocol.h),
+ * which is complete without waiting for the end of the stream.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_REQUEST_H
+#define SIMPLE_MESSAGE_SERVER_REQUEST_H
+
+#include "simple_message_server_buffer.h"
+#include <stdint.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+
+/* requests bigger than this are rejected */
+#define REQUEST_MAX_SIZE (1024 * 1024)
+/* known files of a request beyond this are ignored */
+#define REQUEST_KNOWN_FILES_MAX 16
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** a file the client holds, both by protocolHash() */
+typedef struct
+{
+    uint64_t name_hash;
+    uint64_t hash;          /* of the content */
+    int has_version;
+    uint64_t version;       /* as sent with the file by the server */
+} sms_known_file_t;
+
+typedef enum
+{
+    REQUEST_USER = 0,       /* waiting for the user= line */
+    REQUEST_IMAGE,          /* waiting for the optional img= line */
+    REQUEST_MESSAGE,        /* reading the message until end of stream */
+    REQUEST_FRAME,          /* reading a binary request frame */
+    REQUEST_COMPLETE,
+    REQUEST_INVALID
+} sms_request_state_t;
+
+/**
+ * A request under construction. The received bytes are kept in raw, the
+ * fields are referenced by offsets into raw.data. A zeroed structure is an
+ * empty request.
+ */
+typedef struct
+{
+    sms_request_state_t state;
+    int version;            /* PROTOCOL_VERSION for a binary request, 0 for text */
+    unsigned sequence;      /* number of requests before this one on the connection */
+    uint32_t id;            /* request id of a binary request */
+    int keep_alive;         /* binary request asked to keep the connection open */
+    unsigned encodings;     /* PROTOCOL_ENCODING_* the client can decode */
+    unsigned known_count;
+    sms_known_file_t known[REQUEST_KNOWN_FILES_MAX];
+    size_t frame_len;       /* bytes of raw taken by a binary request */
+    sms_buffer_t raw;       /* all bytes received so far */
+    size_t scan;            /* first byte of raw not yet examined */
+    size_t user_off;
+    size_t user_len;
+    int has_image;
+    size_t image_off;
+    size_t image_len;
+    size_t message_off;
+    size_t message_len;     /* without the newline terminating a text request */
+} sms_request_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+sms_request_state_t requestParse(sms_request_t *request, int eof);
+int requestToText(const sms_request_t *request, sms_buffer_t *text);
+const sms_known_file_t *requestKnownFile(const sms_request_t *request, const char *name);
+void requestNext(sms_request_t *request);
+void requestReset(sms_request_t *request);
+void requestFree(sms_request_t *request);
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * @file simple_message_server_response.c
+ * TCP/IP Server-Client project
+ *
+ * Framing of the responses read by readResponse() of the client.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server_response.h"
+#include "simple_message_protocol.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+
+/* smaller files are not worth compressing */
+#define COMPRESS_MIN_SIZE 256
+/* the page is rendered for every request - speed beats the last few percent */
+#define COMPRESS_LEVEL 1
+/* encoding and size fields plus the head of the data field */
+#define COMPRESS_HEAD_MAX (2 * (2 + PROTOCOL_VARINT_MAX) + 1 + PROTOCOL_VARINT_MAX)
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief append a binary field
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int addField(sms_response_t *response, uint8_t tag, const void *data, size_t len)
+{
+    unsigned char head[1 + PROTOCOL_VARINT_MAX];
+
+    if (bufferAppend(response->buffer, head, protocolPutFieldHead(head, tag, len)) < 0) return -1;
+
+    return bufferAppend(response->buffer, data, len);
+}
+
+/**
+ * \brief append a field holding one varint
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int addVarint(sms_response_t *response, uint8_t tag, uint64_t value)
+{
+    unsigned char field[2 + PROTOCOL_VARINT_MAX];
+
+    return bufferAppend(response->buffer, field, protocolPutVarintField(field, tag, value));
+}
+
+/**
+ * \brief append file data, compressed if the client accepts it and it pays off
+ *
+ * The data is deflated right behind room for the field heads, which are
+ * put in front of it afterwards.
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int addFileData(sms_response_t *response, const void *data, size_t len)
+{
+#ifdef HAVE_ZLIB
+    sms_buffer_t *buffer = response->buffer;
+    unsigned char head[COMPRESS_HEAD_MAX], varint[PROTOCOL_VARINT_MAX];
+    unsigned char *packed;
+    uLongf packedLen;
+    size_t headLen, n;
+
+    if ((response->encodings & PROTOCOL_ENCODING_DEFLATE) && len >= COMPRESS_MIN_SIZE) {
+
+        packedLen = compressBound((uLong) len);
+        if (bufferReserve(buffer, COMPRESS_HEAD_MAX + packedLen) < 0) return -1;
+        packed = (unsigned char *) buffer->data + buffer->len + COMPRESS_HEAD_MAX;
+
+        if (compress2(packed, &packedLen, data, (uLong) len, COMPRESS_LEVEL) == Z_OK && packedLen < len) {
+
+            n = protocolPutVarint(varint, PROTOCOL_ENCODING_DEFLATE);
+            headLen = protocolPutFieldHead(head, PROTOCOL_FIELD_FILE_ENCODING, n);
+            memcpy(head + headLen, varint, n);
+            headLen += n;
+            n = protocolPutVarint(varint, len);
+            headLen += protocolPutFieldHead(head + headLen, PROTOCOL_FIELD_FILE_SIZE, n);
+            memcpy(head + headLen, varint, n);
+            headLen += n;
+            headLen += protocolPutFieldHead(head + headLen, PROTOCOL_FIELD_FILE_DATA, packedLen);
+
+            memcpy(buffer->data + buffer->len, head, headLen);
+            memmove(buffer->data + buffer->len + headLen, packed, packedLen);
+            buffer->len += headLen + packedLen;
+            return 0;
+        }
+    }
+#endif
+
+    return addField(response, PROTOCOL_FIELD_FILE_DATA, data, len);
+}
+
+/**
+ * \brief append a file block of a binary response
+ *
+ * A file the client holds with the same content is answered with an
+ * unchanged field instead of the data.
+ *
+ * \param version - version of the file, NULL if it has none
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+static int addFile(sms_response_t *response, const char *name, size_t nameLen, const uint64_t *version,
+                   const void *data, size_t len)
+{
+    uint64_t nameHash, hash = 0;
+    int hasHash = 0;
+    unsigned i;
+
+    if (addField(response, PROTOCOL_FIELD_FILE_NAME, name, nameLen) < 0) return -1;
+    if (version != NULL && addVarint(response, PROTOCOL_FIELD_FILE_VERSION, *version) < 0) return -1;
+
+    if (response->known_count > 0) {
+        nameHash = protocolHash(name, nameLen);
+        for (i = 0; i < response->known_count; i++) {
+            if (response->known[i].name_hash != nameHash) continue;
+            if (!hasHash) {
+                hash = protocolHash(data, len);
+                hasHash = 1;
+            }
+            if (response->known[i].hash == hash) return addField(response, PROTOCOL_FIELD_FILE_UNCHANGED, "", 0);
+        }
+    }
+
+    return addFileData(response, data, len);
+}
+
+/**
+ * \brief start a response in the format of the request
+ *
+ * A binary response starts with a frame header whose length is filled in
+ * by responseEnd(); the first response of a connection is preceded by the
+ * preamble.
+ *
+ * \param response - response to start
+ * \param buffer - buffer the response is appended to
+ * \param request - request to answer
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseBegin(sms_response_t *response, sms_buffer_t *buffer, const sms_request_t *request)
+{
+    unsigned char head[PROTOCOL_PREAMBLE_SIZE + PROTOCOL_HEADER_SIZE];
+    size_t start = 0;
+
+    response->buffer = buffer;
+    response->version = request->version;
+    response->id = request->id;
+    response->flags = request->keep_alive ? PROTOCOL_FLAG_KEEP_ALIVE : 0;
+    response->encodings = request->encodings & PROTOCOL_ENCODINGS_SUPPORTED;
+    response->known_count = request->known_count;
+    memcpy(response->known, request->known, request->known_count * sizeof(request->known[0]));
+    response->frame_off = 0;
+
+    if (response->version < PROTOCOL_VERSION) return 0;
+
+    if (request->sequence == 0) start = protocolPutPreamble(head, PROTOCOL_VERSION);
+    memset(head + start, 0, PROTOCOL_HEADER_SIZE);
+    /* relative to the unsent data, which bufferReserve() may move to the front */
+    response->frame_off = bufferPending(buffer) + start;
+
+    return bufferAppend(buffer, head, start + PROTOCOL_HEADER_SIZE);
+}
+
+/**
+ * \brief append the status
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseAddStatus(sms_response_t *response, int status)
+{
+    if (response->version < PROTOCOL_VERSION) return bufferPrintf(response->buffer, "status=%d\n", status);
+
+    return addVarint(response, PROTOCOL_FIELD_STATUS, (uint64_t) status);
+}
+
+/**
+ * \brief append a file block
+ *
+ * \param response - response under construction
+ * \param name - file name the client stores the data in
+ * \param data - file content
+ * \param len - length of the content
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseAddFile(sms_response_t *response, const char *name, const char *data, size_t len)
+{
+    if (response->version >= PROTOCOL_VERSION) return addFile(response, name, strlen(name), NULL, data, len);
+
+    if (bufferPrintf(response->buffer, "file=%s\nlen=%lu\n", name, (unsigned long) len) < 0) return -1;
+
+    return bufferAppend(response->buffer, data, len);
+}
+
+/**
+ * \brief append a file block with the version of the file
+ *
+ * The client reports the version with its copy, the logic can then answer
+ * with responseAddPatch(). A text response has no versions.
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseAddVersionedFile(sms_response_t *response, const char *name, uint64_t version,
+                             const char *data, size_t len)
+{
+    if (response->version < PROTOCOL_VERSION) return responseAddFile(response, name, data, len);
+
+    return addFile(response, name, strlen(name), &version, data, len);
+}
+
+/**
+ * \brief append a patch against the copy of a file the client holds
+ *
+ * Only for a binary request that named the file with a version, i.e. if
+ * requestKnownFile() found it.
+ *
+ * \param response - response under construction
+ * \param name - file name of the client's copy
+ * \param version - version of the file after the patch
+ * \param offset - where in the copy the bytes are inserted
+ * \param data - bytes to insert
+ * \param len - number of bytes to insert
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseAddPatch(sms_response_t *response, const char *name, uint64_t version, size_t offset,
+                     const char *data, size_t len)
+{
+    unsigned char head[1 + PROTOCOL_VARINT_MAX], varint[PROTOCOL_VARINT_MAX];
+    size_t n = protocolPutVarint(varint, offset);
+
+    if (addField(response, PROTOCOL_FIELD_FILE_NAME, name, strlen(name)) < 0 ||
+        addVarint(response, PROTOCOL_FIELD_FILE_VERSION, version) < 0 ||
+        bufferAppend(response->buffer, head, protocolPutFieldHead(head, PROTOCOL_FIELD_FILE_PATCH, n + len)) < 0 ||
+        bufferAppend(response->buffer, varint, n) < 0) return -1;
+
+    return bufferAppend(response->buffer, data, len);
+}
+
+/**
+ * \brief append a response given in the text format, as written by the external logic
+ *
+ * A text response is appended unchanged; for a binary response its status
+ * and file blocks are converted into fields. Output that does not follow
+ * the text format ends up as an error status.
+ *
+ * \param response - response under construction
+ * \param text - complete text response
+ * \param len - length of the text
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseAddText(sms_response_t *response, const char *text, size_t len)
+{
+    const char *end = text + len, *newline, *name;
+    size_t nameLen;
+    unsigned long fileLen;
+    char *number;
+    int hasStatus = 0;
+
+    if (response->version < PROTOCOL_VERSION) return bufferAppend(response->buffer, text, len);
+
+    while (text < end) {
+
+        if ((newline = memchr(text, '\n', (size_t) (end - text))) == NULL) break;
+
+        if (!hasStatus && strncmp(text, "status=", 7) == 0) {
+            if (responseAddStatus(response, atoi(text + 7)) < 0) return -1;
+            hasStatus = 1;
+            text = newline + 1;
+            continue;
+        }
+
+        if (strncmp(text, "file=", 5) != 0) break;
+        name = text + 5;
+        nameLen = (size_t) (newline - name);
+
+        /* len=<bytes>\n follows the file line, then the content */
+        text = newline + 1;
+        if ((newline = memchr(text, '\n', (size_t) (end - text))) == NULL || strncmp(text, "len=", 4) != 0) break;
+        fileLen = strtoul(text + 4, &number, 10);
+        if (number != newline || fileLen > (unsigned long) (end - newline - 1)) break;
+        text = newline + 1;
+
+        if (addFile(response, name, nameLen, NULL, text, (size_t) fileLen) < 0) return -1;
+        text += fileLen;
+    }
+
+    if (text < end || !hasStatus) return responseAddStatus(response, STATUS_ERROR);
+
+    return 0;
+}
+
+/**
+ * \brief finish the response: fill in the frame header of a binary response
+ */
+void responseEnd(sms_response_t *response)
+{
+    protocol_header_t header;
+
+    if (response->version < PROTOCOL_VERSION) return;
+
+    header.type = PROTOCOL_FRAME_RESPONSE;
+    header.flags = response->flags;
+    header.id = response->id;
+    header.length = (uint32_t) (bufferPending(response->buffer) - response->frame_off - PROTOCOL_HEADER_SIZE);
+    protocolPutHeader((unsigned char *) response->buffer->data + response->buffer->off + response->frame_off, &header);
+}
+
+/**
+ * \brief append a whole response carrying nothing but a status
+ *
+ * Text or framed like the request, but without keep-alive: the connection
+ * is closed behind it.
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+int responseReject(sms_buffer_t *buffer, const sms_request_t *request, int status)
+{
+    sms_response_t response;
+
+    if (responseBegin(&response, buffer, request) < 0) return -1;
+    response.flags &= (uint8_t) ~PROTOCOL_FLAG_KEEP_ALIVE;
+    if (responseAddStatus(&response, status) < 0) return -1;
+    responseEnd(&response);
+
+    return 0;
+}
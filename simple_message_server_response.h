@@ -0,0 +1,71 @@
+/**
+ * @file simple_message_server_response.h
+ * TCP/IP Server-Client project
+ *
+ * Framing of the responses read by readResponse() of the client:
+ *
+ *     status=<status>\n
+ *     file=<name>\n       (any number of file blocks)
+ *     len=<bytes>\n
+ *     <bytes>
+ *
+ * or, if the request was binary, the same content as a response frame
+ * (protocol version 2, see simple_message_protocol.h).
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_RESPONSE_H
+#define SIMPLE_MESSAGE_SERVER_RESPONSE_H
+
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_request.h"
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define STATUS_OK 0
+#define STATUS_ERROR 1
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** a response under construction, appended to buffer */
+typedef struct
+{
+    sms_buffer_t *buffer;
+    int version;            /* PROTOCOL_VERSION or 0 for text */
+    uint32_t id;            /* id of the request answered */
+    uint8_t flags;
+    unsigned encodings;     /* PROTOCOL_ENCODING_* file data may be sent in */
+    unsigned known_count;
+    sms_known_file_t known[REQUEST_KNOWN_FILES_MAX];    /* files the client holds */
+    size_t frame_off;       /* offset of the frame header from the unsent data of buffer */
+} sms_response_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+int responseBegin(sms_response_t *response, sms_buffer_t *buffer, const sms_request_t *request);
+int responseAddStatus(sms_response_t *response, int status);
+int responseAddFile(sms_response_t *response, const char *name, const char *data, size_t len);
+int responseAddVersionedFile(sms_response_t *response, const char *name, uint64_t version,
+                             const char *data, size_t len);
+int responseAddPatch(sms_response_t *response, const char *name, uint64_t version, size_t offset,
+                     const char *data, size_t len);
+int responseAddText(sms_response_t *response, const char *text, size_t len);
+void responseEnd(sms_response_t *response);
+int responseReject(sms_buffer_t *buffer, const sms_request_t *request, int status);
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file simple_message_server_shards.c
+ * TCP/IP Server-Client project
+ *
+ * Thread-per-core sharded listener engine of the simple_message_server.
+ *
+ * Every shard owns a SO_REUSEPORT listener on the server port and runs its
+ * own epoll reactor on a thread pinned to one core. The kernel spreads the
+ * incoming connections over the listeners, and since a shard never touches
+ * the listener, connections or buffers of another shard, the shards need
+ * no locking at all. A Unix domain socket path cannot be shared that way,
+ * so the first shard also serves the Unix domain listener, if any.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_epoll.h"
+#include "simple_message_server_shards.h"
+#include "simple_message_server_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    pthread_t thread;
+    int index;
+    int sfd;
+    int ufd;                /* Unix domain listener, -1 if none */
+} shard_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static void *runShard(void *arg);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static void *runShard(void *arg)
+{
+    shard_t *shard = arg;
+
+    statsBind(shard->index);
+    runReactor(shard->sfd, shard->ufd);
+    return NULL;
+}
+
+/**
+ * \brief run the sharded engine - does not return
+ *
+ * \param options - number of shards (0: one per online CPU)
+ */
+void runShardEngine(const smc_options_t *options)
+{
+    shard_t *shards;
+    pthread_attr_t attr;
+    cpu_set_t allowed, pinned;
+    int i, iCpu, iShards = options->shards;
+
+    if (iShards == 0) {
+        iShards = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (iShards < 1) iShards = 1;
+    }
+
+    /* only pin to cores we are allowed to run on */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        CPU_ZERO(&allowed);
+    }
+
+    if ((shards = calloc((size_t) iShards, sizeof(*shards))) == NULL) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("SHARDS-calloc()", "Could not allocate shards");
+        exitOnError();
+    }
+
+    /* open all listeners up front - a bind error terminates the server before any shard runs */
+    for (i = 0; i < iShards; i++) {
+        shards[i].index = i;
+        shards[i].sfd = openListener(1);
+        shards[i].ufd = -1;
+    }
+    shards[0].ufd = openUnixListener();
+
+    prepareReactors();
+
+    iCpu = -1;
+    for (i = 0; i < iShards; i++) {
+
+        pthread_attr_init(&attr);
+
+        /* next allowed CPU, round robin if there are more shards than CPUs */
+        if (CPU_COUNT(&allowed) > 0) {
+            do {
+                iCpu = (iCpu + 1) % CPU_SETSIZE;
+            } while (!CPU_ISSET(iCpu, &allowed));
+
+            CPU_ZERO(&pinned);
+            CPU_SET(iCpu, &pinned);
+            pthread_attr_setaffinity_np(&attr, sizeof(pinned), &pinned);
+        }
+
+        if ((errno = pthread_create(&shards[i].thread, &attr, runShard, &shards[i])) != 0) {
+            //RESET save_errno
+            save_errno = 0;
+
+            printError("SHARDS-pthread_create()", strerror(errno));
+            exitOnError();
+        }
+
+        pthread_attr_destroy(&attr);
+    }
+
+    /* the shards run forever */
+    for (i = 0; i < iShards; i++) {
+        pthread_join(shards[i].thread, NULL);
+    }
+
+    exit(0);
+}
@@ -0,0 +1,30 @@
+/**
+ * @file simple_message_server_shards.h
+ * TCP/IP Server-Client project
+ *
+ * Thread-per-core sharded listener engine of the simple_message_server.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_SHARDS_H
+#define SIMPLE_MESSAGE_SERVER_SHARDS_H
+
+#include "simple_message_server_commandline_handling.h"
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void runShardEngine(const smc_options_t *options);
+
+#endif
@@ -0,0 +1,540 @@
+/**
+ * @file simple_message_server_stats.c
+ * TCP/IP Server-Client project
+ *
+ * Metrics of the simple_message_server.
+ *
+ * Every worker (prefork worker process or shard thread) counts into its own
+ * cache line of a shared memory table, so counting is a relaxed atomic add
+ * without any lock or contention. Slot 0 is used by the main process, and
+ * by the children it forks per connection, which share it with atomic adds.
+ * The table is mapped MAP_SHARED before any worker exists, so the counters
+ * of worker processes are visible to the main process.
+ *
+ * A thread of the main process serves the stats socket(s): every client
+ * gets the sum of all slots in the Prometheus text format, and the
+ * connection is closed. A client starting with "GET" is answered with an
+ * HTTP response, so the TCP port can be scraped directly.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+/* accept errors with a larger errno are counted at 0 */
+#define STATS_ERRNO_MAX 134
+#define STATS_BUCKETS 16
+#define STATS_BACKLOG 8
+/* how long a stats client may take to send an HTTP request line */
+#define STATS_REQUEST_WAIT_MS 100
+#define STATS_SEND_TIMEOUT 1
+
+#define STATS_ADD(field, n) __atomic_fetch_add(&statsSelf()->field, (n), __ATOMIC_RELAXED)
+#define STATS_LOAD(value) __atomic_load_n(&(value), __ATOMIC_RELAXED)
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    uint64_t count[STATS_BUCKETS + 1];  /* last one: above the largest bound */
+    uint64_t sum;                       /* nanoseconds */
+} stats_histogram_t;
+
+/** counters of one worker, on cache lines of their own */
+typedef struct
+{
+    uint64_t accepts;
+    uint64_t eagain;                    /* EAGAIN/EWOULDBLOCK which needed a retry */
+    uint64_t active;                    /* handlers running, a signed gauge */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t busy;                      /* connections turned away while overloaded */
+    uint64_t queued;                    /* connections waiting for admission, a signed gauge */
+    uint64_t timeouts;                  /* connections closed because a deadline passed */
+    uint64_t accept_errors[STATS_ERRNO_MAX];
+    stats_histogram_t spawn;
+    stats_histogram_t request;
+} __attribute__((aligned(64))) stats_worker_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+/* upper bounds of the histogram buckets in nanoseconds, and as Prometheus labels */
+static const uint64_t bucketBounds[STATS_BUCKETS] = {
+    100000ULL, 250000ULL, 500000ULL, 1000000ULL, 2500000ULL, 5000000ULL,
+    10000000ULL, 25000000ULL, 50000000ULL, 100000000ULL, 250000000ULL,
+    500000000ULL, 1000000000ULL, 2500000000ULL, 5000000000ULL, 10000000000ULL
+};
+static const char * const bucketLabels[STATS_BUCKETS] = {
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005",
+    "0.01", "0.025", "0.05", "0.1", "0.25",
+    "0.5", "1", "2.5", "5", "10"
+};
+
+static stats_worker_t *spWorkers;
+static int iWorkerCount;
+static _Thread_local stats_worker_t *spSelf;
+static int iStatsFds[2] = { -1, -1 };
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static stats_worker_t *statsSelf(void);
+static void observe(stats_histogram_t *histogram, uint64_t start);
+static int openStatsSocket(const char *cpSocketPath);
+static int openStatsPort(const char *cpPort);
+static int dumpCounter(sms_buffer_t *out, const char *name, const char *type, const char *help, size_t offset);
+static int dumpHistogram(sms_buffer_t *out, const char *name, const char *help, size_t offset);
+static int dumpStats(sms_buffer_t *out);
+static void serveStatsClient(int cfd, sms_buffer_t *out);
+static void *runStats(void *arg);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief create the counter table - before any worker is started
+ *
+ * \param workers - number of workers with a slot of their own (besides slot 0)
+ */
+void statsInit(int workers)
+{
+    iWorkerCount = workers + 1;
+
+    spWorkers = mmap(NULL, sizeof(stats_worker_t) * (size_t) iWorkerCount, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (spWorkers == MAP_FAILED) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("STATS-mmap()", "Could not create stats table");
+        exitOnError();
+    }
+
+    spSelf = spWorkers;
+}
+
+/**
+ * \brief let the calling thread count into the slot of a worker
+ *
+ * \param worker - index of the worker, counted from 0
+ */
+void statsBind(int worker)
+{
+    spSelf = (worker >= 0 && worker + 1 < iWorkerCount) ? &spWorkers[worker + 1] : spWorkers;
+}
+
+static stats_worker_t *statsSelf(void)
+{
+    /* threads which never bound count into slot 0 */
+    return spSelf != NULL ? spSelf : spWorkers;
+}
+
+/**
+ * \brief monotonic time in nanoseconds, the start of a duration
+ */
+uint64_t statsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void statsAccept(void)
+{
+    STATS_ADD(accepts, 1);
+}
+
+void statsAcceptError(int err)
+{
+    STATS_ADD(accept_errors[err > 0 && err < STATS_ERRNO_MAX ? err : 0], 1);
+}
+
+void statsEagain(void)
+{
+    STATS_ADD(eagain, 1);
+}
+
+/**
+ * \brief a handler started (+1) or finished (-1)
+ */
+void statsActive(int delta)
+{
+    STATS_ADD(active, (uint64_t) (int64_t) delta);
+}
+
+void statsBytesIn(size_t n)
+{
+    STATS_ADD(bytes_in, (uint64_t) n);
+}
+
+void statsBytesOut(size_t n)
+{
+    STATS_ADD(bytes_out, (uint64_t) n);
+}
+
+void statsBusy(void)
+{
+    STATS_ADD(busy, 1);
+}
+
+void statsTimeout(void)
+{
+    STATS_ADD(timeouts, 1);
+}
+
+/**
+ * \brief a connection was queued (+1) or left the queue (-1)
+ */
+void statsQueued(int delta)
+{
+    STATS_ADD(queued, (uint64_t) (int64_t) delta);
+}
+
+static void observe(stats_histogram_t *histogram, uint64_t start)
+{
+    uint64_t duration = statsNow() - start;
+    int i = 0;
+
+    while (i < STATS_BUCKETS && duration > bucketBounds[i]) i++;
+
+    __atomic_fetch_add(&histogram->count[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, duration, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief a fork() started at \a start has returned in the parent
+ */
+void statsSpawn(uint64_t start)
+{
+    observe(&statsSelf()->spawn, start);
+}
+
+/**
+ * \brief the response of a request complete at \a start has been built
+ */
+void statsRequest(uint64_t start)
+{
+    observe(&statsSelf()->request, start);
+}
+
+/**
+ * \brief open the Unix domain stats socket, replacing a stale one
+ */
+static int openStatsSocket(const char *cpSocketPath)
+{
+    struct sockaddr_un addr;
+    int sfd;
+
+    if (strlen(cpSocketPath) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, cpSocketPath);
+
+    if ((sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+
+    (void) unlink(cpSocketPath);
+    if (bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sfd, STATS_BACKLOG) < 0) {
+        close(sfd);
+        return -1;
+    }
+
+    return sfd;
+}
+
+/**
+ * \brief open the stats port - on the loopback interface only
+ */
+static int openStatsPort(const char *cpPort)
+{
+    struct sockaddr_in addr;
+    int sfd, optval = 1;
+
+    if ((sfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (const void *) &optval, sizeof(int));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short) atoi(cpPort));
+
+    if (bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sfd, STATS_BACKLOG) < 0) {
+        close(sfd);
+        return -1;
+    }
+
+    return sfd;
+}
+
+/**
+ * \brief start serving the stats - exits the server if a stats socket cannot be opened
+ *
+ * The thread has all signals blocked, so they keep going to the engine.
+ *
+ * \param cpSocketPath - path of the Unix domain socket, NULL for none
+ * \param cpPort - TCP port on the loopback interface, NULL for none
+ */
+void statsServe(const char *cpSocketPath, const char *cpPort)
+{
+    pthread_t thread;
+    sigset_t all, saved;
+
+    if (cpSocketPath == NULL && cpPort == NULL) return;
+
+    //RESET save_errno
+    save_errno = 0;
+
+    if (cpSocketPath != NULL && (iStatsFds[0] = openStatsSocket(cpSocketPath)) < 0) {
+        printError("STATS-bind()", "Could not open stats socket");
+        exitOnError();
+    }
+
+    if (cpPort != NULL && (iStatsFds[1] = openStatsPort(cpPort)) < 0) {
+        printError("STATS-bind()", "Could not open stats port");
+        exitOnError();
+    }
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+    if ((errno = pthread_create(&thread, NULL, runStats, NULL)) != 0) {
+        printError("STATS-pthread_create()", strerror(errno));
+        exitOnError();
+    }
+    pthread_detach(thread);
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/**
+ * \brief one counter per worker
+ *
+ * \param offset - offset of the counter in stats_worker_t
+ */
+static int dumpCounter(sms_buffer_t *out, const char *name, const char *type, const char *help, size_t offset)
+{
+    int i;
+
+    if (bufferPrintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type) < 0) return -1;
+
+    for (i = 0; i < iWorkerCount; i++) {
+        uint64_t value = STATS_LOAD(*(uint64_t *) ((char *) &spWorkers[i] + offset));
+
+        if (bufferPrintf(out, "%s{worker=\"%d\"} %lld\n", name, i, (long long) (int64_t) value) < 0) return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief a histogram summed over all workers
+ *
+ * \param offset - offset of the stats_histogram_t in stats_worker_t
+ */
+static int dumpHistogram(sms_buffer_t *out, const char *name, const char *help, size_t offset)
+{
+    uint64_t count[STATS_BUCKETS + 1] = { 0 }, sum = 0, cumulative = 0;
+    stats_histogram_t *histogram;
+    int i, b;
+
+    for (i = 0; i < iWorkerCount; i++) {
+        histogram = (stats_histogram_t *) ((char *) &spWorkers[i] + offset);
+        for (b = 0; b <= STATS_BUCKETS; b++) count[b] += STATS_LOAD(histogram->count[b]);
+        sum += STATS_LOAD(histogram->sum);
+    }
+
+    if (bufferPrintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name) < 0) return -1;
+
+    for (b = 0; b < STATS_BUCKETS; b++) {
+        cumulative += count[b];
+        if (bufferPrintf(out, "%s_bucket{le=\"%s\"} %llu\n", name, bucketLabels[b],
+                         (unsigned long long) cumulative) < 0) return -1;
+    }
+    cumulative += count[STATS_BUCKETS];
+
+    return bufferPrintf(out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n",
+                        name, (unsigned long long) cumulative, name, (double) sum / 1e9,
+                        name, (unsigned long long) cumulative);
+}
+
+/**
+ * \brief render all metrics in the Prometheus text format
+ */
+static int dumpStats(sms_buffer_t *out)
+{
+    uint64_t value;
+    const char *cpName;
+    int i, err;
+
+    if (dumpCounter(out, "sms_accepts_total", "counter", "Connections accepted.",
+                    offsetof(stats_worker_t, accepts)) < 0 ||
+        dumpCounter(out, "sms_eagain_total", "counter", "Socket operations retried after EAGAIN.",
+                    offsetof(stats_worker_t, eagain)) < 0 ||
+        dumpCounter(out, "sms_active_handlers", "gauge", "Connections being served.",
+                    offsetof(stats_worker_t, active)) < 0 ||
+        dumpCounter(out, "sms_received_bytes_total", "counter", "Bytes received from clients.",
+                    offsetof(stats_worker_t, bytes_in)) < 0 ||
+        dumpCounter(out, "sms_sent_bytes_total", "counter", "Bytes sent to clients.",
+                    offsetof(stats_worker_t, bytes_out)) < 0 ||
+        dumpCounter(out, "sms_busy_replies_total", "counter", "Connections turned away while overloaded.",
+                    offsetof(stats_worker_t, busy)) < 0 ||
+        dumpCounter(out, "sms_queued_connections", "gauge", "Connections waiting for admission.",
+                    offsetof(stats_worker_t, queued)) < 0 ||
+        dumpCounter(out, "sms_timeouts_total", "counter", "Connections closed because a read, write or total deadline passed.",
+                    offsetof(stats_worker_t, timeouts)) < 0) {
+        return -1;
+    }
+
+    if (bufferPrintf(out, "# HELP sms_accept_errors_total Failed accepts by errno.\n"
+                     "# TYPE sms_accept_errors_total counter\n") < 0) return -1;
+
+    for (err = 0; err < STATS_ERRNO_MAX; err++) {
+        value = 0;
+        for (i = 0; i < iWorkerCount; i++) value += STATS_LOAD(spWorkers[i].accept_errors[err]);
+        if (value == 0) continue;
+
+        cpName = err == 0 ? "other" : strerrorname_np(err);
+        if (cpName != NULL) {
+            if (bufferPrintf(out, "sms_accept_errors_total{errno=\"%s\"} %llu\n", cpName,
+                             (unsigned long long) value) < 0) return -1;
+        } else if (bufferPrintf(out, "sms_accept_errors_total{errno=\"%d\"} %llu\n", err,
+                                (unsigned long long) value) < 0) {
+            return -1;
+        }
+    }
+
+    if (dumpHistogram(out, "sms_spawn_duration_seconds", "Time fork() or posix_spawn() took in the parent.",
+                      offsetof(stats_worker_t, spawn)) < 0 ||
+        dumpHistogram(out, "sms_request_duration_seconds",
+                      "Time from a complete request to its complete response.",
+                      offsetof(stats_worker_t, request)) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief answer one stats client and close the connection
+ */
+static void serveStatsClient(int cfd, sms_buffer_t *out)
+{
+    static const char cHttpHeader[] =
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+    struct timeval timeout = { STATS_SEND_TIMEOUT, 0 };
+    struct pollfd pfd = { cfd, POLLIN, 0 };
+    char cRequest[1024];
+    size_t len = 0;
+    ssize_t n;
+
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    /* an HTTP client sends its request first - read it up to the empty line */
+    while (len < sizeof(cRequest) - 1 && poll(&pfd, 1, STATS_REQUEST_WAIT_MS) > 0) {
+        if ((n = recv(cfd, cRequest + len, sizeof(cRequest) - 1 - len, 0)) <= 0) break;
+        len += (size_t) n;
+        cRequest[len] = '\0';
+        if (strstr(cRequest, "\r\n\r\n") != NULL || strstr(cRequest, "\n\n") != NULL) break;
+    }
+
+    bufferReset(out);
+    if ((len >= 3 && memcmp(cRequest, "GET", 3) == 0 &&
+         bufferAppend(out, cHttpHeader, sizeof(cHttpHeader) - 1) < 0) ||
+        dumpStats(out) < 0) {
+        printError("STATS-bufferPrintf()", "Could not render stats");
+        close(cfd);
+        return;
+    }
+
+    while (bufferPending(out) > 0) {
+        n = send(cfd, out->data + out->off, bufferPending(out), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        bufferConsume(out, (size_t) n);
+    }
+
+    close(cfd);
+}
+
+/**
+ * \brief the stats thread: serve the stats sockets forever
+ */
+static void *runStats(void *arg)
+{
+    struct pollfd pfds[2];
+    sms_buffer_t out = { NULL, 0, 0, 0 };
+    nfds_t i, nfds = 0;
+    int cfd;
+
+    (void) arg;
+
+    for (i = 0; i < 2; i++) {
+        if (iStatsFds[i] >= 0) {
+            pfds[nfds].fd = iStatsFds[i];
+            pfds[nfds].events = POLLIN;
+            nfds++;
+        }
+    }
+
+    while (1) {
+
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            printError("STATS-poll()", "Could not wait for stats clients - stats disabled");
+            break;
+        }
+
+        for (i = 0; i < nfds; i++) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            if ((cfd = accept4(pfds[i].fd, NULL, NULL, SOCK_CLOEXEC)) < 0) continue;
+            serveStatsClient(cfd, &out);
+        }
+    }
+
+    bufferFree(&out);
+    return NULL;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file simple_message_server_stats.h
+ * TCP/IP Server-Client project
+ *
+ * Metrics of the simple_message_server, dumped in the Prometheus text
+ * format over a local stats socket.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_STATS_H
+#define SIMPLE_MESSAGE_SERVER_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void statsInit(int workers);
+void statsBind(int worker);
+void statsServe(const char *cpSocketPath, const char *cpPort);
+uint64_t statsNow(void);
+void statsAccept(void);
+void statsAcceptError(int err);
+void statsEagain(void);
+void statsActive(int delta);
+void statsBytesIn(size_t n);
+void statsBytesOut(size_t n);
+void statsBusy(void);
+void statsQueued(int delta);
+void statsTimeout(void);
+void statsSpawn(uint64_t start);
+void statsRequest(uint64_t start);
+
+#endif
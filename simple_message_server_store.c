@@ -0,0 +1,894 @@
+/**
+ * @file simple_message_server_store.c
+ * TCP/IP Server-Client project
+ *
+ * Append-only message store of the built-in logic (--store <dir>).
+ *
+ * Posts are appended as checksummed records to segment files of at most
+ * STORE_SEGMENT_SIZE bytes:
+ *
+ *     <dir>/segment-00000000.log, <dir>/segment-00000001.log, ...
+ *
+ * The index file maps the sequence number of every post to its segment and
+ * offset, so a post is found in O(1). It is memory-mapped by every process
+ * and thread using the store and also holds the shared state: the number
+ * of posts, how many of them are known to be on disk, and the segment
+ * being appended to.
+ *
+ * Appending takes an flock() on the index, writes the record and publishes
+ * it in the index; the cost does not depend on the size of the board. The
+ * post is acknowledged once it is on disk (group commit): a poster takes
+ * the sync lock and runs fdatasync() for every post appended until then,
+ * so the posters queueing behind it usually find their post synced
+ * already. A segment is synced before the next one is started.
+ *
+ * The index itself is never synced, so after a crash none of it can be
+ * trusted. When the server starts, every record of the kept segments is
+ * checked and the index is written anew from them; only a torn record at
+ * the very end of the log is cut off. A store with a damaged record
+ * before the end, or an intact record behind a torn one, is not opened at
+ * all, so no acknowledged post is ever cut off.
+ *
+ * With --store-retain <n> only the newest n posts make up the board, and a
+ * background thread of the main process deletes the segments holding
+ * nothing but older posts.
+ *
+ * Every thread (and every process forked from it) opens the files on its
+ * own: flock() only keeps out other open file descriptions.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_store.h"
+#include "simple_message_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define STORE_MAGIC 0x3158444953534d53ULL   /* "SMSSIDX1" */
+#define RECORD_MAGIC 0x534d5352U
+#define INDEX_NAME "index"
+#define SYNC_NAME "sync.lock"
+#define SEGMENT_FORMAT "%s/segment-%08u.log"
+#define SEGMENT_SCAN_FORMAT "segment-%8u.log"
+/* the index entries start on the page after the header */
+#define STORE_HEADER_SIZE 4096
+#define STORE_INDEX_INITIAL 65536
+#define STORE_SEGMENT_SIZE (64 * 1024 * 1024)
+/* seconds between two runs of the compaction */
+#define STORE_COMPACT_INTERVAL 1
+#define RECORD_ALIGN 8
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** start of the index file, shared by every user of the store */
+typedef struct
+{
+    uint64_t magic;
+    uint64_t count;         /* posts appended, the sequence number of the newest */
+    uint64_t durable;       /* posts known to be on disk */
+    uint64_t first;         /* sequence number of the oldest post kept */
+    uint64_t tail;          /* end of the data in the segment appended to */
+    uint64_t capacity;      /* entries the index file has room for */
+    uint32_t segment;       /* segment appended to */
+    uint32_t first_segment; /* oldest segment kept */
+} store_header_t;
+
+/** where the post with a sequence number is */
+typedef struct
+{
+    uint32_t segment;
+    uint32_t length;
+    uint64_t offset;
+} store_entry_t;
+
+/** a record of a segment, followed by user, image URL and message, padded to RECORD_ALIGN */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t length;        /* whole record */
+    uint64_t seq;
+    int64_t time;
+    uint32_t user_len;
+    uint32_t image_len;
+    uint32_t message_len;
+    uint32_t reserved;
+    uint64_t check;         /* protocolHash() of the fields above, xor that of the payload */
+} store_record_t;
+
+/** the files of the store as opened by one thread */
+typedef struct
+{
+    pid_t pid;              /* process the descriptors were opened by */
+    int lock_fd;            /* the index, locked while appending */
+    int sync_fd;            /* locked while syncing */
+    int segment_fd;         /* segment to append to, -1 if none is open */
+    uint32_t segment;
+    store_header_t *header; /* mapping of the index */
+    size_t mapped;
+    char **segments;        /* read-only mappings by segment number, NULL if not mapped */
+    uint32_t segment_slots;
+} store_handle_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static const char *cpStorePath;
+static _Thread_local store_handle_t *spHandle;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int openStoreFile(const char *cpName, int flags);
+static void segmentPath(char *cpPath, uint32_t segment);
+static int64_t segmentSize(uint32_t segment);
+static const char *segmentMap(store_handle_t *h, uint32_t segment);
+static void unmapDropped(store_handle_t *h);
+static int openSegment(store_handle_t *h, uint32_t segment, int flags);
+static int syncDirectory(void);
+static int mapIndex(store_handle_t *h);
+static int growIndex(store_handle_t *h, uint64_t need);
+static int lowestSegment(uint32_t *pSegment);
+static int initIndex(int fd);
+static int findRecord(const char *data, uint64_t size, uint64_t pos);
+static store_handle_t *storeHandle(void);
+static int mapEntry(store_handle_t *h, uint64_t seq);
+static store_entry_t *entryAt(store_handle_t *h, uint64_t seq);
+static size_t recordLength(uint64_t payload);
+static uint64_t recordCheck(const store_record_t *record, uint64_t payloadHash);
+static size_t checkRecord(const char *data, uint64_t avail, uint64_t seq);
+static int recoverStore(store_handle_t *h);
+static int syncStore(store_handle_t *h, uint64_t seq);
+static int dropSegments(store_handle_t *h);
+static void *compactStore(void *arg);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static int openStoreFile(const char *cpName, int flags)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", cpStorePath, cpName);
+    return open(path, flags | O_CLOEXEC, 0644);
+}
+
+static void segmentPath(char *cpPath, uint32_t segment)
+{
+    snprintf(cpPath, PATH_MAX, SEGMENT_FORMAT, cpStorePath, segment);
+}
+
+/**
+ * \return the size of a segment file, -1 if it does not exist
+ */
+static int64_t segmentSize(uint32_t segment)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    segmentPath(path, segment);
+    return stat(path, &st) < 0 ? -1 : (int64_t) st.st_size;
+}
+
+/**
+ * \brief map a segment for reading
+ *
+ * The whole STORE_SEGMENT_SIZE is mapped at once, so the mapping covers
+ * everything appended later; only the bytes below the file size may be
+ * touched.
+ *
+ * \return the mapping, NULL if the segment does not exist (any more)
+ */
+static const char *segmentMap(store_handle_t *h, uint32_t segment)
+{
+    char path[PATH_MAX], **slots;
+    void *data;
+    int fd;
+
+    if (segment >= h->segment_slots) {
+        if ((slots = realloc(h->segments, (segment + 8) * sizeof(*slots))) == NULL) return NULL;
+        memset(slots + h->segment_slots, 0, (segment + 8 - h->segment_slots) * sizeof(*slots));
+        h->segments = slots;
+        h->segment_slots = segment + 8;
+    }
+
+    if (h->segments[segment] == NULL) {
+        segmentPath(path, segment);
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return NULL;
+        data = mmap(NULL, STORE_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return NULL;
+        h->segments[segment] = data;
+    }
+
+    return h->segments[segment];
+}
+
+/**
+ * \brief release the mappings of segments the compaction has deleted
+ */
+static void unmapDropped(store_handle_t *h)
+{
+    uint32_t segment, below = __atomic_load_n(&h->header->first_segment, __ATOMIC_ACQUIRE);
+
+    for (segment = 0; segment < below && segment < h->segment_slots; segment++) {
+        if (h->segments[segment] == NULL) continue;
+        munmap(h->segments[segment], STORE_SEGMENT_SIZE);
+        h->segments[segment] = NULL;
+    }
+}
+
+static int openSegment(store_handle_t *h, uint32_t segment, int flags)
+{
+    char path[PATH_MAX];
+
+    if (h->segment_fd >= 0) close(h->segment_fd);
+
+    segmentPath(path, segment);
+    h->segment = segment;
+    h->segment_fd = open(path, O_RDWR | O_CLOEXEC | flags, 0644);
+    return h->segment_fd < 0 ? -1 : 0;
+}
+
+/**
+ * \brief make a new segment file survive a crash
+ */
+static int syncDirectory(void)
+{
+    int fd, iResult;
+
+    if ((fd = open(cpStorePath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) return -1;
+    iResult = fsync(fd);
+    close(fd);
+    return iResult;
+}
+
+/**
+ * \brief (re-)map the index if it has grown since it was mapped
+ */
+static int mapIndex(store_handle_t *h)
+{
+    struct stat st;
+    void *data;
+
+    if (fstat(h->lock_fd, &st) < 0) return -1;
+    if ((size_t) st.st_size <= h->mapped) return 0;
+
+    data = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, h->lock_fd, 0);
+    if (data == MAP_FAILED) return -1;
+
+    if (h->header != NULL) munmap(h->header, h->mapped);
+    h->header = data;
+    h->mapped = (size_t) st.st_size;
+    return 0;
+}
+
+/**
+ * \brief make room for the entry of post \a need, doubling the index - with the lock held
+ */
+static int growIndex(store_handle_t *h, uint64_t need)
+{
+    uint64_t capacity = h->header->capacity > 0 ? h->header->capacity : STORE_INDEX_INITIAL;
+
+    while (capacity < need) capacity *= 2;
+
+    if (ftruncate(h->lock_fd, (off_t) (STORE_HEADER_SIZE + capacity * sizeof(store_entry_t))) < 0 ||
+        mapIndex(h) < 0) return -1;
+
+    h->header->capacity = capacity;
+    return 0;
+}
+
+/**
+ * \brief find the oldest segment file
+ *
+ * \return 1 if there is one, 0 if there are none, -1 on error
+ */
+static int lowestSegment(uint32_t *pSegment)
+{
+    struct dirent *entry;
+    unsigned segment;
+    int iFound = 0;
+    DIR *dir;
+
+    if ((dir = opendir(cpStorePath)) == NULL) return -1;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, SEGMENT_SCAN_FORMAT, &segment) == 1 && (!iFound || segment < *pSegment)) {
+            *pSegment = segment;
+            iFound = 1;
+        }
+    }
+    closedir(dir);
+
+    return iFound;
+}
+
+/**
+ * \brief write the header of a new index - with the lock held
+ *
+ * If segments are left (the index was lost), the index starts at the
+ * oldest of them and the recovery scans them all.
+ */
+static int initIndex(int fd)
+{
+    store_header_t header;
+    store_record_t record;
+    char path[PATH_MAX];
+    int segFd, iFound;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = STORE_MAGIC;
+    header.first = 1;
+    header.capacity = STORE_INDEX_INITIAL;
+
+    if ((iFound = lowestSegment(&header.first_segment)) < 0) return -1;
+
+    if (iFound == 0) {
+        header.first_segment = 0;
+    } else {
+        segmentPath(path, header.first_segment);
+        if ((segFd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+            if (pread(segFd, &record, sizeof(record), 0) == (ssize_t) sizeof(record) &&
+                record.magic == RECORD_MAGIC && record.seq > 0) header.first = record.seq;
+            close(segFd);
+        }
+    }
+    header.segment = header.first_segment;
+
+    while (header.capacity < header.first) header.capacity *= 2;
+
+    if (ftruncate(fd, 0) < 0 ||
+        ftruncate(fd, (off_t) (STORE_HEADER_SIZE + header.capacity * sizeof(store_entry_t))) < 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) return -1;
+
+    return 0;
+}
+
+/**
+ * \brief the files of the store for the calling thread, opened on first use
+ *
+ * A process forked from the thread reopens the descriptors it locks with,
+ * the mappings are inherited.
+ *
+ * \return the handle, NULL on error
+ */
+static store_handle_t *storeHandle(void)
+{
+    store_handle_t *h = spHandle;
+
+    if (h != NULL && h->pid == getpid()) return h;
+
+    if (h == NULL) {
+        if ((h = calloc(1, sizeof(*h))) == NULL) return NULL;
+        h->lock_fd = -1;
+        h->sync_fd = -1;
+        h->segment_fd = -1;
+        spHandle = h;
+    }
+
+    if (h->lock_fd >= 0) close(h->lock_fd);
+    if (h->sync_fd >= 0) close(h->sync_fd);
+    h->pid = getpid();
+
+    if ((h->lock_fd = openStoreFile(INDEX_NAME, O_RDWR)) < 0 ||
+        (h->sync_fd = openStoreFile(SYNC_NAME, O_RDWR | O_CREAT)) < 0 ||
+        mapIndex(h) < 0) {
+        printError("STORE-open()", "Could not open message store");
+        h->pid = 0;
+        return NULL;
+    }
+
+    return h;
+}
+
+/**
+ * \brief make sure the mapping of this handle covers the entry of post \a seq
+ *
+ * Another process or thread may have grown the index since it was mapped.
+ */
+static int mapEntry(store_handle_t *h, uint64_t seq)
+{
+    if (STORE_HEADER_SIZE + seq * sizeof(store_entry_t) <= h->mapped) return 0;
+    return mapIndex(h);
+}
+
+static store_entry_t *entryAt(store_handle_t *h, uint64_t seq)
+{
+    return (store_entry_t *) ((char *) h->header + STORE_HEADER_SIZE) + (seq - 1);
+}
+
+static size_t recordLength(uint64_t payload)
+{
+    return (sizeof(store_record_t) + payload + RECORD_ALIGN - 1) & ~((size_t) RECORD_ALIGN - 1);
+}
+
+static uint64_t recordCheck(const store_record_t *record, uint64_t payloadHash)
+{
+    return protocolHash(record, offsetof(store_record_t, check)) ^ payloadHash;
+}
+
+/**
+ * \brief check that a complete, intact record of post \a seq starts at \a data
+ *
+ * \param avail - bytes of the segment from \a data on
+ *
+ * \return the length of the record, 0 if there is none
+ */
+static size_t checkRecord(const char *data, uint64_t avail, uint64_t seq)
+{
+    const store_record_t *record = (const store_record_t *) data;
+    uint64_t payload;
+
+    if (avail < sizeof(*record) || record->magic != RECORD_MAGIC || record->seq != seq) return 0;
+
+    payload = (uint64_t) record->user_len + record->image_len + record->message_len;
+    if (record->length != recordLength(payload) || record->length > avail) return 0;
+
+    if (recordCheck(record, protocolHash(data + sizeof(*record), (size_t) payload)) != record->check) return 0;
+
+    return record->length;
+}
+
+/**
+ * \brief look for an intact record of any sequence number from \a pos on
+ *
+ * \return 1 if there is one, 0 if not
+ */
+static int findRecord(const char *data, uint64_t size, uint64_t pos)
+{
+    const store_record_t *record;
+
+    for (; pos + sizeof(store_record_t) <= size; pos += RECORD_ALIGN) {
+        record = (const store_record_t *) (data + pos);
+        if (record->magic == RECORD_MAGIC && checkRecord(data + pos, size - pos, record->seq) > 0) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief write the index anew from the log after a crash - with the lock held
+ *
+ * Nothing of the index is trusted but the oldest post kept: the segments
+ * are taken from the directory, and every record in them is checked and
+ * indexed. A torn record is only cut off the end of the newest segment,
+ * and only if no intact record follows it.
+ *
+ * \return 0 on success, -1 on error or if the log is damaged before its end
+ */
+static int recoverStore(store_handle_t *h)
+{
+    store_header_t *header;
+    store_entry_t *entry;
+    const store_record_t *record;
+    const char *data = NULL;
+    char path[PATH_MAX];
+    uint64_t count = 0, pos = 0, first, oldest = 1;
+    uint32_t segment = 0, lowest = 0;
+    int64_t size = 0;
+    size_t len;
+    int iFound;
+
+    if (mapIndex(h) < 0 || (iFound = lowestSegment(&lowest)) < 0) return -1;
+    header = h->header;
+    first = header->first > 0 ? header->first : 1;
+
+    /* the size of the file, not the capacity it was last grown to, tells what is mapped */
+    header->capacity = (h->mapped - STORE_HEADER_SIZE) / sizeof(store_entry_t);
+
+    if (iFound) {
+        for (segment = lowest; ; segment++) {
+
+            if ((size = segmentSize(segment)) > 0 && (data = segmentMap(h, segment)) == NULL) return -1;
+            pos = 0;
+
+            /* the oldest segment starts the count */
+            if (segment == lowest) {
+                record = (const store_record_t *) data;
+                count = size >= (int64_t) sizeof(*record) && record->magic == RECORD_MAGIC &&
+                        record->seq > 0 ? record->seq - 1 : first - 1;
+                oldest = count + 1;
+            }
+
+            while (size > 0 && (uint64_t) size > pos &&
+                   (len = checkRecord(data + pos, (uint64_t) size - pos, count + 1)) > 0) {
+                if (mapEntry(h, count + 1) < 0 ||
+                    (count + 1 > h->header->capacity && growIndex(h, count + 1) < 0)) return -1;
+                entry = entryAt(h, count + 1);
+                entry->segment = segment;
+                entry->length = (uint32_t) len;
+                entry->offset = pos;
+                count++;
+                pos += len;
+            }
+
+            if (size > (int64_t) pos && (segmentSize(segment + 1) >= 0 || findRecord(data, (uint64_t) size, pos))) {
+                /* no crash leaves this: segments are synced before the next one starts, and
+                 * posts are synced in order */
+                printError("STORE-recover()", "Damaged record before the end of the log");
+                return -1;
+            }
+
+            if (segmentSize(segment + 1) < 0) break;
+        }
+
+        if (size > (int64_t) pos) {
+            segmentPath(path, segment);
+            if (truncate(path, (off_t) pos) < 0) return -1;
+        }
+    } else {
+        count = first - 1;
+        oldest = first;
+    }
+
+    if (openSegment(h, segment, O_CREAT) < 0 || fdatasync(h->segment_fd) < 0) return -1;
+
+    header = h->header;
+    if (first < oldest) first = oldest;
+    if (first > count + 1) first = count + 1;
+    header->first_segment = lowest;
+    header->first = first;
+    header->count = count;
+    header->durable = count;
+    header->segment = segment;
+    header->tail = pos;
+    return 0;
+}
+
+/**
+ * \brief wait until post \a seq is on disk (group commit)
+ *
+ * Only one process or thread syncs at a time, covering every post appended
+ * until it started; the others find their post synced when they get the lock.
+ * Segments before the current one were synced when it was started.
+ */
+static int syncStore(store_handle_t *h, uint64_t seq)
+{
+    store_header_t *header = h->header;
+    uint64_t target;
+    uint32_t segment;
+    int iResult = 0;
+
+    if (__atomic_load_n(&header->durable, __ATOMIC_ACQUIRE) >= seq) return 0;
+
+    while (flock(h->sync_fd, LOCK_EX) < 0) {
+        if (errno != EINTR) return -1;
+    }
+
+    if (__atomic_load_n(&header->durable, __ATOMIC_ACQUIRE) < seq) {
+        target = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+        segment = __atomic_load_n(&header->segment, __ATOMIC_ACQUIRE);
+
+        if ((h->segment_fd < 0 || h->segment != segment) && openSegment(h, segment, 0) < 0) {
+            iResult = -1;
+        } else if (fdatasync(h->segment_fd) < 0) {
+            iResult = -1;
+        } else {
+            __atomic_store_n(&header->durable, target, __ATOMIC_RELEASE);
+        }
+    }
+
+    flock(h->sync_fd, LOCK_UN);
+    return iResult;
+}
+
+/**
+ * \brief move the oldest post kept up to the retention and delete the segments before it
+ */
+static int dropSegments(store_handle_t *h)
+{
+    store_header_t *header = h->header;
+    const store_record_t *next;
+    const char *data;
+    char path[PATH_MAX];
+    uint64_t first, count = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+    int iResult = 0;
+
+    if (count <= (uint64_t) options.store_retain) return 0;
+    first = count - (uint64_t) options.store_retain + 1;
+
+    while (flock(h->lock_fd, LOCK_EX) < 0) {
+        if (errno != EINTR) return -1;
+    }
+
+    if (first > header->first) __atomic_store_n(&header->first, first, __ATOMIC_RELEASE);
+
+    /* a segment goes once the first post of the next one is not kept either */
+    while (header->first_segment < header->segment) {
+        if (segmentSize(header->first_segment + 1) < (int64_t) sizeof(store_record_t) ||
+            (data = segmentMap(h, header->first_segment + 1)) == NULL) break;
+
+        next = (const store_record_t *) data;
+        if (next->seq > header->first) break;
+
+        segmentPath(path, header->first_segment);
+        if (unlink(path) < 0 && errno != ENOENT) {
+            iResult = -1;
+            break;
+        }
+        __atomic_store_n(&header->first_segment, header->first_segment + 1, __ATOMIC_RELEASE);
+    }
+
+    flock(h->lock_fd, LOCK_UN);
+    unmapDropped(h);
+    return iResult;
+}
+
+/**
+ * \brief background compaction thread of the main process
+ */
+static void *compactStore(void *arg)
+{
+    store_handle_t *h;
+
+    (void) arg;
+
+    while (1) {
+        sleep(STORE_COMPACT_INTERVAL);
+        if ((h = storeHandle()) != NULL && dropSegments(h) < 0) {
+            printError("STORE-unlink()", "Could not delete old segment");
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief create or recover the store in \a cpPath - exits the server on failure
+ *
+ * Called once in the main process before the engine starts. With
+ * --store-retain the compaction thread is started as well.
+ */
+void storeOpen(const char *cpPath)
+{
+    store_handle_t *h;
+    struct stat st;
+    pthread_t thread;
+    sigset_t all, saved;
+    uint64_t magic = 0;
+    int fd = -1;
+
+    //RESET save_errno
+    save_errno = 0;
+
+    cpStorePath = cpPath;
+
+    /* the lock keeps another server starting on the same store out until it is recovered */
+    if ((mkdir(cpPath, 0755) < 0 && errno != EEXIST) ||
+        (fd = openStoreFile(INDEX_NAME, O_RDWR | O_CREAT)) < 0 ||
+        flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0 ||
+        (st.st_size >= STORE_HEADER_SIZE && pread(fd, &magic, sizeof(magic), 0) < 0) ||
+        /* a header that never reached the disk is a lost index */
+        ((st.st_size < STORE_HEADER_SIZE || magic == 0) && initIndex(fd) < 0)) {
+        printError("STORE-open()", "Could not create message store");
+        exitOnError();
+    }
+
+    if ((h = storeHandle()) == NULL) exitOnError();
+
+    if (h->header->magic != STORE_MAGIC) {
+        printError("STORE-open()", "Not a message store");
+        exitOnError();
+    }
+
+    if (recoverStore(h) < 0) {
+        printError("STORE-recover()", "Could not recover message store");
+        exitOnError();
+    }
+
+    close(fd);
+
+    if (options.store_retain == 0) return;
+
+    /* signals stay with the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+    if ((errno = pthread_create(&thread, NULL, compactStore, NULL)) != 0) {
+        printError("STORE-pthread_create()", strerror(errno));
+        exitOnError();
+    }
+    pthread_detach(thread);
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/**
+ * \brief append a post and wait until it is on disk
+ *
+ * \param post - the post; its sequence number is filled in
+ *
+ * \return 0 on success, -1 on error
+ */
+int storeAppend(sms_post_t *post)
+{
+    static const char padding[RECORD_ALIGN];
+    store_handle_t *h;
+    store_header_t *header;
+    store_record_t *record;
+    store_entry_t *entry;
+    sms_buffer_t buffer = { NULL, 0, 0, 0 };
+    uint64_t seq = 0, payload = (uint64_t) post->user_len + post->image_len + post->message_len, payloadHash;
+    size_t len = recordLength(payload), written = 0;
+    ssize_t n;
+    int iResult = -1;
+
+    if ((h = storeHandle()) == NULL || len > STORE_SEGMENT_SIZE) return -1;
+
+    if (bufferReserve(&buffer, len) < 0) return -1;
+    buffer.len = sizeof(store_record_t);
+    if (bufferAppend(&buffer, post->user, post->user_len) < 0 ||
+        bufferAppend(&buffer, post->image, post->image_len) < 0 ||
+        bufferAppend(&buffer, post->message, post->message_len) < 0 ||
+        bufferAppend(&buffer, padding, len - buffer.len) < 0) {
+        bufferFree(&buffer);
+        return -1;
+    }
+    payloadHash = protocolHash(buffer.data + sizeof(store_record_t), (size_t) payload);
+
+    record = (store_record_t *) buffer.data;
+    memset(record, 0, sizeof(*record));
+    record->magic = RECORD_MAGIC;
+    record->length = (uint32_t) len;
+    record->time = post->time;
+    record->user_len = (uint32_t) post->user_len;
+    record->image_len = (uint32_t) post->image_len;
+    record->message_len = (uint32_t) post->message_len;
+
+    while (flock(h->lock_fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            bufferFree(&buffer);
+            return -1;
+        }
+    }
+
+    header = h->header;
+    seq = header->count + 1;
+    record->seq = seq;
+    record->check = recordCheck(record, payloadHash);
+
+    /* another handle may have grown the index since this one mapped it */
+    if (mapEntry(h, seq) < 0) goto unlock;
+    header = h->header;
+    if (seq > header->capacity && growIndex(h, seq) < 0) goto unlock;
+    header = h->header;
+
+    /* start the next segment, the full one goes to disk first */
+    if (header->tail + len > STORE_SEGMENT_SIZE) {
+        if (((h->segment_fd < 0 || h->segment != header->segment) && openSegment(h, header->segment, 0) < 0) ||
+            fdatasync(h->segment_fd) < 0 ||
+            openSegment(h, header->segment + 1, O_CREAT) < 0 || syncDirectory() < 0) goto unlock;
+        __atomic_store_n(&header->segment, header->segment + 1, __ATOMIC_RELEASE);
+        header->tail = 0;
+    }
+
+    if ((h->segment_fd < 0 || h->segment != header->segment) && openSegment(h, header->segment, O_CREAT) < 0) goto unlock;
+
+    while (written < len) {
+        if ((n = pwrite(h->segment_fd, buffer.data + written, len - written, (off_t) (header->tail + written))) < 0) {
+            if (errno == EINTR) continue;
+            goto unlock;
+        }
+        written += (size_t) n;
+    }
+
+    entry = entryAt(h, seq);
+    entry->segment = header->segment;
+    entry->length = (uint32_t) len;
+    entry->offset = header->tail;
+    header->tail += len;
+
+    /* readers only look at posts up to count */
+    __atomic_store_n(&header->count, seq, __ATOMIC_RELEASE);
+    iResult = 0;
+
+unlock:
+    flock(h->lock_fd, LOCK_UN);
+    bufferFree(&buffer);
+
+    if (iResult == 0) iResult = syncStore(h, seq);
+    if (iResult == 0) post->seq = seq;
+    return iResult;
+}
+
+/**
+ * \brief the sequence numbers of the oldest and the newest post of the board
+ *
+ * \param pFirst [OUT] - oldest post kept, pLast + 1 if there is none
+ * \param pLast [OUT] - newest post, 0 if there is none
+ *
+ * \return 0 on success, -1 on error
+ */
+int storeRange(uint64_t *pFirst, uint64_t *pLast)
+{
+    store_handle_t *h;
+    uint64_t first, last;
+
+    if ((h = storeHandle()) == NULL) return -1;
+
+    last = __atomic_load_n(&h->header->count, __ATOMIC_ACQUIRE);
+    first = __atomic_load_n(&h->header->first, __ATOMIC_ACQUIRE);
+
+    /* the compaction only catches up every STORE_COMPACT_INTERVAL */
+    if (options.store_retain > 0 && last >= (uint64_t) options.store_retain &&
+        last - (uint64_t) options.store_retain + 1 > first) {
+        first = last - (uint64_t) options.store_retain + 1;
+    }
+
+    unmapDropped(h);
+
+    *pFirst = first;
+    *pLast = last;
+    return 0;
+}
+
+/**
+ * \brief look a post up by its sequence number
+ *
+ * \param post [OUT] - the post, pointing into the store; valid until the thread exits
+ *
+ * \return 0 on success, -1 if the post is gone or was never appended
+ */
+int storeGet(uint64_t seq, sms_post_t *post)
+{
+    store_handle_t *h;
+    const store_entry_t *entry;
+    const store_record_t *record;
+    const char *data;
+
+    if ((h = storeHandle()) == NULL || seq == 0 ||
+        seq > __atomic_load_n(&h->header->count, __ATOMIC_ACQUIRE)) return -1;
+
+    /* another process may have grown the index */
+    if (mapEntry(h, seq) < 0) return -1;
+
+    entry = entryAt(h, seq);
+    if ((data = segmentMap(h, entry->segment)) == NULL) return -1;
+
+    record = (const store_record_t *) (data + entry->offset);
+    if (record->magic != RECORD_MAGIC || record->seq != seq) return -1;
+
+    post->seq = seq;
+    post->time = record->time;
+    post->user = (const char *) (record + 1);
+    post->user_len = record->user_len;
+    post->image = post->user + post->user_len;
+    post->image_len = record->image_len;
+    post->message = post->image + post->image_len;
+    post->message_len = record->message_len;
+    return 0;
+}
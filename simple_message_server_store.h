@@ -0,0 +1,51 @@
+/**
+ * @file simple_message_server_store.h
+ * TCP/IP Server-Client project
+ *
+ * Append-only message store of the built-in logic (--store <dir>).
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_STORE_H
+#define SIMPLE_MESSAGE_SERVER_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** a post; the fields are not NUL-terminated */
+typedef struct
+{
+    uint64_t seq;           /* sequence number, the first post is 1 */
+    int64_t time;           /* unix time of the post */
+    const char *user;
+    size_t user_len;
+    const char *image;      /* empty if the post has no image URL */
+    size_t image_len;
+    const char *message;
+    size_t message_len;
+} sms_post_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void storeOpen(const char *cpPath);
+int storeAppend(sms_post_t *post);
+int storeRange(uint64_t *pFirst, uint64_t *pLast);
+int storeGet(uint64_t seq, sms_post_t *post);
+
+#endif
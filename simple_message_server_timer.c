@@ -0,0 +1,254 @@
+/**
+ * @file simple_message_server_timer.c
+ * TCP/IP Server-Client project
+ *
+ * Hashed timer wheel for the connection deadlines of the event loop
+ * engines.
+ *
+ * A timer hangs in the slot of the tick it is due, in a doubly-linked list
+ * running through the timer itself, so arming and cancelling are O(1) and
+ * never allocate. Deadlines further away than one turn of the wheel
+ * (TIMER_SLOTS * TIMER_TICK_MS) share the slot with nearer ones and are
+ * skipped until their turn comes. A bitmap of the non-empty slots tells
+ * the event loop how long it may sleep, so an idle wheel causes no
+ * wakeups. Deadlines are rounded up to the next tick: a timer never fires
+ * early, and at most TIMER_TICK_MS late.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#include "simple_message_server_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define BITMAP_WORDS (TIMER_SLOTS / 64)
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static void unlinkTimer(sms_timer_t *timer);
+static void linkTimer(sms_timer_t *head, sms_timer_t *timer);
+static void updateOccupied(sms_timer_wheel_t *wheel, unsigned slot);
+static int nextOccupied(const sms_timer_wheel_t *wheel, unsigned from);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static void unlinkTimer(sms_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+static void linkTimer(sms_timer_t *head, sms_timer_t *timer)
+{
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void updateOccupied(sms_timer_wheel_t *wheel, unsigned slot)
+{
+    if (wheel->slots[slot].next != &wheel->slots[slot]) {
+        wheel->occupied[slot / 64] |= 1ULL << (slot % 64);
+    } else {
+        wheel->occupied[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+}
+
+/**
+ * \brief distance from slot \a from to the next non-empty slot, going round once
+ *
+ * \return 0 to TIMER_SLOTS - 1, or -1 if the wheel is empty
+ */
+static int nextOccupied(const sms_timer_wheel_t *wheel, unsigned from)
+{
+    unsigned i, word, slot;
+    uint64_t bits;
+
+    for (i = 0; i <= BITMAP_WORDS; i++) {
+
+        word = (from / 64 + i) % BITMAP_WORDS;
+        bits = wheel->occupied[word];
+
+        /* the first word is looked at twice: the part from the start, then the part before it */
+        if (i == 0) bits &= ~0ULL << (from % 64);
+        if (i == BITMAP_WORDS) bits &= ~(~0ULL << (from % 64));
+
+        if (bits != 0) {
+            slot = word * 64 + (unsigned) __builtin_ctzll(bits);
+            return (int) ((slot - from) & SLOT_MASK);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * \brief milliseconds of the monotonic clock
+ */
+uint64_t timerNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000ULL + (uint64_t) ts.tv_nsec / 1000000ULL;
+}
+
+/**
+ * \brief the point in time \a ms after \a now
+ *
+ * \return the deadline, 0 (none) if \a ms is 0
+ */
+uint64_t timerDeadline(uint64_t now, int ms)
+{
+    return ms > 0 ? now + (uint64_t) ms : 0;
+}
+
+/**
+ * \brief the earlier of two deadlines, where 0 stands for none
+ */
+uint64_t timerEarliest(uint64_t a, uint64_t b)
+{
+    if (a == 0) return b;
+    if (b == 0) return a;
+    return a < b ? a : b;
+}
+
+void timerWheelInit(sms_timer_wheel_t *wheel)
+{
+    unsigned i;
+
+    for (i = 0; i < TIMER_SLOTS; i++) {
+        wheel->slots[i].next = &wheel->slots[i];
+        wheel->slots[i].prev = &wheel->slots[i];
+    }
+    for (i = 0; i < BITMAP_WORDS; i++) wheel->occupied[i] = 0;
+
+    wheel->expired.next = &wheel->expired;
+    wheel->expired.prev = &wheel->expired;
+    wheel->tick = timerNow() / TIMER_TICK_MS;
+}
+
+/**
+ * \brief (re-)arm a timer
+ *
+ * \param deadline - timerNow() time the timer is due, 0 to just disarm it
+ */
+void timerArm(sms_timer_wheel_t *wheel, sms_timer_t *timer, uint64_t deadline)
+{
+    unsigned slot;
+
+    timerCancel(wheel, timer);
+    if (deadline == 0) return;
+
+    timer->expires = (deadline + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (timer->expires <= wheel->tick) timer->expires = wheel->tick + 1;
+
+    slot = (unsigned) (timer->expires & SLOT_MASK);
+    linkTimer(&wheel->slots[slot], timer);
+    updateOccupied(wheel, slot);
+}
+
+/**
+ * \brief disarm a timer, whether it is pending, due or already disarmed
+ */
+void timerCancel(sms_timer_wheel_t *wheel, sms_timer_t *timer)
+{
+    if (timer->next == NULL) return;
+
+    unlinkTimer(timer);
+    updateOccupied(wheel, (unsigned) (timer->expires & SLOT_MASK));
+}
+
+/**
+ * \brief how long an event loop may wait before timerExpire() has work
+ *
+ * \return milliseconds, 0 if timers are due, -1 if none is armed
+ */
+int timerTimeout(const sms_timer_wheel_t *wheel, uint64_t now)
+{
+    uint64_t due;
+    int distance;
+
+    if (wheel->expired.next != &wheel->expired) return 0;
+
+    if ((distance = nextOccupied(wheel, (unsigned) ((wheel->tick + 1) & SLOT_MASK))) < 0) return -1;
+
+    /* the slot may hold timers of a later turn only - waking up early is harmless */
+    due = (wheel->tick + 1 + (uint64_t) distance) * TIMER_TICK_MS;
+    if (due <= now) return 0;
+    return due - now > INT_MAX ? INT_MAX : (int) (due - now);
+}
+
+/**
+ * \brief move every timer due by \a now to the expired list
+ *
+ * Only the slots of the ticks passed since the last call are visited, at
+ * most one turn of the wheel.
+ */
+void timerExpire(sms_timer_wheel_t *wheel, uint64_t now)
+{
+    uint64_t nowTick = now / TIMER_TICK_MS, steps, i;
+    sms_timer_t *head, *timer, *next;
+    unsigned slot;
+
+    if (nowTick <= wheel->tick) return;
+
+    steps = nowTick - wheel->tick < TIMER_SLOTS ? nowTick - wheel->tick : TIMER_SLOTS;
+
+    for (i = 1; i <= steps; i++) {
+
+        slot = (unsigned) ((wheel->tick + i) & SLOT_MASK);
+        if (!(wheel->occupied[slot / 64] & (1ULL << (slot % 64)))) continue;
+
+        head = &wheel->slots[slot];
+        for (timer = head->next; timer != head; timer = next) {
+            next = timer->next;
+            if (timer->expires > nowTick) continue;
+            unlinkTimer(timer);
+            linkTimer(&wheel->expired, timer);
+        }
+        updateOccupied(wheel, slot);
+    }
+
+    wheel->tick = nowTick;
+}
+
+/**
+ * \brief take the next due timer, which is disarmed by that
+ *
+ * \return the timer, NULL if none is due
+ */
+sms_timer_t *timerNextExpired(sms_timer_wheel_t *wheel)
+{
+    sms_timer_t *timer = wheel->expired.next;
+
+    if (timer == &wheel->expired) return NULL;
+
+    unlinkTimer(timer);
+    return timer;
+}
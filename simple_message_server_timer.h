@@ -0,0 +1,66 @@
+/**
+ * @file simple_message_server_timer.h
+ * TCP/IP Server-Client project
+ *
+ * Timer wheel for the connection deadlines of the event loop engines.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_TIMER_H
+#define SIMPLE_MESSAGE_SERVER_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+/* slots of the wheel (a power of two) and the time one slot stands for */
+#define TIMER_SLOTS 1024
+#define TIMER_TICK_MS 16
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** a timer embedded in whatever it times; a zeroed timer is a valid disarmed one */
+typedef struct sms_timer
+{
+    struct sms_timer *next; /* NULL while disarmed */
+    struct sms_timer *prev;
+    uint64_t expires;       /* tick the timer is due */
+} sms_timer_t;
+
+/** a wheel is used by one thread only */
+typedef struct
+{
+    sms_timer_t slots[TIMER_SLOTS];     /* list heads */
+    uint64_t occupied[TIMER_SLOTS / 64];    /* bit set for every non-empty slot */
+    uint64_t tick;                      /* last tick expired */
+    sms_timer_t expired;                /* head of the due timers */
+} sms_timer_wheel_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+uint64_t timerNow(void);
+uint64_t timerDeadline(uint64_t now, int ms);
+uint64_t timerEarliest(uint64_t a, uint64_t b);
+void timerWheelInit(sms_timer_wheel_t *wheel);
+void timerArm(sms_timer_wheel_t *wheel, sms_timer_t *timer, uint64_t deadline);
+void timerCancel(sms_timer_wheel_t *wheel, sms_timer_t *timer);
+int timerTimeout(const sms_timer_wheel_t *wheel, uint64_t now);
+void timerExpire(sms_timer_wheel_t *wheel, uint64_t now);
+sms_timer_t *timerNextExpired(sms_timer_wheel_t *wheel);
+
+#endif
@@ -0,0 +1,741 @@
+/**
+ * @file simple_message_server_uring.c
+ * TCP/IP Server-Client project
+ *
+ * io_uring engine of the simple_message_server.
+ *
+ * One ring drives every connection. The listening socket sits in slot 0 of
+ * the registered (fixed) file table (the Unix domain listener, if any, in
+ * slot 1) and a multishot accept per listener installs every new
+ * connection directly into a free slot, so accepted sockets never
+ * become ordinary descriptors. Slot i owns registered buffer i, which is
+ * used for READ_FIXED of the request and WRITE_FIXED of the response. All
+ * submissions queued while a batch of completions is processed go to the
+ * kernel with a single io_uring_enter(), which also waits for the next
+ * batch.
+ *
+ * The deadlines of the connections are kept in a timer wheel like the
+ * epoll engine does; the wait in io_uring_enter() ends when the next one
+ * may be due. The read or write in flight on a connection whose timer
+ * expires is cancelled, and the connection is closed once it returns.
+ *
+ * The ring is set up with the raw system calls, no liburing is needed. If
+ * the kernel lacks io_uring or one of the features used, the engine returns
+ * and the server carries on with the fork-per-connection loop.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_logic.h"
+#include "simple_message_server_request.h"
+#include "simple_message_server_response.h"
+#include "simple_message_server_stats.h"
+#include "simple_message_server_timer.h"
+#include "simple_message_server_uring.h"
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+#define RING_ENTRIES 256
+/* fixed file slots (slots 0 and 1 are the listeners), limited further by RLIMIT_NOFILE */
+#define MAX_SLOTS 1024
+/* size of the registered buffer of every slot */
+#define SLOT_BUFFER_SIZE 4096
+#define LISTENER_SLOT 0
+#define UNIX_LISTENER_SLOT 1
+#define SLOT_BIT(slot) (1U << (slot))
+
+/* user_data of a submission: operation in the upper, slot in the lower half */
+#define OP_ACCEPT 1ULL
+#define OP_READ 2ULL
+#define OP_WRITE 3ULL
+#define OP_CLOSE 4ULL
+#define OP_CANCEL 5ULL
+#define USER_DATA(op, slot) (((op) << 32) | (unsigned long long) (slot))
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+typedef struct
+{
+    int active;
+    int closing;            /* close once the response is sent */
+    int expired;            /* a deadline passed: close once the operation in flight returns */
+    unsigned long long in_flight;   /* user_data of the read or write in flight */
+    sms_request_t request;
+    sms_buffer_t response;
+    uint64_t read_deadline; /* timerNow() times, 0 for none */
+    uint64_t write_deadline;
+    uint64_t total_deadline;
+    sms_timer_t timer;      /* armed for the earliest deadline */
+} slot_t;
+
+typedef struct
+{
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_local_tail;     /* tail including queued, not yet published submissions */
+    unsigned to_submit;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;              /* same mapping as sq_ring */
+    size_t sqes_size;
+    char *buffers;              /* SLOT_BUFFER_SIZE bytes per slot */
+    slot_t *slots;
+    unsigned slot_count;
+    unsigned listening;         /* SLOT_BIT of every listener slot in use */
+    unsigned accepting;         /* SLOT_BIT of every listener with multishot accept armed */
+    unsigned long accepted;
+    sms_timer_wheel_t timers;   /* deadlines of the slots */
+} ring_t;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static int ringSetup(ring_t *ring, unsigned entries);
+static void ringTeardown(ring_t *ring);
+static int ringRegister(ring_t *ring, int sfd, int ufd);
+static int ringSubmit(ring_t *ring, unsigned waitFor, int timeout);
+static struct io_uring_sqe *ringSqe(ring_t *ring);
+static void queueAccept(ring_t *ring, unsigned listener);
+static void armAccepts(ring_t *ring);
+static void queueRead(ring_t *ring, unsigned slot);
+static void queueWrite(ring_t *ring, unsigned slot);
+static void queueClose(ring_t *ring, unsigned slot);
+static void queueCancel(ring_t *ring, unsigned slot);
+static void armDeadline(ring_t *ring, unsigned slot);
+static void expireSlots(ring_t *ring);
+static void onRead(ring_t *ring, unsigned slot, int res);
+static void onWrite(ring_t *ring, unsigned slot, int res);
+static void handleRequests(ring_t *ring, unsigned slot, int eof);
+static int runRing(ring_t *ring);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                        const void *arg, size_t argSize)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void *arg, unsigned nrArgs)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+/**
+ * \brief create the ring and map its queues
+ *
+ * \return 0 on success, -1 if io_uring is not available
+ */
+static int ringSetup(ring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+    unsigned i;
+
+    memset(&params, 0, sizeof(params));
+
+    if ((ring->fd = ioUringSetup(entries, &params)) < 0) return -1;
+
+    /* single mmap for both rings and no dropped completions - both since 5.5, waits with a timeout since 5.11 */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(ring->fd);
+        ring->fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->entries = params.sq_entries;
+    /* both rings live in one mapping, big enough for the larger of the two */
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > ring->sq_ring_size) {
+        ring->sq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        return -1;
+    }
+    ring->cq_ring = ring->sq_ring;
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    sq = ring->sq_ring;
+    cq = ring->cq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    /* submission queue entry i always sits at ring position i */
+    for (i = 0; i < ring->entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    ring->sq_local_tail = *ring->sq_tail;
+
+    return 0;
+}
+
+static void ringTeardown(ring_t *ring)
+{
+    unsigned i;
+
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->sq_ring != NULL) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    if (ring->slots != NULL) {
+        for (i = 0; i < ring->slot_count; i++) {
+            requestFree(&ring->slots[i].request);
+            bufferFree(&ring->slots[i].response);
+        }
+    }
+    free(ring->slots);
+    free(ring->buffers);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * \brief register the fixed file table (listeners in slots 0 and 1, the rest empty) and the slot buffers
+ *
+ * Without a Unix domain listener slot 1 is free for a connection.
+ *
+ * \return 0 on success, -1 on failure
+ */
+static int ringRegister(ring_t *ring, int sfd, int ufd)
+{
+    struct rlimit limit;
+    struct iovec *iov;
+    int *files;
+    unsigned i;
+    int iResult;
+
+    /* the fixed file table counts against the descriptor limit */
+    ring->slot_count = MAX_SLOTS;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            (void) setrlimit(RLIMIT_NOFILE, &limit);
+        }
+        if (limit.rlim_cur < ring->slot_count) ring->slot_count = (unsigned) limit.rlim_cur;
+    }
+
+    files = malloc(ring->slot_count * sizeof(int));
+    iov = malloc(ring->slot_count * sizeof(struct iovec));
+    ring->slots = calloc(ring->slot_count, sizeof(slot_t));
+    ring->buffers = aligned_alloc(4096, (size_t) ring->slot_count * SLOT_BUFFER_SIZE);
+
+    if (files == NULL || iov == NULL || ring->slots == NULL || ring->buffers == NULL) {
+        free(files);
+        free(iov);
+        return -1;
+    }
+
+    for (i = 0; i < ring->slot_count; i++) {
+        files[i] = i == LISTENER_SLOT ? sfd : i == UNIX_LISTENER_SLOT ? ufd : -1;
+        iov[i].iov_base = ring->buffers + (size_t) i * SLOT_BUFFER_SIZE;
+        iov[i].iov_len = SLOT_BUFFER_SIZE;
+    }
+
+    iResult = ioUringRegister(ring->fd, IORING_REGISTER_FILES, files, ring->slot_count);
+    if (iResult == 0) iResult = ioUringRegister(ring->fd, IORING_REGISTER_BUFFERS, iov, ring->slot_count);
+
+    free(files);
+    free(iov);
+
+    ring->listening = SLOT_BIT(LISTENER_SLOT) | (ufd >= 0 ? SLOT_BIT(UNIX_LISTENER_SLOT) : 0);
+    return iResult < 0 ? -1 : 0;
+}
+
+/**
+ * \brief hand all queued submissions to the kernel, optionally waiting for completions
+ *
+ * \param waitFor - number of completions to wait for
+ * \param timeout - milliseconds to wait for them at most, -1 for no limit
+ *
+ * \return 0 on success (also if the wait timed out), -1 on error
+ */
+static int ringSubmit(ring_t *ring, unsigned waitFor, int timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int n;
+
+    memset(&arg, 0, sizeof(arg));
+    if (waitFor > 0 && timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long) (timeout % 1000) * 1000000LL;
+        arg.ts = (unsigned long long) (uintptr_t) &ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    /* publish the queued entries */
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    while (ring->to_submit > 0 || waitFor > 0) {
+
+        n = ioUringEnter(ring->fd, ring->to_submit, waitFor, flags,
+                         (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+                         (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            /* a deadline may be due */
+            if (errno == ETIME) return 0;
+            /* completion queue busy - reap first, the entries stay queued */
+            if (errno == EBUSY || errno == EAGAIN) {
+                statsEagain();
+                return 0;
+            }
+            return -1;
+        }
+
+        ring->to_submit -= (unsigned) n < ring->to_submit ? (unsigned) n : ring->to_submit;
+        break;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief get a cleared submission queue entry, submitting the queue if it is full
+ */
+static struct io_uring_sqe *ringSqe(ring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned head;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    while (ring->sq_local_tail - head >= ring->entries) {
+        if (ringSubmit(ring, 0, -1) < 0) return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    sqe = &ring->sqes[ring->sq_local_tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+    ring->to_submit++;
+    return sqe;
+}
+
+/**
+ * \brief arm the multishot accept which installs connections of a listener into free fixed file slots
+ */
+static void queueAccept(ring_t *ring, unsigned listener)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = ringSqe(ring)) == NULL) return;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = (int) listener;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = USER_DATA(OP_ACCEPT, listener);
+    ring->accepting |= SLOT_BIT(listener);
+}
+
+/**
+ * \brief arm the accept of every listener which has none armed
+ */
+static void armAccepts(ring_t *ring)
+{
+    if ((ring->listening & ~ring->accepting) & SLOT_BIT(LISTENER_SLOT)) queueAccept(ring, LISTENER_SLOT);
+    if ((ring->listening & ~ring->accepting) & SLOT_BIT(UNIX_LISTENER_SLOT)) queueAccept(ring, UNIX_LISTENER_SLOT);
+}
+
+/**
+ * \brief wait for (more of) the request
+ */
+static void queueRead(ring_t *ring, unsigned slot)
+{
+    struct io_uring_sqe *sqe;
+
+    ring->slots[slot].write_deadline = 0;
+    armDeadline(ring, slot);
+
+    if ((sqe = ringSqe(ring)) == NULL) return;
+
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = (int) slot;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (unsigned long) (ring->buffers + (size_t) slot * SLOT_BUFFER_SIZE);
+    sqe->len = SLOT_BUFFER_SIZE;
+    sqe->buf_index = (unsigned short) slot;
+    sqe->user_data = USER_DATA(OP_READ, slot);
+    ring->slots[slot].in_flight = sqe->user_data;
+}
+
+/**
+ * \brief send the next chunk of the response through the registered buffer of the slot
+ */
+static void queueWrite(ring_t *ring, unsigned slot)
+{
+    sms_buffer_t *response = &ring->slots[slot].response;
+    char *buffer = ring->buffers + (size_t) slot * SLOT_BUFFER_SIZE;
+    size_t len = bufferPending(response) < SLOT_BUFFER_SIZE ? bufferPending(response) : SLOT_BUFFER_SIZE;
+    struct io_uring_sqe *sqe;
+
+    /* the client has write_timeout to take a response from the moment it is pending */
+    if (ring->slots[slot].write_deadline == 0) {
+        ring->slots[slot].write_deadline = timerDeadline(timerNow(), options.write_timeout);
+        armDeadline(ring, slot);
+    }
+
+    if ((sqe = ringSqe(ring)) == NULL) return;
+
+    memcpy(buffer, response->data + response->off, len);
+
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = (int) slot;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (unsigned long) buffer;
+    sqe->len = (unsigned) len;
+    sqe->buf_index = (unsigned short) slot;
+    sqe->user_data = USER_DATA(OP_WRITE, slot);
+    ring->slots[slot].in_flight = sqe->user_data;
+}
+
+static void queueClose(ring_t *ring, unsigned slot)
+{
+    struct io_uring_sqe *sqe;
+
+    requestFree(&ring->slots[slot].request);
+    bufferFree(&ring->slots[slot].response);
+    ring->slots[slot].closing = 0;
+    timerCancel(&ring->timers, &ring->slots[slot].timer);
+
+    if ((sqe = ringSqe(ring)) == NULL) return;
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = USER_DATA(OP_CLOSE, slot);
+}
+
+/**
+ * \brief cancel the read or write in flight on a slot
+ */
+static void queueCancel(ring_t *ring, unsigned slot)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = ringSqe(ring)) == NULL) return;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = ring->slots[slot].in_flight;
+    sqe->user_data = USER_DATA(OP_CANCEL, slot);
+}
+
+/**
+ * \brief arm the timer of a slot for its earliest deadline
+ */
+static void armDeadline(ring_t *ring, unsigned slot)
+{
+    slot_t *conn = &ring->slots[slot];
+
+    timerArm(&ring->timers, &conn->timer,
+             timerEarliest(timerEarliest(conn->read_deadline, conn->write_deadline), conn->total_deadline));
+}
+
+/**
+ * \brief stop the slots whose deadline has passed
+ */
+static void expireSlots(ring_t *ring)
+{
+    sms_timer_t *timer;
+    unsigned slot;
+
+    timerExpire(&ring->timers, timerNow());
+
+    while ((timer = timerNextExpired(&ring->timers)) != NULL) {
+        slot = (unsigned) ((slot_t *) ((char *) timer - offsetof(slot_t, timer)) - ring->slots);
+        statsTimeout();
+        ring->slots[slot].expired = 1;
+        queueCancel(ring, slot);
+    }
+}
+
+/**
+ * \brief answer all complete requests, then send the responses or read on
+ *
+ * Every slot has one operation in flight at a time: the responses to all
+ * requests received so far are written before the next read.
+ *
+ * \param eof - non-zero if the client has closed its sending direction
+ */
+static void handleRequests(ring_t *ring, unsigned slot, int eof)
+{
+    slot_t *conn = &ring->slots[slot];
+    sms_request_state_t state;
+    uint64_t requestStart;
+
+    while (!conn->closing) {
+
+        /* the client closed a keep-alive connection between two requests */
+        if (eof && conn->request.raw.len == 0 && conn->request.sequence > 0) {
+            conn->closing = 1;
+            break;
+        }
+
+        state = requestParse(&conn->request, eof);
+        if (state != REQUEST_COMPLETE && state != REQUEST_INVALID) break;
+
+        if (state == REQUEST_COMPLETE) {
+            requestStart = statsNow();
+            if (logicRespond(&conn->request, &conn->response) < 0) {
+                queueClose(ring, slot);
+                return;
+            }
+            statsRequest(requestStart);
+        } else if (responseReject(&conn->response, &conn->request, STATUS_ERROR) < 0) {
+            queueClose(ring, slot);
+            return;
+        }
+
+        if (state == REQUEST_COMPLETE && conn->request.keep_alive) {
+            requestNext(&conn->request);
+            conn->read_deadline = timerDeadline(timerNow(), options.read_timeout);
+        } else {
+            requestFree(&conn->request);
+            conn->closing = 1;
+        }
+    }
+
+    if (bufferPending(&conn->response) > 0) {
+        queueWrite(ring, slot);
+    } else if (conn->closing) {
+        queueClose(ring, slot);
+    } else {
+        queueRead(ring, slot);
+    }
+}
+
+static void onRead(ring_t *ring, unsigned slot, int res)
+{
+    slot_t *conn = &ring->slots[slot];
+
+    if (res < 0 || conn->expired) {
+        queueClose(ring, slot);
+        return;
+    }
+
+    statsBytesIn((size_t) res);
+    if (res > 0 && bufferAppend(&conn->request.raw, ring->buffers + (size_t) slot * SLOT_BUFFER_SIZE, (size_t) res) < 0) {
+        queueClose(ring, slot);
+        return;
+    }
+
+    handleRequests(ring, slot, res == 0);
+}
+
+static void onWrite(ring_t *ring, unsigned slot, int res)
+{
+    sms_buffer_t *response = &ring->slots[slot].response;
+
+    if (res <= 0 || ring->slots[slot].expired) {
+        queueClose(ring, slot);
+        return;
+    }
+
+    /* a short write just leaves more for the next chunk */
+    statsBytesOut((size_t) res);
+    bufferConsume(response, (size_t) res);
+
+    if (bufferPending(response) > 0) {
+        queueWrite(ring, slot);
+    } else if (ring->slots[slot].closing) {
+        queueClose(ring, slot);
+    } else {
+        /* keep-alive: wait for the next request */
+        queueRead(ring, slot);
+    }
+}
+
+/**
+ * \brief the completion loop
+ *
+ * \return -1 if multishot accept turned out to be unsupported before the
+ *         first connection, does not return otherwise
+ */
+static int runRing(ring_t *ring)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head, tail, slot;
+    unsigned long long op;
+    uint64_t now;
+    int res;
+
+    armAccepts(ring);
+
+    while (1) {
+
+        if (ringSubmit(ring, 1, timerTimeout(&ring->timers, timerNow())) < 0) {
+            //RESET save_errno
+            save_errno = 0;
+
+            printError("URING-io_uring_enter()", "Could not submit to ring");
+            exitOnError();
+        }
+
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            op = cqe->user_data >> 32;
+            slot = (unsigned) (cqe->user_data & 0xffffffffULL);
+            res = cqe->res;
+
+            switch (op) {
+
+            case OP_ACCEPT:
+                if (res >= 0 && (unsigned) res < ring->slot_count) {
+                    statsAccept();
+                    statsActive(1);
+                    ring->accepted++;
+                    now = timerNow();
+                    ring->slots[res].active = 1;
+                    ring->slots[res].expired = 0;
+                    ring->slots[res].read_deadline = timerDeadline(now, options.read_timeout);
+                    ring->slots[res].total_deadline = timerDeadline(now, options.total_timeout);
+                    queueRead(ring, (unsigned) res);
+                } else if (res == -EINVAL && ring->accepted == 0) {
+                    /* kernel older than 5.19: no multishot accept into fixed slots */
+                    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+                    return -1;
+                } else if (res < 0) {
+                    statsAcceptError(-res);
+                }
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    /* multishot ended (e.g. table full): re-arm once a slot is closed */
+                    ring->accepting &= ~SLOT_BIT(slot);
+                    if (res != -ENFILE) queueAccept(ring, slot);
+                }
+                break;
+
+            case OP_READ:
+                onRead(ring, slot, res);
+                break;
+
+            case OP_WRITE:
+                onWrite(ring, slot, res);
+                break;
+
+            case OP_CLOSE:
+                statsActive(-1);
+                ring->slots[slot].active = 0;
+                armAccepts(ring);
+                break;
+
+            case OP_CANCEL:
+                /* the cancelled operation completes on its own */
+                break;
+            }
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        expireSlots(ring);
+    }
+}
+
+/**
+ * \brief run the io_uring engine
+ *
+ * Does not return unless io_uring is unavailable - the caller then falls
+ * back to the fork-per-connection loop.
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param options - server settings
+ */
+void runUringEngine(int sfd, int ufd, const smc_options_t *options)
+{
+    ring_t ring;
+
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+    timerWheelInit(&ring.timers);
+
+    /* accepted sockets only exist as fixed files, which cannot be handed to an exec'ed logic */
+    if (options->logic == SMS_LOGIC_EXEC) {
+        printError("URING", "io_uring needs an in-process logic - falling back to fork engine");
+        return;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (ringSetup(&ring, RING_ENTRIES) < 0 || ringRegister(&ring, sfd, ufd) < 0) {
+        printError("URING-io_uring_setup()", "io_uring not available - falling back to fork engine");
+        ringTeardown(&ring);
+        return;
+    }
+
+    if (runRing(&ring) < 0) {
+        printError("URING-accept()", "multishot accept not supported - falling back to fork engine");
+        ringTeardown(&ring);
+        return;
+    }
+}
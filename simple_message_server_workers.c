@@ -0,0 +1,462 @@
+/**
+ * @file simple_message_server_workers.c
+ * TCP/IP Server-Client project
+ *
+ * Logic worker engine of the simple_message_server.
+ *
+ * The parent keeps a fixed pool of long-running workers, each connected to
+ * it by a SOCK_SEQPACKET socket pair. The parent alone accepts connections
+ * and hands every connection to an idle worker as SCM_RIGHTS ancillary data
+ * of a one byte message, then closes its own copy. The worker serves the
+ * connection and answers with a one byte message when it is ready for the
+ * next one. So the logic runs isolated in a process of its own, as with
+ * the fork engine, without a fork() per connection, and the parent always
+ * knows which workers are idle.
+ *
+ * While no worker is idle the listeners are not polled and connections
+ * wait in the listen backlog, unless --overload busy turns them away. A
+ * worker which died is reaped and respawned into its slot. Closing the
+ * channels tells the workers to exit after their current connection.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+/**
+ * -------------------------------------------------------------- includes --
+ */
+#define _GNU_SOURCE
+#include "simple_message_server.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_stats.h"
+#include "simple_message_server_workers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * -------------------------------------------------------------- defines --
+ */
+
+/* milliseconds until the parent retries to respawn a worker fork() failed for */
+#define RESPAWN_RETRY 1000
+
+/**
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/** slot of one worker, only known to the parent */
+typedef struct
+{
+    pid_t pid;              /* 0 if the slot is empty */
+    int chan;               /* parent end of the socket pair, -1 if the slot is empty */
+    int busy;               /* 1 from handing over a connection until the worker is ready */
+} worker_slot_t;
+
+/**
+ * -------------------------------------------------------------- global variables --
+ */
+static worker_slot_t *spWorkers;
+static int iWorkerCount;
+static volatile sig_atomic_t iStop = 0;
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+static void onStopSignal(int signo);
+static int spawnWorker(int sfd, int ufd, int slot);
+static void runWorker(int chan, int slot);
+static void reapWorker(int slot);
+static int passConnection(int chan, int cfd);
+static int takeConnection(int chan);
+static void stopWorkers(void);
+
+/**
+ * ------------------------------------------------------------- functions --
+ */
+
+static void onStopSignal(int signo)
+{
+    (void) signo;
+    iStop = 1;
+}
+
+/**
+ * \brief hand a connection to a worker
+ *
+ * \param chan - parent end of the worker's socket pair
+ * \param cfd - connected client socket, stays open in the caller
+ *
+ * \return 0 on success, -1 if the worker is gone
+ */
+static int passConnection(int chan, int cfd)
+{
+    char byte = 'C';
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &cfd, sizeof(int));
+
+    while (sendmsg(chan, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief wait for the next connection of a worker
+ *
+ * \param chan - worker end of the socket pair
+ *
+ * \return the connected client socket, or -1 if the parent closed the channel
+ */
+static int takeConnection(int chan)
+{
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+    int cfd;
+
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+
+        n = recvmsg(chan, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(&cfd, CMSG_DATA(cmsg), sizeof(int));
+            return cfd;
+        }
+
+        //a message without a descriptor (e.g. the fd limit was reached): ask for the next one
+        printError("WORKERS-WORKER-recvmsg()", "Received no connection");
+        if (send(chan, "R", 1, MSG_NOSIGNAL) < 0) return -1;
+    }
+}
+
+/**
+ * \brief loop of a worker process: serve the connections handed over until the channel closes
+ *
+ * \param chan - worker end of the socket pair
+ * \param slot - slot of this worker
+ */
+static void runWorker(int chan, int slot)
+{
+    int cfd;
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_IGN);
+    statsBind(slot);
+
+    /* the parent counts the active connections, it knows which workers are busy */
+    while ((cfd = takeConnection(chan)) >= 0) {
+        (void) handleConnection(cfd);
+
+        //ready for the next connection
+        while (send(chan, "R", 1, MSG_NOSIGNAL) < 0) {
+            if (errno != EINTR) exit(1);
+        }
+    }
+
+    exit(0);
+}
+
+/**
+ * \brief fork a new worker into the given slot
+ *
+ * \param sfd - listening socket, closed in the worker
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param slot - empty slot
+ *
+ * \return 0 on success, -1 if the socket pair or fork() failed
+ */
+static int spawnWorker(int sfd, int ufd, int slot)
+{
+    int fds[2], i;
+    pid_t childpid;
+    uint64_t forkStart;
+
+    /* close-on-exec: the external logic started by a worker must not hold a channel */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("WORKERS-socketpair()", "Could not create worker channel");
+        return -1;
+    }
+
+    forkStart = statsNow();
+    childpid = fork();
+
+    if (childpid < (pid_t) 0) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("WORKERS-fork()", "Could not spawn worker");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (childpid == (pid_t) 0) {
+        //the worker neither accepts nor talks to the other workers
+        close(sfd);
+        if (ufd >= 0) close(ufd);
+        close(fds[0]);
+        for (i = 0; i < iWorkerCount; i++) {
+            if (spWorkers[i].chan >= 0) close(spWorkers[i].chan);
+        }
+
+        runWorker(fds[1], slot);
+    }
+
+    statsSpawn(forkStart);
+    close(fds[1]);
+    spWorkers[slot].pid = childpid;
+    spWorkers[slot].chan = fds[0];
+    spWorkers[slot].busy = 0;
+    return 0;
+}
+
+/**
+ * \brief collect a worker whose channel hung up and empty its slot
+ *
+ * \param slot - slot of the worker
+ */
+static void reapWorker(int slot)
+{
+    close(spWorkers[slot].chan);
+
+    while (waitpid(spWorkers[slot].pid, NULL, 0) < 0 && errno == EINTR);
+
+    /* the connection in hand died with the worker */
+    if (spWorkers[slot].busy) statsActive(-1);
+
+    spWorkers[slot].pid = 0;
+    spWorkers[slot].chan = -1;
+    spWorkers[slot].busy = 0;
+}
+
+/**
+ * \brief close all channels and wait for the workers (busy workers finish their connection first)
+ */
+static void stopWorkers(void)
+{
+    int i;
+
+    for (i = 0; i < iWorkerCount; i++) {
+        if (spWorkers[i].chan >= 0) close(spWorkers[i].chan);
+    }
+
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+        /* wait until all children are gone */
+    }
+}
+
+/**
+ * \brief run the logic worker pool - does not return
+ *
+ * \param sfd - listening socket
+ * \param ufd - Unix domain listening socket, -1 if none
+ * \param options - number of workers and overload handling
+ */
+void runWorkerEngine(int sfd, int ufd, const smc_options_t *options)
+{
+    struct pollfd *pfds;
+    struct sigaction sa;
+    int i, cfd, lfd = sfd, iIdle, iEmpty, iPaused = 0;
+    char byte;
+    ssize_t n;
+
+    iWorkerCount = options->workers;
+
+    /* pfds[0], pfds[1]: listeners, pfds[2 + i]: channel of worker i */
+    spWorkers = calloc((size_t) iWorkerCount, sizeof(*spWorkers));
+    pfds = calloc((size_t) iWorkerCount + 2, sizeof(*pfds));
+    if (spWorkers == NULL || pfds == NULL) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("WORKERS-calloc()", "Could not allocate worker slots");
+        exitOnError();
+    }
+
+    /* woken by several listeners, accept() must not block */
+    if (fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) | O_NONBLOCK) < 0 ||
+        (ufd >= 0 && fcntl(ufd, F_SETFL, fcntl(ufd, F_GETFL) | O_NONBLOCK) < 0)) {
+        //RESET save_errno
+        save_errno = 0;
+
+        printError("WORKERS-fcntl()", "Could not make listeners non-blocking");
+        exitOnError();
+    }
+
+    /* no SA_RESTART: poll() shall return EINTR */
+    sa.sa_handler = onStopSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    if (sigaction(SIGTERM, &sa, NULL) < 0 || sigaction(SIGINT, &sa, NULL) < 0) {
+        printError("WORKERS-sigaction()", "Could not install signal handler");
+    }
+
+    for (i = 0; i < iWorkerCount; i++) {
+        spWorkers[i].chan = -1;
+    }
+    for (i = 0; i < iWorkerCount; i++) {
+        (void) spawnWorker(sfd, ufd, i);
+    }
+
+    // DISPATCH LOOP - START
+    while (!iStop) {
+
+        iIdle = 0;
+        iEmpty = 0;
+        for (i = 0; i < iWorkerCount; i++) {
+            /* respawn workers which died or could not be forked */
+            if (spWorkers[i].pid == 0 && spawnWorker(sfd, ufd, i) < 0) {
+                iEmpty++;
+                pfds[2 + i].fd = -1;
+                continue;
+            }
+            if (!spWorkers[i].busy) iIdle++;
+            pfds[2 + i].fd = spWorkers[i].chan;
+            pfds[2 + i].events = POLLIN;
+        }
+
+        /* without an idle worker, connections wait in the backlog - unless they are answered busy;
+         * out of descriptors, they wait until a worker reports back or RESPAWN_RETRY passes */
+        pfds[0].fd = (!iPaused && (iIdle > 0 || options->overload == SMS_OVERLOAD_BUSY)) ? sfd : -1;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = (pfds[0].fd >= 0) ? ufd : -1;
+        pfds[1].events = POLLIN;
+
+        if (poll(pfds, (nfds_t) iWorkerCount + 2, (iEmpty > 0 || iPaused) ? RESPAWN_RETRY : -1) < 0) {
+            if (errno == EINTR) continue; //maybe told to stop
+
+            //RESET save_errno
+            save_errno = 0;
+
+            printError("WORKERS-poll()", "Could not wait for connections");
+            exitOnError();
+        }
+        iPaused = 0;
+
+        /* ready messages and hang-ups of the workers */
+        for (i = 0; i < iWorkerCount; i++) {
+            if (pfds[2 + i].fd < 0 || pfds[2 + i].revents == 0) continue;
+
+            while ((n = recv(spWorkers[i].chan, &byte, 1, MSG_DONTWAIT)) < 0 && errno == EINTR);
+
+            if (n > 0) {
+                if (spWorkers[i].busy) statsActive(-1);
+                spWorkers[i].busy = 0;
+            } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                reapWorker(i);
+            }
+        }
+
+        /* both listeners ready: take turns, so neither starves the other */
+        if ((pfds[1].revents & POLLIN) && (lfd == sfd || !(pfds[0].revents & POLLIN))) lfd = ufd;
+        else if (pfds[0].revents & POLLIN) lfd = sfd;
+        else continue;
+
+        cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (cfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) statsEagain();
+            else if (errno != EINTR) statsAcceptError(errno);
+
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue; //try again
+            }
+
+            if (errno == EMFILE || errno == ENFILE) {
+                /* level triggered: polling the listeners again would spin */
+                printError("WORKERS-accept()", "Out of descriptors - pausing accept");
+                iPaused = 1;
+                continue;
+            }
+
+            //RESET save_errno
+            save_errno = 0;
+
+            //MAIN ERROR MESSAGE -> keep serving, the error might be temporary
+            printError("WORKERS-accept()", "Could not accept connection");
+            continue;
+        }
+
+        statsAccept();
+
+        /* the first idle worker whose channel still takes the connection */
+        for (i = 0; i < iWorkerCount; i++) {
+            if (spWorkers[i].pid == 0 || spWorkers[i].busy) continue;
+            if (passConnection(spWorkers[i].chan, cfd) == 0) break;
+            reapWorker(i);
+        }
+
+        if (i < iWorkerCount) {
+            spWorkers[i].busy = 1;
+            statsActive(1);
+            close(cfd);
+        } else {
+            rejectBusy(cfd);
+        }
+    }
+    // DISPATCH LOOP - END
+
+    stopWorkers();
+
+    if (close(sfd) < 0 || (ufd >= 0 && close(ufd) < 0)) {
+        printError("WORKERS-close()", "Could not close PARENT socket");
+        exitOnError();
+    }
+
+    exit(0);
+}
@@ -0,0 +1,31 @@
+/**
+ * @file simple_message_server_workers.h
+ * TCP/IP Server-Client project
+ *
+ * Logic worker engine of the simple_message_server: connections are handed
+ * to long-running workers over Unix domain sockets.
+ *
+ * @author Karin Kalman <karin.kalman@technikum-wien.at>
+ * @author Michael Mueller <michael.mueller@technikum-wien.at>
+ * @author Gerhard Sabeditsch <gerhard.sabeditsch@technikum-wien.at>
+ * @date 2016/12/10
+ *
+ * @version $Revision: 1 $
+ *
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: Gerhard $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_WORKERS_H
+#define SIMPLE_MESSAGE_SERVER_WORKERS_H
+
+#include "simple_message_server_commandline_handling.h"
+
+/**
+ * --------------------------------------------------- function prototypes --
+ */
+void runWorkerEngine(int sfd, int ufd, const smc_options_t *options);
+
+#endif